@@ -0,0 +1,512 @@
+#include "../include/shell.h"
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/*
+ * Microbenchmarks for the shell's hot paths: tokenizing and parsing command
+ * lines, the dangerous-command lookup for growing blacklists, prompt
+ * rendering, history search, glob expansion, and mcalc's parse/compute/print
+ * steps. Every
+ * case is repeated until it has run for at least BENCH_MIN_SECONDS and is
+ * reported as one JSON object per line, in ns/op and MB/s. "--baseline
+ * old.json" adds the relative change against an earlier run, so two builds
+ * can be compared directly:
+ *
+ *     ./obj/bench_core > before.json
+ *     ./obj/bench_core --baseline before.json
+ */
+
+#define BENCH_MIN_SECONDS 0.2
+
+typedef struct
+{
+    char name[64];
+    char param[64];
+    double ns_per_op;
+} bench_baseline_t;
+
+typedef struct
+{
+    const char *line; // Command line to process
+    size_t len;       // Length of line
+} line_arg_t;
+
+typedef struct
+{
+    matrix_t *operands[4];
+    int count;
+    char operation;
+} compute_arg_t;
+
+static bench_baseline_t *baseline = NULL;
+static int baseline_count = 0;
+static int results_printed = 0;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Seconds per call of fn, growing the repetition count until the run is long enough to trust */
+static double time_per_op(void (*fn)(void *), void *arg)
+{
+    long iters = 1;
+
+    for (;;)
+    {
+        double t0 = now_seconds();
+        for (long i = 0; i < iters; i++)
+        {
+            fn(arg);
+        }
+        double elapsed = now_seconds() - t0;
+
+        if (elapsed >= BENCH_MIN_SECONDS)
+            return elapsed / iters;
+
+        if (elapsed < BENCH_MIN_SECONDS / 100)
+            iters *= 100;
+        else
+            iters = (long)(iters * BENCH_MIN_SECONDS * 1.2 / elapsed) + 1;
+    }
+}
+
+static void load_baseline(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    char line[512];
+    int capacity = 0;
+    bench_baseline_t entry;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"param\": \"%63[^\"]\", \"ns_per_op\": %lf",
+                   entry.name, entry.param, &entry.ns_per_op) != 3)
+            continue;
+
+        if (baseline_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 32;
+            baseline = realloc(baseline, capacity * sizeof(*baseline));
+            if (!baseline)
+            {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        baseline[baseline_count++] = entry;
+    }
+    fclose(file);
+}
+
+static const bench_baseline_t *find_baseline(const char *name, const char *param)
+{
+    for (int i = 0; i < baseline_count; i++)
+    {
+        if (strcmp(baseline[i].name, name) == 0 && strcmp(baseline[i].param, param) == 0)
+            return &baseline[i];
+    }
+    return NULL;
+}
+
+static void report(const char *name, const char *param, double seconds, double bytes)
+{
+    double ns = seconds * 1e9;
+
+    printf("%s  {\"name\": \"%s\", \"param\": \"%s\", \"ns_per_op\": %.1f, \"mb_per_s\": %.2f",
+           results_printed++ ? ",\n" : "", name, param, ns, bytes / seconds / 1e6);
+
+    const bench_baseline_t *base = find_baseline(name, param);
+    if (base)
+    {
+        printf(", \"baseline_ns_per_op\": %.1f, \"change_pct\": %.1f", base->ns_per_op,
+               (ns - base->ns_per_op) / base->ns_per_op * 100.0);
+    }
+    printf("}");
+    fflush(stdout);
+}
+
+static void run_tokenize(void *arg)
+{
+    line_arg_t *a = arg;
+    arena_chunk_t *arena = NULL;
+    char **tokens;
+
+    if (tokenize(a->line, &arena, &tokens, NULL) >= 0)
+        free(tokens);
+    arena_free(arena);
+}
+
+static void run_parse_line(void *arg)
+{
+    line_arg_t *a = arg;
+    free_pipeline(parse_line(a->line));
+}
+
+static void bench_command_lines(void)
+{
+    static const struct
+    {
+        const char *param;
+        const char *line;
+    } lines[] = {
+        {"simple", "ls -la"},
+        {"pipe", "cat /var/log/syslog | grep -v \"cron job\" 2> errors.log"},
+        {"background", "sleep 10 &"},
+        {"expand", "cp ~/notes.txt \"$HOME/backup/${HOME}.txt\" $PATH"},
+        {"redirect", "sort -u < names.txt > sorted.txt 2>> errors.log"},
+    };
+
+    // A 256-argument line on top of the typical ones
+    char long_line[4096];
+    size_t pos = (size_t)snprintf(long_line, sizeof(long_line), "echo");
+    for (int i = 0; i < 256; i++)
+        pos += (size_t)snprintf(long_line + pos, sizeof(long_line) - pos, " arg%d", i);
+
+    for (size_t i = 0; i <= sizeof(lines) / sizeof(lines[0]); i++)
+    {
+        const char *param = i < sizeof(lines) / sizeof(lines[0]) ? lines[i].param : "256 args";
+        line_arg_t arg = {i < sizeof(lines) / sizeof(lines[0]) ? lines[i].line : long_line, 0};
+        arg.len = strlen(arg.line);
+
+        report("tokenize", param, time_per_op(run_tokenize, &arg), arg.len);
+        report("parse_line", param, time_per_op(run_parse_line, &arg), arg.len);
+    }
+}
+
+static void run_dangerous(void *arg)
+{
+    int index;
+    is_dangerous_command(arg, &index);
+}
+
+static void bench_dangerous(void)
+{
+    for (size_t n = 10; n <= 100000; n *= 10)
+    {
+        char path[] = "/tmp/bench_core_XXXXXX";
+        int fd = mkstemp(path);
+        FILE *file = fd == -1 ? NULL : fdopen(fd, "w");
+        if (!file)
+        {
+            perror("mkstemp");
+            exit(1);
+        }
+
+        char last[64];
+        for (size_t i = 0; i < n; i++)
+        {
+            snprintf(last, sizeof(last), "cmd%zu --force /srv/data%zu", i, i);
+            fprintf(file, "%s\n", last);
+        }
+        fclose(file);
+
+        if (load_dangerous_commands(path) != n)
+        {
+            fprintf(stderr, "bench_core: blacklist of %zu entries did not load\n", n);
+            exit(1);
+        }
+        unlink(path);
+
+        // Both cases are hash lookups, so the time should not grow with n;
+        // throughput is measured over the bytes of the checked command
+        char param[64];
+        char miss[] = "ls -la /srv";
+        snprintf(param, sizeof(param), "n=%zu miss", n);
+        report("is_dangerous_command", param, time_per_op(run_dangerous, miss), strlen(miss));
+        snprintf(param, sizeof(param), "n=%zu exact", n);
+        report("is_dangerous_command", param, time_per_op(run_dangerous, last), strlen(last));
+    }
+    free_dangerous_commands();
+}
+
+static void run_prompt_cached(void *arg)
+{
+    display_prompt(arg);
+}
+
+static void run_prompt_changed(void *arg)
+{
+    command_stats_t *s = arg;
+    s->cmds_count++;
+    update_command_stats(s, 0.00123);
+    display_prompt(s);
+}
+
+static void bench_prompt(void)
+{
+    command_stats_t s;
+    memset(&s, 0, sizeof(s));
+    s.min_time = DBL_MAX;
+    s.cmds_count = 1;
+    update_command_stats(&s, 0.00042);
+
+    // Length of one rendered prompt, for MB/s
+    int capture_fd = capture_open("bench-prompt");
+    int saved = redirect_fd(STDOUT_FILENO, capture_fd);
+    display_prompt(&s);
+    restore_fd(STDOUT_FILENO, saved);
+    double prompt_len = (double)lseek(capture_fd, 0, SEEK_END);
+    close(capture_fd);
+
+    // An empty line redraws the same prompt; an executed command changes it
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    saved = redirect_fd(STDOUT_FILENO, null_fd);
+    double cached = time_per_op(run_prompt_cached, &s);
+    double changed = time_per_op(run_prompt_changed, &s);
+    restore_fd(STDOUT_FILENO, saved);
+    close(null_fd);
+
+    report("display_prompt", "unchanged", cached, prompt_len);
+    report("display_prompt", "changed", changed, prompt_len);
+}
+
+typedef struct
+{
+    history_query_t query;
+    size_t total;
+} history_arg_t;
+
+static void run_history_find(void *arg)
+{
+    history_arg_t *a = arg;
+    history_find(&a->query, a->total, -1);
+}
+
+static void run_history_scan(void *arg)
+{
+    history_arg_t *a = arg;
+    history_query_t plain = a->query;
+    plain.gram_count = 0; // No trigrams: every block is scanned
+    history_find(&plain, a->total, -1);
+}
+
+static void bench_history(unsigned int *seed)
+{
+    static const char *verbs[] = {"ls -la", "git status", "make -j8", "cd /srv/app", "grep -rn TODO src",
+                                  "cat /var/log/syslog | grep -v cron", "mcalc \"[2,2:1,2,3,4]\" \"[2,2:1,1,1,1]\" ADD"};
+
+    for (size_t n = 100000; n <= 1000000; n *= 10)
+    {
+        char path[] = "/tmp/bench_history_XXXXXX";
+        int fd = mkstemp(path);
+        FILE *file = fd == -1 ? NULL : fdopen(fd, "w");
+        if (!file)
+        {
+            perror("mkstemp");
+            exit(1);
+        }
+
+        // Typical commands, with the searched-for one as the oldest entry
+        fprintf(file, "ssh deploy@build-07 uptime\n");
+        for (size_t i = 1; i < n; i++)
+            fprintf(file, "%s %u\n", verbs[rand_r(seed) % (sizeof(verbs) / sizeof(verbs[0]))], rand_r(seed) % 10000);
+        double history_bytes = (double)ftell(file);
+        fclose(file);
+
+        if (history_open(path) == -1)
+            exit(1);
+        unlink(path);
+
+        history_arg_t arg;
+        arg.total = history_refresh();
+        while (history_indexed() + HISTORY_BLOCK_ENTRIES <= arg.total)
+        {
+            usleep(1000);
+            history_refresh();
+        }
+
+        // The worst case for !?text and history -s: the only match is the oldest entry
+        char param[64];
+        history_query_init(&arg.query, "build-07", 8, 0);
+        snprintf(param, sizeof(param), "n=%zu substring", n);
+        report("history_find", param, time_per_op(run_history_find, &arg), history_bytes);
+        snprintf(param, sizeof(param), "n=%zu substring scan", n);
+        report("history_find", param, time_per_op(run_history_scan, &arg), history_bytes);
+
+        history_query_init(&arg.query, "ssh deploy", 10, 1);
+        snprintf(param, sizeof(param), "n=%zu prefix", n);
+        report("history_find", param, time_per_op(run_history_find, &arg), history_bytes);
+        history_close();
+    }
+}
+
+static void run_expand_globs(void *arg)
+{
+    pipeline_t *pipeline = parse_line(arg);
+    expand_globs(pipeline);
+    free_pipeline(pipeline);
+}
+
+static void run_expand_globs_uncached(void *arg)
+{
+    glob_cache_free();
+    run_expand_globs(arg);
+}
+
+static void run_libc_glob(void *arg)
+{
+    glob_t matches;
+    if (glob(arg, 0, NULL, &matches) == 0)
+        globfree(&matches);
+}
+
+static void bench_glob(void)
+{
+    for (int n = 1000; n <= 100000; n *= 10)
+    {
+        char dir[] = "/tmp/bench_glob_XXXXXX";
+        if (!mkdtemp(dir))
+        {
+            perror("mkdtemp");
+            exit(1);
+        }
+
+        char path[PATH_MAX];
+        for (int i = 0; i < n; i++)
+        {
+            snprintf(path, sizeof(path), "%s/file%06d.%s", dir, (i * 7919) % n, i % 10 ? "o" : "c");
+            int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (fd != -1)
+                close(fd);
+        }
+
+        // An old mtime, as for any directory not written in the last moments
+        struct timespec old[2] = {{time(NULL) - 60, 0}, {time(NULL) - 60, 0}};
+        utimensat(AT_FDCWD, dir, old, 0);
+
+        char line[PATH_MAX + 16], pattern[PATH_MAX];
+        snprintf(line, sizeof(line), "ls %s/file*7.c", dir);
+        snprintf(pattern, sizeof(pattern), "%s/file*7.c", dir);
+
+        char param[64];
+        snprintf(param, sizeof(param), "n=%d cached", n);
+        report("expand_globs", param, time_per_op(run_expand_globs, line), strlen(line));
+        snprintf(param, sizeof(param), "n=%d uncached", n);
+        report("expand_globs", param, time_per_op(run_expand_globs_uncached, line), strlen(line));
+        snprintf(param, sizeof(param), "n=%d glob(3)", n);
+        report("expand_globs", param, time_per_op(run_libc_glob, pattern), strlen(pattern));
+        glob_cache_free();
+
+        for (int i = 0; i < n; i++)
+        {
+            snprintf(path, sizeof(path), "%s/file%06d.%s", dir, (i * 7919) % n, i % 10 ? "o" : "c");
+            unlink(path);
+        }
+        rmdir(dir);
+    }
+}
+
+static matrix_t *random_matrix(int rows, int cols, unsigned int *seed)
+{
+    matrix_t *mat = create_matrix(rows, cols);
+    if (!mat)
+    {
+        perror("create_matrix");
+        exit(1);
+    }
+    for (size_t i = 0; i < (size_t)rows * cols; i++)
+    {
+        mat->data[i] = (double)(rand_r(seed) % 2001 - 1000) / 100.0;
+    }
+    return mat;
+}
+
+static void run_parse_matrix(void *arg)
+{
+    free_matrix(parse_matrix(arg));
+}
+
+static void run_compute(void *arg)
+{
+    compute_arg_t *a = arg;
+    free_matrix(compute_matrices_parallel(a->operands, a->count, a->operation));
+}
+
+static void run_print_matrix(void *arg)
+{
+    print_matrix(arg);
+}
+
+static void bench_matrices(unsigned int *seed)
+{
+    char param[64];
+    int sizes[] = {64, 256, 1024};
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        int n = sizes[s];
+        matrix_t *a = random_matrix(n, n, seed), *b = random_matrix(n, n, seed);
+        snprintf(param, sizeof(param), "%dx%d", n, n);
+
+        // Text form of a, as typed on the command line
+        int capture_fd = capture_open("bench-print");
+        int saved = redirect_fd(STDOUT_FILENO, capture_fd);
+        print_matrix(a);
+        restore_fd(STDOUT_FILENO, saved);
+
+        size_t text_len;
+        char *mapped = capture_map(capture_fd, &text_len);
+        char *text = strndup(mapped, text_len);
+        munmap(mapped, text_len);
+        close(capture_fd);
+        text[strcspn(text, "\n")] = '\0';
+
+        report("parse_matrix", param, time_per_op(run_parse_matrix, text), text_len);
+
+        // Four operands take the threaded pairwise tree; bytes are operands read plus result written
+        compute_arg_t add = {{a, b, a, b}, 4, 'A'};
+        report("compute_matrices_parallel ADD", param, time_per_op(run_compute, &add),
+               5.0 * n * n * sizeof(double));
+        compute_arg_t sub = {{a, b, NULL, NULL}, 2, 'S'};
+        report("compute_matrices_parallel SUB", param, time_per_op(run_compute, &sub),
+               3.0 * n * n * sizeof(double));
+
+        int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        saved = redirect_fd(STDOUT_FILENO, null_fd);
+        double t = time_per_op(run_print_matrix, a);
+        restore_fd(STDOUT_FILENO, saved);
+        close(null_fd);
+        report("print_matrix", param, t, text_len);
+
+        free(text);
+        free_matrix(a);
+        free_matrix(b);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--baseline") == 0)
+    {
+        load_baseline(argv[2]);
+    }
+    else if (argc != 1)
+    {
+        fprintf(stderr, "usage: %s [--baseline previous.json]\n", argv[0]);
+        return 1;
+    }
+
+    // Full buffering even on a terminal, so print_matrix() is timed the same way everywhere
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    unsigned int seed = 7;
+
+    printf("{\"benchmark\": \"bench_core\", \"min_seconds\": %.2f, \"results\": [\n", BENCH_MIN_SECONDS);
+    bench_command_lines();
+    bench_dangerous();
+    bench_prompt();
+    bench_history(&seed);
+    bench_glob();
+    bench_matrices(&seed);
+    printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "../include/shell.h"
+
+/*
+ * Fused expression evaluation ("A + B - C*2 + D") against the chained
+ * equivalent built from compute_matrices_parallel() calls, which
+ * materializes a full intermediate matrix per step.
+ */
+
+static double now_seconds(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static matrix_t *random_matrix(int rows, int cols, unsigned int *seed)
+{
+    matrix_t *mat = create_matrix(rows, cols);
+    if (!mat)
+    {
+        perror("create_matrix");
+        exit(1);
+    }
+    for (size_t i = 0; i < (size_t)rows * cols; i++)
+    {
+        mat->data[i] = (double)(rand_r(seed) % 2001 - 1000) / 100.0;
+    }
+    return mat;
+}
+
+static matrix_t *chained(matrix_t *a, matrix_t *b, matrix_t *c, matrix_t *d)
+{
+    // Each step is what a separate mcalc call would compute
+    matrix_t *pair[2] = {a, b};
+    matrix_t *sum = compute_matrices_parallel(pair, 2, 'A');
+
+    matrix_t *c2 = copy_matrix(c);
+    for (size_t i = 0; i < (size_t)c->rows * c->cols; i++)
+    {
+        c2->data[i] *= 2.0;
+    }
+
+    matrix_t *diff_in[2] = {sum, c2};
+    matrix_t *diff = compute_matrices_parallel(diff_in, 2, 'S');
+
+    matrix_t *final_in[2] = {diff, d};
+    matrix_t *result = compute_matrices_parallel(final_in, 2, 'A');
+
+    free_matrix(sum);
+    free_matrix(c2);
+    free_matrix(diff);
+    return result;
+}
+
+static void bench_size(int n, unsigned int *seed)
+{
+    const char *names[] = {"A", "B", "C", "D"};
+    matrix_t *m[4];
+    for (int i = 0; i < 4; i++)
+    {
+        m[i] = random_matrix(n, n, seed);
+        matrix_store_set(names[i], retain_matrix(m[i]));
+    }
+
+    int reps = (n <= 256) ? 50 : 5;
+    double bytes = 5.0 * n * n * sizeof(double); // 4 inputs read + 1 output written
+
+    double t0 = now_seconds();
+    matrix_t *ref = NULL;
+    for (int r = 0; r < reps; r++)
+    {
+        free_matrix(ref);
+        ref = chained(m[0], m[1], m[2], m[3]);
+    }
+    double t_chained = (now_seconds() - t0) / reps;
+
+    t0 = now_seconds();
+    matrix_t *fused = NULL;
+    for (int r = 0; r < reps; r++)
+    {
+        free_matrix(fused);
+        fused = evaluate_matrix_expression("A + B - C*2 + D");
+    }
+    double t_fused = (now_seconds() - t0) / reps;
+
+    double err = 0.0;
+    for (size_t i = 0; i < (size_t)n * n; i++)
+    {
+        double e = fabs(ref->data[i] - fused->data[i]);
+        if (e > err)
+            err = e;
+    }
+
+    printf("%5d x %-5d  chained %9.3f ms  fused %9.3f ms (%7.2f MB/s)  speedup %5.2fx  max_err %.2e\n",
+           n, n, t_chained * 1e3, t_fused * 1e3, bytes / t_fused / 1e6, t_chained / t_fused, err);
+
+    free_matrix(ref);
+    free_matrix(fused);
+    for (int i = 0; i < 4; i++)
+    {
+        free_matrix(m[i]);
+    }
+    matrix_store_clear();
+}
+
+int main(void)
+{
+    unsigned int seed = 7;
+    int sizes[] = {64, 256, 1024, 2048};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bench_size(sizes[i], &seed);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "../include/shell.h"
+
+/*
+ * GFLOP/s benchmark for mcalc MUL: the blocked, packed, tile-parallel kernel
+ * against a naive i-j-k triple loop, plus chain-order vs left-to-right.
+ */
+
+static double now_seconds(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static matrix_t *random_matrix(int rows, int cols, unsigned int *seed)
+{
+    matrix_t *mat = create_matrix(rows, cols);
+    if (!mat)
+    {
+        perror("create_matrix");
+        exit(1);
+    }
+    for (int i = 0; i < rows * cols; i++)
+    {
+        mat->data[i] = (double)(rand_r(seed) % 2001 - 1000) / 100.0;
+    }
+    return mat;
+}
+
+static matrix_t *naive_multiply(const matrix_t *a, const matrix_t *b)
+{
+    matrix_t *c = create_matrix(a->rows, b->cols);
+    for (int i = 0; i < a->rows; i++)
+    {
+        for (int j = 0; j < b->cols; j++)
+        {
+            double sum = 0.0;
+            for (int p = 0; p < a->cols; p++)
+            {
+                sum += a->data[i * a->cols + p] * b->data[p * b->cols + j];
+            }
+            c->data[i * c->cols + j] = sum;
+        }
+    }
+    return c;
+}
+
+static double max_abs_diff(const matrix_t *x, const matrix_t *y)
+{
+    double diff = 0.0;
+    for (int i = 0; i < x->rows * x->cols; i++)
+    {
+        double d = fabs(x->data[i] - y->data[i]);
+        if (d > diff)
+            diff = d;
+    }
+    return diff;
+}
+
+static void bench_square(int n, unsigned int *seed)
+{
+    matrix_t *a = random_matrix(n, n, seed);
+    matrix_t *b = random_matrix(n, n, seed);
+    double flops = 2.0 * n * n * n;
+
+    double t0 = now_seconds();
+    matrix_t *naive = naive_multiply(a, b);
+    double t_naive = now_seconds() - t0;
+
+    t0 = now_seconds();
+    matrix_t *blocked = matrix_multiply(a, b);
+    double t_blocked = now_seconds() - t0;
+
+    printf("%5d x %-5d  naive %7.3f GFLOP/s  blocked %7.3f GFLOP/s  speedup %5.2fx  max_err %.2e\n",
+           n, n, flops / t_naive / 1e9, flops / t_blocked / 1e9,
+           t_naive / t_blocked, max_abs_diff(naive, blocked));
+
+    free_matrix(a);
+    free_matrix(b);
+    free_matrix(naive);
+    free_matrix(blocked);
+}
+
+static void bench_chain(unsigned int *seed)
+{
+    // (A * B) * C is ~100x more work than A * (B * C) for these shapes
+    matrix_t *chain[3];
+    chain[0] = random_matrix(1000, 20, seed);
+    chain[1] = random_matrix(20, 1000, seed);
+    chain[2] = random_matrix(1000, 20, seed);
+
+    double t0 = now_seconds();
+    matrix_t *ab = matrix_multiply(chain[0], chain[1]);
+    matrix_t *left_to_right = matrix_multiply(ab, chain[2]);
+    double t_ltr = now_seconds() - t0;
+
+    t0 = now_seconds();
+    matrix_t *ordered = matrix_chain_multiply(chain, 3);
+    double t_ordered = now_seconds() - t0;
+
+    printf("chain 1000x20 * 20x1000 * 1000x20  left-to-right %.4f s  chain-order %.4f s  speedup %5.2fx  max_err %.2e\n",
+           t_ltr, t_ordered, t_ltr / t_ordered, max_abs_diff(left_to_right, ordered));
+
+    for (int i = 0; i < 3; i++)
+        free_matrix(chain[i]);
+    free_matrix(ab);
+    free_matrix(left_to_right);
+    free_matrix(ordered);
+}
+
+int main(void)
+{
+    unsigned int seed = 42;
+    int sizes[] = {64, 128, 256, 512, 1024};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bench_square(sizes[i], &seed);
+    }
+    bench_chain(&seed);
+
+    return 0;
+}
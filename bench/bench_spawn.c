@@ -0,0 +1,101 @@
+#include "../include/shell.h"
+#include <sys/mman.h>
+
+/*
+ * Per-command spawn latency against the shell's resident set size:
+ * fork()+execvp()+waitpid() from the growing process, as the shell does
+ * by default, versus a request to the launcher forked at startup (-L).
+ *
+ * Usage: bench_spawn [iterations]   (default 200)
+ */
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long rss_mib(void)
+{
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    return resident * sysconf(_SC_PAGESIZE) >> 20;
+}
+
+static double spawn_fork(char *const argv[], int iterations)
+{
+    double t0 = now_seconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            execvp(argv[0], argv);
+            _exit(127);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return (now_seconds() - t0) / iterations;
+}
+
+static double spawn_launcher(char *const argv[], int iterations)
+{
+    double t0 = now_seconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        int status;
+        pid_t pid = launcher_spawn(argv, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, 0);
+        if (pid <= 0 || launcher_wait(pid, &status) == -1)
+            return -1.0;
+    }
+    return (now_seconds() - t0) / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 200;
+    char *const cmd[] = {"true", NULL};
+    const size_t heap_mib[] = {0, 256, 1024, 2048};
+
+    if (launcher_start() == -1)
+        return 1;
+
+    printf("%10s %16s %16s\n", "rss_mib", "fork_us/op", "launcher_us/op");
+
+    char *heap = NULL;
+    size_t heap_size = 0;
+    for (size_t i = 0; i < sizeof(heap_mib) / sizeof(heap_mib[0]); i++)
+    {
+        // Grow and touch memory so it is resident, as a long session's would be
+        size_t size = heap_mib[i] << 20;
+        if (size > heap_size)
+        {
+            char *grown = heap ? mremap(heap, heap_size, size, MREMAP_MAYMOVE)
+                               : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (grown == MAP_FAILED)
+            {
+                perror("mmap");
+                break;
+            }
+            memset(grown + heap_size, 1, size - heap_size);
+            heap = grown;
+            heap_size = size;
+        }
+
+        double forked = spawn_fork(cmd, iterations);
+        double launched = spawn_launcher(cmd, iterations);
+        printf("%10ld %16.1f %16.1f\n", rss_mib(), forked * 1e6, launched * 1e6);
+    }
+
+    if (heap)
+        munmap(heap, heap_size);
+    launcher_stop();
+    return 0;
+}
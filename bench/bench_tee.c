@@ -0,0 +1,217 @@
+#include "../include/shell.h"
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+
+/*
+ * my_tee throughput: the original 1 KiB read/write loop, tee_stream()
+ * (tee()/splice() for pipe-to-pipe), tee_uring() (the -u io_uring engine)
+ * and coreutils tee, each copying pipe -> pipe plus two files.
+ *
+ * Each mode is run twice: once untimed under ptrace to count the system
+ * calls made by the copying process, and once untraced for throughput.
+ *
+ * Usage: bench_tee [MiB]   (default 256)
+ */
+
+#define BENCH_TEE_FILES 2
+
+static double now_seconds(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* The my_tee loop as it was before tee_stream() */
+static int legacy_tee(int in_fd, int out_fd, const int *fds, int count)
+{
+    char buf[BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(in_fd, buf, sizeof(buf))) > 0)
+    {
+        write(out_fd, buf, n);
+        for (int i = 0; i < count; ++i)
+        {
+            write(fds[i], buf, n);
+        }
+    }
+    return 0;
+}
+
+static void produce(int fd, size_t total)
+{
+    char *buf = malloc(1 << 16);
+    memset(buf, 'x', 1 << 16);
+    while (total > 0)
+    {
+        size_t n = total < (1 << 16) ? total : (1 << 16);
+        if (write_all(fd, buf, n) == -1)
+            break;
+        total -= n;
+    }
+    free(buf);
+}
+
+static void consume(int fd)
+{
+    int null_fd = open("/dev/null", O_WRONLY);
+    while (splice(fd, NULL, null_fd, NULL, 1 << 20, SPLICE_F_MOVE) > 0)
+    {
+    }
+    close(null_fd);
+}
+
+static pid_t spawn(void (*body)(int, size_t), int fd, size_t arg, int close_fds[4])
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (close_fds[i] != fd)
+                close(close_fds[i]);
+        }
+        body(fd, arg);
+        _exit(0);
+    }
+    return pid;
+}
+
+static void produce_body(int fd, size_t total) { produce(fd, total); }
+static void consume_body(int fd, size_t unused)
+{
+    (void)unused;
+    consume(fd);
+}
+
+/* Resume a traced child until it exits, counting system calls */
+static long count_syscalls(pid_t pid)
+{
+    int status;
+    long stops = 0;
+
+    waitpid(pid, &status, 0); // initial SIGSTOP
+    ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL);
+
+    int sig = 0;
+    while (ptrace(PTRACE_SYSCALL, pid, 0, sig) == 0)
+    {
+        if (waitpid(pid, &status, 0) == -1 || WIFEXITED(status) || WIFSIGNALED(status))
+            break;
+
+        sig = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80))
+            stops++;
+        else if (WSTOPSIG(status) != SIGTRAP)
+            sig = WSTOPSIG(status);
+    }
+
+    // Every call has an entry and an exit stop, except the final exit_group
+    return (stops + 1) / 2;
+}
+
+/* mode: 0 = legacy loop, 1 = tee_stream(), 2 = tee_uring(), 3 = coreutils tee */
+static double run(int mode, size_t total, const char *dir, long *syscalls)
+{
+    int in[2], out[2];
+    if (pipe(in) == -1 || pipe(out) == -1)
+    {
+        perror("pipe");
+        exit(1);
+    }
+    int all[4] = {in[0], in[1], out[0], out[1]};
+
+    char paths[BENCH_TEE_FILES][256];
+    for (int i = 0; i < BENCH_TEE_FILES; i++)
+    {
+        snprintf(paths[i], sizeof(paths[i]), "%s/bench_tee_%d.out", dir, i);
+    }
+
+    double t0 = now_seconds();
+
+    pid_t producer = spawn(produce_body, in[1], total, all);
+    pid_t consumer = spawn(consume_body, out[0], 0, all);
+
+    pid_t teer = fork();
+    if (teer == 0)
+    {
+        close(in[1]);
+        close(out[0]);
+
+        if (syscalls)
+        {
+            ptrace(PTRACE_TRACEME, 0, 0, 0);
+            raise(SIGSTOP);
+        }
+
+        if (mode == 3)
+        {
+            dup2(in[0], STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+            execlp("tee", "tee", paths[0], paths[1], (char *)NULL);
+            _exit(127);
+        }
+
+        int fds[BENCH_TEE_FILES];
+        for (int i = 0; i < BENCH_TEE_FILES; i++)
+        {
+            fds[i] = open(paths[i], O_WRONLY | O_CREAT | O_TRUNC, DEFAULT_FILE_PERMISSIONS);
+        }
+        int status;
+        if (mode == 0)
+            status = legacy_tee(in[0], out[1], fds, BENCH_TEE_FILES);
+        else if (mode == 1)
+            status = tee_stream(in[0], out[1], fds, BENCH_TEE_FILES);
+        else
+            status = tee_uring(in[0], out[1], fds, BENCH_TEE_FILES);
+        _exit(status == 0 && io_engine_stats.fallbacks == 0 ? 0 : 1);
+    }
+
+    for (int i = 0; i < 4; i++)
+        close(all[i]);
+
+    int status = 0, failed = 0;
+    if (syscalls)
+        *syscalls = count_syscalls(teer);
+    waitpid(producer, NULL, 0);
+    waitpid(teer, &status, 0);
+    waitpid(consumer, NULL, 0);
+    if (!syscalls && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+        failed = 1;
+
+    double elapsed = now_seconds() - t0;
+
+    for (int i = 0; i < BENCH_TEE_FILES; i++)
+    {
+        struct stat st;
+        if (stat(paths[i], &st) == -1 || (size_t)st.st_size != total)
+            failed = 1;
+        unlink(paths[i]);
+    }
+
+    return failed ? -1.0 : elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mib = (argc > 1) ? (size_t)atol(argv[1]) : 256;
+    size_t total = mib << 20;
+    const char *dir = (access("/dev/shm", W_OK) == 0) ? "/dev/shm" : "/tmp";
+    const char *names[] = {"legacy 1KiB loop", "tee_stream", "tee_uring", "coreutils tee"};
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int mode = 0; mode < 4; mode++)
+    {
+        long syscalls = -1;
+        run(mode, total, dir, &syscalls);
+
+        double t = run(mode, total, dir, NULL);
+        if (t < 0)
+            printf("%-18s %zu MiB  failed\n", names[mode], mib);
+        else
+            printf("%-18s %zu MiB  %8.3f s  %9.1f MB/s  %9ld syscalls\n", names[mode], mib, t,
+                   total / t / 1e6, syscalls);
+    }
+    return 0;
+}
@@ -4,43 +4,182 @@
 #include "types.h"
 
 // Global variables (extern declarations)
-extern char dangerous_cmds[MAX_DANGEROUS_CMDS][MAX_CMD_LEN];
+extern char **dangerous_cmds;
 extern size_t dangerous_cmds_count;
 extern command_stats_t stats;
 extern FILE *log_file;
+extern int use_io_uring;
+extern io_engine_stats_t io_engine_stats;
+extern int batch_mode;
+extern int batch_jobs;
+extern char limit_last_reason[64];
+extern unsigned long *dangerous_hits;
+extern const double latency_bucket_bounds[LATENCY_BUCKETS - 1];
+extern int server_sessions_active;
+extern long long redirect_preallocate;
 
 /* Shell core functions */
 void setup_shell(void);
 void shell_loop(void);
 void cleanup_shell(void);
+int run_batch(int fd);
+int is_barrier_line(const char *line);
+void execute_line_unlogged(const char *line, batch_result_t *result);
+void apply_line_result(command_stats_t *target, const char *line, const batch_result_t *result);
+int run_server(const char *socket_path);
 
 /* Command parsing and execution */
-char *read_line(char *buffer, size_t size, FILE *stream);
+char *read_line(char **buffer, size_t *capacity, FILE *stream);
+char *trim_spaces(char *str, size_t len);
+int tokenize(const char *str, arena_chunk_t **arena, char ***tokens_dest, unsigned char **globs_dest);
+arena_chunk_t *arena_new(size_t size);
+char *arena_alloc(arena_chunk_t **arena, size_t size);
+void arena_free(arena_chunk_t *arena);
+void expand_free(void);
+int expand_globs(pipeline_t *pipeline);
+void glob_cache_free(void);
 pipeline_t *parse_line(const char *line);
 void free_pipeline(pipeline_t *pipeline);
 int execute_line(const char *line);
 int execute_pipeline(pipeline_t *pipeline);
 
+/* Pre-forked launcher */
+int launcher_start(void);
+int launcher_active(void);
+pid_t launcher_spawn(char *const argv[], int in_fd, int out_fd, int err_fd, int detached);
+pid_t launcher_wait(pid_t pid, int *status);
+void launcher_stop(void);
+
 /* Built-in commands */
 int is_builtin(const char *cmd_str);
+int is_stream_builtin(const char *cmd_str);
 int execute_builtin(command_t *cmd);
 
+/* In-shell output capture */
+int capture_open(const char *name);
+void *capture_map(int fd, size_t *len);
+int redirect_fd(int target, int fd);
+void restore_fd(int target, int saved);
+
+/* Redirections */
+int redirect_open(const command_t *cmd, redirect_set_t *set, int foreground);
+void redirect_resolve(const redirect_set_t *set, int fds[3]);
+void redirect_apply(const redirect_set_t *set);
+void redirect_close(redirect_set_t *set);
+
+/* Resource limits */
+int run_limited(command_t *cmd, const limit_spec_t *spec, const char *line);
+
+/* Stream copying */
+int tee_stream(int in_fd, int out_fd, const int *fds, int count);
+int tee_fanout(int in_fd, int out_fd, const int *fds, int count, size_t high_water);
+
+/* io_uring I/O engine */
+int uring_init(uring_t *ring, unsigned entries);
+void uring_destroy(uring_t *ring);
+int tee_uring(int in_fd, int out_fd, const int *fds, int count);
+int uring_log_open(int fd);
+int uring_log_write(int fd, const char *data, size_t len);
+void uring_log_close(void);
+
+/* Matrix operations */
+matrix_t *create_matrix(int rows, int cols);
+matrix_t *retain_matrix(matrix_t *mat);
+void free_matrix(matrix_t *mat);
+matrix_t *parse_matrix(const char *str);
+int append_matrix(matrix_t ***matrices, int *count, int *capacity, matrix_t *mat);
+void print_matrix(matrix_t *mat);
+void write_matrix_key(const matrix_t *mat, FILE *out);
+int matrices_compatible(matrix_t *m1, matrix_t *m2);
+int matrices_chain_compatible(matrix_t **matrices, int count);
+matrix_t *compute_matrices_parallel(matrix_t **matrices, int count, char operation);
+matrix_t *matrix_multiply(const matrix_t *left, const matrix_t *right);
+matrix_t *matrix_chain_multiply(matrix_t **matrices, int count);
+matrix_t *copy_matrix(const matrix_t *mat);
+int mcalc_thread_count(int tasks);
+
+/* Sparse (CSR) matrices */
+matrix_t *create_sparse_matrix(int rows, int cols, size_t nnz);
+matrix_t *sparse_from_triplets(int rows, int cols, matrix_triplet_t *triplets, size_t count);
+matrix_t *parse_sparse_matrix(const char *str);
+matrix_t *matrix_to_dense(const matrix_t *mat);
+matrix_t *sparsify_if_sparse(matrix_t *mat);
+matrix_t *sparse_add_sub(const matrix_t *left, const matrix_t *right, char operation);
+
+/* Matrix expressions */
+int is_matrix_expression(const char *str);
+matrix_t *evaluate_matrix_expression(const char *expr);
+int write_expression_key(const char *expr, FILE *out);
+
+/* Matrix files */
+int load_matrix_file(const char *path, matrix_t ***matrices, int *count, int *capacity);
+int save_matrix_file(const char *path, const matrix_t *mat);
+void release_matrix_mapping(matrix_mapping_t *mapping);
+
+/* Named matrix store */
+int matrix_store_set(const char *name, matrix_t *mat);
+matrix_t *matrix_store_get(const char *name);
+int matrix_store_remove(const char *name);
+void matrix_store_list(FILE *out);
+void matrix_store_clear(void);
+
 /* Signal handling */
 void setup_signal_handlers(void);
 
 /* Utilities */
 int has_consecutive_spaces(const char *str);
-int tokenize(char *str_src, char **tokens_dest, int max_args);
-void reconstruct_command_string(const command_t *cmd, char *cmd_str);
+char *reconstruct_command_string(const command_t *cmd);
+ssize_t write_all(int fd, const void *buf, size_t len);
+long long parse_size(const char *str);
+double parse_duration(const char *str);
+int open_unix_listener(const char *path, int backlog);
+int open_pidfd(pid_t pid);
+int limit_command_start(char *const *args, int argc);
 
 /* Dangerous commands */
 size_t load_dangerous_commands(const char *filename);
+void free_dangerous_commands(void);
 int check_dangerous_pipeline(pipeline_t *pipeline);
+int check_dangerous_expanded(pipeline_t *pipeline);
 int is_dangerous_command(const char *cmd, int *dangerous_cmd_index);
 
 /* Statistics and logging */
 void display_prompt(command_stats_t *stats);
+int prompt_compile(const char *template);
+void prompt_free(void);
 void update_command_stats(command_stats_t *stats, double elapsed_time);
+void print_stats_summary(FILE *out, const command_stats_t *stats);
 void log_command_execution(FILE *file, const char *command_str, double elapsed_time);
+void log_limit_violation(FILE *file, const char *command_str, const char *reason);
+
+/* Metrics export */
+int metrics_start(const char *socket_path, const char *file_path);
+void metrics_publish(const command_stats_t *stats);
+void metrics_stop(void);
+
+/* Builtin result cache */
+int builtin_cache_init(long long size);
+int builtin_cache_enabled(void);
+int builtin_cache_run(command_t *cmd, int (*key_of)(const command_t *, FILE *), int (*run)(command_t *));
+void builtin_cache_free(void);
+
+/* Command history */
+int history_open(const char *path);
+void history_close(void);
+size_t history_refresh(void);
+size_t history_indexed(void);
+int history_add(const char *line);
+const char *history_get(size_t n, size_t *len);
+void history_query_init(history_query_t *query, const char *text, size_t len, int prefix);
+size_t history_find(const history_query_t *query, size_t from, int direction);
+int history_expand(const char *line, char **expanded);
+
+/* Host-wide statistics segment */
+stats_shm_t *stats_shm_map(const char *name, int writable);
+int stats_slot_alive(pid_t pid);
+void stats_slot_add(stats_slot_t *dst, const stats_slot_t *src);
+int stats_shm_attach(const char *name);
+void stats_shm_sync(const command_stats_t *stats);
+void stats_shm_detach(void);
 
 #endif // SHELL_H
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
@@ -16,24 +17,165 @@
 #include <math.h>
 #include <float.h>
 #include <sys/time.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
 
 /* Constants */
-#define MAX_CMD_LEN 1024
-#define MAX_ARGS 7
-#define MAX_DANGEROUS_CMDS 100
 #define BUFFER_SIZE 1024
+#define BATCH_BLOCK_SIZE (1 << 20) // batch mode: bytes read per block from a pipe
+#define BATCH_WINDOW_FACTOR 4      // -j N: lines in flight or awaiting output, per worker
+#define SERVER_BACKLOG 512         // --serve: pending connections
+#define SERVER_MAX_EVENTS 64       // --serve: events handled per epoll_wait()
+#define SERVER_READ_SIZE 65536     // --serve: bytes read from a client at a time
+#define LAUNCHER_MAX_REQUEST 65536 // -L: largest spawn request; bigger argv falls back to fork()
+#define LIMIT_KILL_GRACE 2.0       // limit: seconds between SIGTERM and SIGKILL on timeout
+#define LIMIT_TIMEOUT_STATUS 124   // limit: exit status of a timed-out command (as timeout(1))
+#define LATENCY_BUCKETS 19         // Command latency histogram: 18 bounds (25us..10s) plus overflow
+#define METRICS_FILE_INTERVAL 1000 // --metrics-file: milliseconds between rewrites
+#define STATS_SHM_NAME "/secureshell-stats" // --stats-shm: default segment name
+#define STATS_SHM_SLOTS 1024       // --stats-shm: shell instances per segment
+#define STATS_SHM_MAGIC 0x53485354 // --stats-shm: "SHST", set once the segment is initialized
+#define STATS_SHM_VERSION 1
+#define CACHE_LINE_SIZE 64
+#define LAUNCHER_SPAWNED 1
+#define LAUNCHER_EXITED 2
+#define LAUNCHER_FDS 4            // stdin, stdout, stderr and working directory sent with each request
+#define TEE_BUFFER_SIZE (1 << 20) // my_tee user-space buffer when kernel-side copies are unavailable
+#define TEE_CHUNK_SIZE (256 * 1024)          // my_tee -p: bytes per shared chunk
+#define TEE_DEFAULT_HIGH_WATER (16 << 20)    // my_tee -p: default bytes buffered for slow outputs
+#define URING_LOG_SLOTS 32                   // in-flight log writes with the io_uring engine
+#define URING_LOG_SLOT_SIZE 4096             // bytes per log write slot
 #define DEFAULT_FILE_PERMISSIONS 0644
+#define MATRIX_SPARSE_DENSITY 0.05 // parsed matrices below this fill ratio are stored as CSR
+#define PROMPT_MAX_SEGMENTS 32     // --prompt: literal and field pieces of one template
+#define PROMPT_FIELD_WIDTH 32      // --prompt: longest rendering of one field
+#define PROMPT_DEFAULT "#cmd:{cmd}|#dangerous_cmd_blocked:{blocked}|last_cmd_time:{last}|avg_time:{avg}|min_time:{min}|max_time:{max}>> "
+#define HISTORY_FILE ".secureshell_history" // history: file in $HOME unless overridden
+#define HISTORY_BLOCK_ENTRIES 32   // history: entries summarized by one trigram filter
+#define HISTORY_FILTER_BITS 4096   // history: bits in one block's trigram filter
+#define HISTORY_QUERY_GRAMS 16     // history: pattern trigrams checked against the filters
+#define HISTORY_MIN_MAP (1 << 20)  // history: smallest reserved read mapping
+#define BUILTIN_CACHE_BUCKETS 256  // --builtin-cache: initial hash buckets (power of two)
+#define ARENA_SLACK 64             // parse_line: spare arena bytes beyond the line for expansions
+#define GLOB_CACHE_DIRS 64         // globs: directory listings kept between lines
+#define GLOB_DENTS_SIZE 65536      // globs: bytes read per getdents64() call
+#define GLOB_CACHE_SETTLE 0.05     // globs: seconds a directory must be unchanged before its listing is trusted
+#define GLOB_RADIX_MIN 32          // globs: smaller groups of names are sorted by comparison
+#define MAX_REDIRECTIONS 8         // redirections: operators allowed on one command
+#define REDIRECT_KEEP -1           // redirections: stream left as the command would get it
+#define REDIRECT_STDOUT -2         // redirections: stream joins the command's unredirected stdout (2>&1)
+
+/**
+ * @brief Value shown by one piece of a compiled prompt template
+ */
+typedef enum
+{
+    PROMPT_TEXT,    // Literal text
+    PROMPT_CMD,     // {cmd}: executed commands
+    PROMPT_BLOCKED, // {blocked}: dangerous commands blocked
+    PROMPT_WARNED,  // {warned}: dangerous-command warnings
+    PROMPT_LIMIT,   // {limit}: commands stopped by limit
+    PROMPT_JOBS,    // {jobs}: background pipelines started
+    PROMPT_LAST,    // {last}: last command time, %.5f
+    PROMPT_AVG,     // {avg}: average time, %.5f
+    PROMPT_MIN,     // {min}: minimum time, %.5f
+    PROMPT_MAX      // {max}: maximum time, %.5f
+} prompt_field_t;
+
+/**
+ * @brief One piece of a compiled prompt template
+ */
+typedef struct
+{
+    prompt_field_t field; // What the piece shows
+    const char *text;     // PROMPT_TEXT: start of the literal in the template
+    size_t len;           // PROMPT_TEXT: length of the literal
+    double shown;         // Field value in the cached prompt
+} prompt_segment_t;
+
+/**
+ * @brief A cached builtin result, in the hash chain and the LRU list
+ */
+typedef struct builtin_cache_entry
+{
+    struct builtin_cache_entry *chain; // Next entry in the same hash bucket
+    struct builtin_cache_entry *prev;  // More recently used entry
+    struct builtin_cache_entry *next;  // Less recently used entry
+    uint64_t hash;                     // SipHash of the key
+    size_t key_len;                    // Normalized call, as written by the builtin's key function
+    size_t output_len;                 // Captured stdout
+    int status;                        // Exit status of the call
+    char data[];                       // Key followed by output
+} builtin_cache_entry_t;
+
+/**
+ * @brief A compiled history search
+ */
+typedef struct
+{
+    const char *text;                      // Pattern
+    size_t len;                            // Length of text
+    int prefix;                            // Match at the start of entries only
+    uint32_t grams[HISTORY_QUERY_GRAMS];   // Filter bits every matching block has set
+    int gram_count;                        // Used entries of grams
+} history_query_t;
+
+/**
+ * @brief One block of a per-line arena
+ *
+ * parse_line() writes every expanded token of a line into its arena; a line
+ * that does not outgrow the first chunk costs a single allocation.
+ */
+typedef struct arena_chunk
+{
+    struct arena_chunk *next; // Chunk filled before this one
+    size_t used;              // Bytes handed out
+    size_t size;              // Capacity of data
+    char data[];
+} arena_chunk_t;
+
+/**
+ * @brief Redirection operators, applied left to right
+ */
+typedef enum
+{
+    REDIRECT_IN,         // < file
+    REDIRECT_OUT,        // > file
+    REDIRECT_APPEND,     // >> file
+    REDIRECT_ERR,        // 2> file
+    REDIRECT_ERR_APPEND, // 2>> file
+    REDIRECT_ERR_TO_OUT  // 2>&1
+} redirect_type_t;
+
+typedef struct
+{
+    redirect_type_t type;
+    const char *path; // target file, NULL for 2>&1
+} redirection_t;
 
 /**
  * @brief Structure representing a single command with its arguments
  */
 typedef struct
 {
-    char **args;       // argv-style array of pointers to each argument string
-    int argc;          // how many strings are in args
-    char *stderr_file; // if non-NULL, filename to redirect stderr (“2> file”)
+    char **args;                               // argv-style array of pointers to each argument string
+    int argc;                                  // how many strings are in args
+    unsigned char *globs;                      // if non-NULL, 1 for each argument still holding unquoted wildcards
+    redirection_t redirects[MAX_REDIRECTIONS]; // redirections in the order they were written
+    int redirect_count;                        // how many entries of redirects are used
 } command_t;
 
+/**
+ * @brief Files opened for the redirections of one command
+ */
+typedef struct
+{
+    int fds[3];                           // stdin, stdout, stderr: file, REDIRECT_KEEP or REDIRECT_STDOUT
+    int opened[MAX_REDIRECTIONS];         // every file opened, closed by redirect_close()
+    unsigned char trim[MAX_REDIRECTIONS]; // 1 if the file was preallocated and its unused tail must go
+    int opened_count;
+} redirect_set_t;
+
 /**
  * @brief Structure representing a pipeline of commands
  */
@@ -42,6 +184,7 @@ typedef struct
     command_t commands[2]; // at most two commands: [0]=left side, [1]=right side
     int cmd_count;         // 1 for a single command, 2 if there’s a pipe
     int is_background;     // whether the pipeline ends with ‘&’
+    arena_chunk_t *arena;  // holds every args[i] and redirection path of both commands
 } pipeline_t;
 
 typedef struct
@@ -54,18 +197,273 @@ typedef struct
     double avg_time;                    // Average execution time
     double total_time;                  // Accumulated time for computing average
     int unblocked_dangerous_cmds_count; // Count of commands that are similar to the dangerous commands
+    int limit_violations;               // Commands stopped by limit for exceeding a limit
+    int background_jobs;                // Pipelines started in the background with '&'
+    unsigned long latency_buckets[LATENCY_BUCKETS]; // Executed commands per latency_bucket_bounds[] bucket
+    int cache_hits;                     // Builtin calls answered from the result cache
+    int cache_misses;                   // Cacheable builtin calls that had to run
+    int cache_evictions;                // Cached results dropped to stay within the budget
 } command_stats_t;
 
+/**
+ * @brief Outcome of one batch line run in a -j worker, in shared memory
+ */
+typedef struct
+{
+    int executed;          // The line ran and counts as a command
+    int blocked;           // Dangerous commands blocked while checking the line
+    int warned;            // Dangerous-command warnings issued for the line
+    int background;        // The line started a background pipeline
+    int cache_hits;        // Result cache hits, misses and evictions during the line
+    int cache_misses;
+    int cache_evictions;
+    double elapsed;        // Execution time of the line
+    char limit_reason[64]; // Limit the line's command exceeded, empty if none
+} batch_result_t;
+
+/**
+ * @brief A line dispatched by the -j scheduler, retired in input order
+ */
+typedef struct
+{
+    pid_t pid;  // Worker process, 0 once it has been reaped
+    int pidfd;  // pidfd of the running worker, -1 if none
+    char *line; // Line text, kept for the audit log
+    int out_fd; // memfd capturing the worker's stdout, reused by the slot
+    int err_fd; // memfd capturing the worker's stderr, reused by the slot
+} batch_job_t;
+
+/**
+ * @brief Resource limits requested with the limit builtin
+ */
+typedef struct
+{
+    double timeout;      // Wall-clock limit in seconds, 0 for none
+    double cpu_seconds;  // RLIMIT_CPU in seconds, 0 for none
+    long long memory;    // RLIMIT_AS in bytes, 0 for none
+} limit_spec_t;
+
+/**
+ * @brief Spawn request sent to the launcher; argv then environment strings follow, NUL-separated
+ */
+typedef struct
+{
+    int argc;        // Number of argv strings that follow
+    int envc;        // Number of environment strings after them
+    int detached;    // Background command: no exit record is wanted
+    size_t args_len; // Bytes of packed argv and environment strings
+} launcher_request_t;
+
+/**
+ * @brief Record sent back by the launcher
+ */
+typedef struct
+{
+    int type;   // LAUNCHER_SPAWNED or LAUNCHER_EXITED
+    pid_t pid;  // Process the record is about (-errno if the spawn failed)
+    int status; // waitpid() status for LAUNCHER_EXITED
+} launcher_record_t;
+
+/**
+ * @brief Slot of a blacklist hash index
+ */
+typedef struct
+{
+    uint32_t hash; // Hash of the key
+    int entry;     // Index into the blacklist, -1 for an empty slot
+} blacklist_slot_t;
+
+/**
+ * @brief One client session of the --serve daemon
+ */
+typedef struct
+{
+    int fd;                 // Client socket (non-blocking)
+    uint32_t generation;    // Tells this session's epoll events from those of an earlier one in the slot
+    int result_fd;          // Result pipe of the running worker, -1 when idle
+    pid_t worker;           // Worker running the current line, 0 when idle
+    int output_fd;          // Read end of the output pipe (non-blocking), -1 once drained
+    int output_write;       // Write end, the workers' stdout/stderr; -1 once the session is closing
+    char *line;             // Line being executed, for the audit log
+    char *cwd;              // Session working directory
+    command_stats_t stats;  // Per-session statistics
+    char *input;            // Received bytes not yet executed
+    size_t input_len;       // Valid bytes in input
+    size_t input_cap;       // Allocated size of input
+    char *output;           // Output not yet sent to the client
+    size_t output_len;      // Valid bytes in output
+    size_t output_cap;      // Allocated size of output
+    int eof;                // Client shut down its write side
+} server_session_t;
+
+/**
+ * @brief A read-only file mapping shared by the matrices that point into it
+ */
+typedef struct
+{
+    void *addr;    // Start of the mmap'd region
+    size_t length; // Length of the mapping in bytes
+    int refs;      // Number of matrices whose data lives in this mapping
+} matrix_mapping_t;
+
+/**
+ * @brief A chunk of input shared by all fan-out writers of my_tee -p
+ */
+typedef struct
+{
+    char *data; // TEE_CHUNK_SIZE buffer, reused when the slot comes around again
+    size_t len; // Valid bytes in data
+    int refs;   // Writers that still have to write this chunk; 0 means the slot is free
+} tee_chunk_t;
+
+/**
+ * @brief Bounded ring of chunks shared by the reader and the writer threads
+ */
+typedef struct
+{
+    tee_chunk_t *slots;          // Ring storage
+    size_t slot_count;           // Ring capacity (high-water mark / TEE_CHUNK_SIZE)
+    size_t produced;             // Chunks published by the reader so far
+    int writers;                 // Number of writer threads
+    int eof;                     // Reader reached end of input (or failed)
+    pthread_mutex_t lock;        // Protects every field above and the chunk refcounts
+    pthread_cond_t chunk_ready;  // Signalled when a chunk is published or eof is set
+    pthread_cond_t slot_free;    // Signalled when a chunk's last reference is dropped
+} tee_ring_t;
+
+/**
+ * @brief Per-output writer thread state for my_tee -p
+ */
+typedef struct
+{
+    tee_ring_t *ring; // Shared ring
+    int fd;           // Output descriptor owned by this writer
+    size_t next;      // Sequence number of the next chunk to write
+    int failed;       // Set after a write error; remaining chunks are released unwritten
+    int error;        // errno of the first failure
+} tee_writer_t;
+
+/**
+ * @brief Minimal io_uring instance (raw syscalls, no liburing)
+ */
+typedef struct
+{
+    int fd;                     // Ring file descriptor, -1 if not set up
+    unsigned entries;           // Submission queue size
+    unsigned *sq_head;          // Kernel-owned SQ head
+    unsigned *sq_tail;          // Shared SQ tail, published by us
+    unsigned *sq_mask;          // SQ index mask
+    unsigned *sq_array;         // SQ index array
+    struct io_uring_sqe *sqes;  // Submission queue entries
+    unsigned *cq_head;          // Shared CQ head, advanced by us
+    unsigned *cq_tail;          // Kernel-owned CQ tail
+    unsigned *cq_mask;          // CQ index mask
+    struct io_uring_cqe *cqes;  // Completion queue entries
+    unsigned sqe_tail;          // Local tail including SQEs not yet published
+    unsigned submitted;         // SQEs handed to the kernel so far
+    void *sq_ring;              // SQ ring mapping
+    size_t sq_ring_size;        // SQ ring mapping length
+    void *cq_ring;              // CQ ring mapping (same as sq_ring with IORING_FEAT_SINGLE_MMAP)
+    size_t cq_ring_size;        // CQ ring mapping length
+    size_t sqes_size;           // SQE array mapping length
+    int buffers_registered;     // Fixed buffers are registered with the ring
+} uring_t;
+
+/**
+ * @brief Counters describing how builtin I/O reached the kernel
+ */
+typedef struct
+{
+    unsigned long enter_calls;    // io_uring_enter() system calls
+    unsigned long sqes_submitted; // Operations queued through io_uring
+    unsigned long fallbacks;      // Times io_uring was wanted but unavailable
+} io_engine_stats_t;
+
 /**
  * @brief Structure representing a matrix for calculations
  */
 typedef struct
 {
-    int rows;     // Number of matrix rows
-    int cols;     // Number of matrix columns
-    double *data; // Matrix data in row-major order
+    int rows;                  // Number of matrix rows
+    int cols;                  // Number of matrix columns
+    double *data;              // Matrix data in row-major order
+    matrix_mapping_t *mapping; // if non-NULL, data points into this mapping and is not owned
+    int refs;                  // Owners of this matrix (operand lists, named store)
+    size_t nnz;                // Stored nonzeros (CSR only)
+    size_t *row_ptr;           // CSR row offsets (rows + 1 entries); NULL for dense matrices
+    int *col_idx;              // CSR column index of each stored value, sorted within a row
+    double *values;            // CSR stored values
 } matrix_t;
 
+/**
+ * @brief One (row, col, value) entry used to build a CSR matrix
+ */
+typedef struct
+{
+    int row;      // Row index (0-based)
+    int col;      // Column index (0-based)
+    double value; // Entry value; duplicates are summed
+} matrix_triplet_t;
+
+/**
+ * @brief Node of a compiled mcalc expression ("A + B - C*2 + D")
+ */
+typedef struct expr_node
+{
+    char kind;                // 'M' matrix, 'N' number, '+', '-', '*', or 'u' (unary minus)
+    double number;            // Value of an 'N' node
+    matrix_t *mat;            // Operand of an 'M' node (one reference held)
+    struct expr_node *left;   // Left child (or only child for 'u')
+    struct expr_node *right;  // Right child
+} expr_node_t;
+
+/**
+ * @brief One term of a linear expression: coefficient * matrix
+ */
+typedef struct
+{
+    double coef;         // Scalar coefficient
+    const matrix_t *mat; // Operand (borrowed from the expression tree)
+} expr_term_t;
+
+/**
+ * @brief Thread argument structure for the fused expression kernel
+ */
+typedef struct
+{
+    const expr_term_t *terms; // Terms to sum
+    int term_count;           // Number of terms
+    matrix_t *result;         // Dense result matrix
+    int row_begin;            // First row handled by this thread
+    int row_end;              // One past the last row handled by this thread
+} expr_thread_arg_t;
+
+/**
+ * @brief A session-resident named matrix ("mcalc let NAME ...")
+ */
+typedef struct named_matrix
+{
+    char *name;                // Variable name, referenced as $NAME
+    matrix_t *mat;             // Stored matrix (the store holds one reference)
+    struct named_matrix *next; // Next entry in definition order
+} named_matrix_t;
+
+/* Binary matrix file format: header followed by rows*cols host-order doubles.
+ * Several header+data records may be concatenated in one file. */
+#define MATRIX_FILE_MAGIC "MCMX"
+#define MATRIX_FILE_VERSION 1
+
+/**
+ * @brief On-disk header of a binary matrix record (16 bytes, keeps data 8-byte aligned)
+ */
+typedef struct
+{
+    char magic[4];    // MATRIX_FILE_MAGIC, not NUL-terminated
+    uint32_t version; // MATRIX_FILE_VERSION
+    uint32_t rows;    // Number of rows
+    uint32_t cols;    // Number of columns
+} matrix_file_header_t;
+
 /**
  * @brief Thread argument structure for matrix operations
  */
@@ -77,4 +475,76 @@ typedef struct
     char operation;   // Operation type: 'A' for ADD, 'S' for SUB
 } thread_arg_t;
 
+/**
+ * @brief Thread argument structure for one level of the ADD reduction tree
+ */
+typedef struct
+{
+    thread_arg_t *pairs; // Pairs of the level
+    int pair_count;      // Number of pairs
+    int first_pair;      // First pair handled by this thread
+    int pair_stride;     // Distance between consecutive pairs of this thread
+} pair_thread_arg_t;
+
+/**
+ * @brief Thread argument structure for row-partitioned sparse add/sub kernels
+ */
+typedef struct
+{
+    const matrix_t *left;  // Left operand matrix
+    const matrix_t *right; // Right operand matrix
+    matrix_t *result;      // Result matrix (CSR arrays or dense data preallocated)
+    char operation;        // 'A' for ADD, 'S' for SUB
+    int row_begin;         // First row handled by this thread
+    int row_end;           // One past the last row handled by this thread
+} sparse_thread_arg_t;
+
+/**
+ * @brief Thread argument structure for tiled matrix multiplication
+ */
+typedef struct
+{
+    const matrix_t *left;  // Left operand matrix (m x k)
+    const matrix_t *right; // Right operand matrix (k x n)
+    matrix_t *result;      // Result matrix (m x n), zero-initialized
+    int tile_rows;         // Number of row blocks in the result
+    int tile_cols;         // Number of column blocks in the result
+    int first_tile;        // First tile index handled by this thread
+    int tile_stride;       // Distance between consecutive tiles of this thread
+} mul_thread_arg_t;
+
+/**
+ * @brief One shell instance's counters in the --stats-shm segment
+ *
+ * Every field is updated with atomic adds by the owning instance and read
+ * without locks by shellstat. Slots are cache-line aligned so instances
+ * never write to the same line.
+ */
+typedef struct
+{
+    int32_t pid;                               // Owner; 0 if free, negative while being claimed
+    int32_t reserved;                          // Keeps the counters 8-byte aligned
+    uint64_t started;                          // Owner start time (seconds since the epoch)
+    uint64_t commands;                         // Commands executed
+    uint64_t blocked;                          // Dangerous commands blocked
+    uint64_t warned;                           // Commands similar to a dangerous command
+    uint64_t limit_exceeded;                   // Commands stopped by limit
+    uint64_t background_jobs;                  // Pipelines started with '&'
+    uint64_t total_time_ns;                    // Summed execution time of executed commands
+    uint64_t latency_buckets[LATENCY_BUCKETS]; // Executed commands per latency_bucket_bounds[] bucket
+} __attribute__((aligned(CACHE_LINE_SIZE))) stats_slot_t;
+
+/**
+ * @brief Layout of the --stats-shm segment: a header followed by the slots
+ */
+typedef struct
+{
+    uint32_t magic;                      // STATS_SHM_MAGIC once initialized
+    uint32_t version;                    // STATS_SHM_VERSION
+    uint32_t slot_count;                 // Number of slots that follow
+    uint32_t slot_size;                  // sizeof(stats_slot_t) of the writer
+    stats_slot_t retired;                // Counters folded in by instances that have exited
+    stats_slot_t slots[STATS_SHM_SLOTS]; // One per running shell instance
+} stats_shm_t;
+
 #endif // TYPES_H
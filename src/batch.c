@@ -0,0 +1,559 @@
+#include "../include/shell.h"
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int batch_mode = 0; // Set when stdin is not a TTY or a script is given with -f
+int batch_jobs = 1; // -j N: lines run concurrently in batch mode
+
+/* Reusable copy of the current line; execute_line() needs a terminated string */
+static char *line_buf = NULL;
+static size_t line_cap = 0;
+
+/*
+ * -j scheduler state. Jobs form a ring in input order: [head, head + queued)
+ * holds lines that are running or finished but not yet printed, at most
+ * batch_jobs of them running at a time.
+ */
+static batch_job_t *jobs = NULL;
+static batch_result_t *results = NULL; // MAP_SHARED, written by the workers
+static struct pollfd *worker_fds = NULL; // pidfds of the running workers, for reap_worker()
+static int window = 0;
+static int head = 0;
+static int queued = 0;
+static int running = 0;
+static sigset_t saved_mask;
+
+/**
+ * @brief Execute a line without logging it, reporting what it did.
+ *
+ * Used where the line runs away from the process that owns the log and the
+ * statistics (a worker, or a server session); the owner applies the result
+ * with apply_line_result().
+ *
+ * @param line Trimmed line
+ * @param result Output: statistics deltas of the line
+ */
+void execute_line_unlogged(const char *line, batch_result_t *result)
+{
+    FILE *saved_log = log_file;
+    command_stats_t before = stats;
+
+    log_file = NULL;
+    limit_last_reason[0] = '\0';
+    execute_line(line);
+    log_file = saved_log;
+
+    result->executed = stats.cmds_count - before.cmds_count;
+    result->blocked = stats.blocked_cmd_count - before.blocked_cmd_count;
+    result->warned = stats.unblocked_dangerous_cmds_count - before.unblocked_dangerous_cmds_count;
+    result->background = stats.background_jobs - before.background_jobs;
+    result->cache_hits = stats.cache_hits - before.cache_hits;
+    result->cache_misses = stats.cache_misses - before.cache_misses;
+    result->cache_evictions = stats.cache_evictions - before.cache_evictions;
+    result->elapsed = stats.last_time;
+    memcpy(result->limit_reason, limit_last_reason, sizeof(result->limit_reason));
+
+    fflush(stdout);
+    fflush(stderr);
+}
+
+/**
+ * @brief Merge a line's result into statistics and log it, as execute_line() would have.
+ * @param target Statistics to update
+ * @param line Line text for the audit log
+ * @param result Result reported by execute_line_unlogged()
+ */
+void apply_line_result(command_stats_t *target, const char *line, const batch_result_t *result)
+{
+    target->blocked_cmd_count += result->blocked;
+    target->unblocked_dangerous_cmds_count += result->warned;
+    target->background_jobs += result->background;
+    target->cache_hits += result->cache_hits;
+    target->cache_misses += result->cache_misses;
+    target->cache_evictions += result->cache_evictions;
+    if (result->limit_reason[0])
+    {
+        target->limit_violations++;
+        log_limit_violation(log_file, line, result->limit_reason);
+    }
+    if (result->executed)
+    {
+        ++target->cmds_count;
+        update_command_stats(target, result->elapsed);
+        log_command_execution(log_file, line, result->elapsed);
+    }
+}
+
+/**
+ * @brief Check whether one pipeline stage changes shell state.
+ * @param stage Stage text, from its first word to the end of the line
+ * @return 1 for cd, exit, mcalc let and mcalc free, 0 otherwise
+ */
+static int is_barrier_stage(const char *stage)
+{
+    stage += strspn(stage, " \t");
+    size_t len = strcspn(stage, " \t|");
+    if ((len == 2 && strncmp(stage, "cd", 2) == 0) || (len == 4 && strncmp(stage, "exit", 4) == 0))
+        return 1;
+
+    if (len == 5 && strncmp(stage, "mcalc", 5) == 0)
+    {
+        const char *sub = stage + len + strspn(stage + len, " \t");
+        size_t sub_len = strcspn(sub, " \t|");
+        return (sub_len == 3 && strncmp(sub, "let", 3) == 0) ||
+               (sub_len == 4 && strncmp(sub, "free", 4) == 0);
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether a line changes shell state and must run alone.
+ *
+ * cd and exit act on the shell process itself, and mcalc let/free change
+ * the session's named matrices, so they cannot run in a worker. mcalc also
+ * runs inside the shell as a pipeline stage, so every stage is looked at.
+ *
+ * @param line Trimmed line
+ * @return 1 for a barrier line, 0 otherwise
+ */
+int is_barrier_line(const char *line)
+{
+    for (const char *stage = line; stage; stage = strchr(stage, '|'))
+    {
+        if (*stage == '|')
+            stage++;
+        if (is_barrier_stage(stage))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Copy a worker's captured output to the shell's own stream.
+ * @param src memfd holding the output
+ * @param dst Destination descriptor
+ */
+static void replay_output(int src, int dst)
+{
+    size_t len;
+    void *data = capture_map(src, &len);
+
+    if (data)
+    {
+        write_all(dst, data, len);
+        munmap(data, len);
+    }
+
+    // Ready the memfd for the slot's next job
+    if (ftruncate(src, 0) == -1 || lseek(src, 0, SEEK_SET) == -1)
+        perror("batch");
+}
+
+/**
+ * @brief Wait for at least one worker to exit and mark its job finished.
+ *
+ * Only the workers' own pids are waited for: the shell has other children
+ * (the launcher, background jobs of barrier lines) that are not ours to reap.
+ *
+ * @return 0 on success, -1 if there is nothing to wait for
+ */
+static int reap_worker(void)
+{
+    for (;;)
+    {
+        int watched = 0, unwatched = 0;
+        for (int i = 0; i < queued; i++)
+        {
+            batch_job_t *job = &jobs[(head + i) % window];
+            if (job->pid == 0)
+                continue;
+            if (job->pidfd >= 0)
+            {
+                worker_fds[watched].fd = job->pidfd;
+                worker_fds[watched++].events = POLLIN;
+            }
+            else
+            {
+                unwatched = 1;
+            }
+        }
+        if (!watched && !unwatched)
+            return -1;
+
+        // Without a pidfd for some worker, re-check every 10 ms
+        if (poll(worker_fds, watched, unwatched ? 10 : -1) == -1 && errno != EINTR)
+        {
+            perror("poll");
+            return -1;
+        }
+
+        int reaped = 0;
+        for (int i = 0; i < queued; i++)
+        {
+            batch_job_t *job = &jobs[(head + i) % window];
+            if (job->pid == 0)
+                continue;
+
+            // ECHILD: already gone, so it cannot be waited for again
+            pid_t pid = waitpid(job->pid, NULL, WNOHANG);
+            if (pid == 0 || (pid == -1 && errno != ECHILD))
+                continue;
+
+            if (job->pidfd >= 0)
+                close(job->pidfd);
+            job->pidfd = -1;
+            job->pid = 0;
+            running--;
+            reaped = 1;
+        }
+        if (reaped)
+            return 0;
+    }
+}
+
+/**
+ * @brief Print and account for finished jobs at the head of the ring, in input order.
+ */
+static void retire_finished_jobs(void)
+{
+    while (queued > 0 && jobs[head].pid == 0)
+    {
+        batch_job_t *job = &jobs[head];
+        batch_result_t *result = &results[head];
+
+        fflush(stdout); // output of a preceding barrier line goes first
+        replay_output(job->out_fd, STDOUT_FILENO);
+        replay_output(job->err_fd, STDERR_FILENO);
+
+        apply_line_result(&stats, job->line, result);
+        metrics_publish(&stats);
+        stats_shm_sync(&stats);
+
+        free(job->line);
+        job->line = NULL;
+        head = (head + 1) % window;
+        queued--;
+    }
+}
+
+/**
+ * @brief Wait until every dispatched line has finished and been printed.
+ */
+static void drain_jobs(void)
+{
+    while (queued > 0)
+    {
+        retire_finished_jobs();
+        if (queued > 0 && reap_worker() == -1)
+        {
+            // Lost track of a worker (should not happen); treat it as finished
+            jobs[head].pid = 0;
+            running = 0;
+        }
+    }
+}
+
+/**
+ * @brief Run one line in a worker process whose output is captured.
+ * @param line Trimmed line
+ * @return 0 on success, -1 if the worker could not be started
+ */
+static int dispatch_line(const char *line)
+{
+    // Make room: at most batch_jobs running and window lines queued
+    while (running >= batch_jobs || queued == window)
+    {
+        if (reap_worker() == -1)
+            break;
+        retire_finished_jobs();
+    }
+
+    int slot = (head + queued) % window;
+    batch_job_t *job = &jobs[slot];
+    batch_result_t *result = &results[slot];
+
+    if (job->out_fd < 0)
+        job->out_fd = memfd_create("batch-stdout", MFD_CLOEXEC);
+    if (job->err_fd < 0)
+        job->err_fd = memfd_create("batch-stderr", MFD_CLOEXEC);
+    job->line = strdup(line);
+    if (job->out_fd < 0 || job->err_fd < 0 || !job->line)
+    {
+        perror("batch");
+        free(job->line);
+        job->line = NULL;
+        return -1;
+    }
+
+    memset(result, 0, sizeof(*result));
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+        dup2(job->out_fd, STDOUT_FILENO);
+        dup2(job->err_fd, STDERR_FILENO);
+
+        // The shell logs the line when it retires the job
+        execute_line_unlogged(line, result);
+        _exit(0);
+    }
+    else if (pid < 0)
+    {
+        perror("fork");
+        free(job->line);
+        job->line = NULL;
+        return -1;
+    }
+
+    job->pid = pid;
+    job->pidfd = open_pidfd(pid);
+    queued++;
+    running++;
+    return 0;
+}
+
+/**
+ * @brief Set up the -j scheduler.
+ * @return 0 on success, -1 on failure (the caller runs lines sequentially)
+ */
+static int start_jobs(void)
+{
+    window = batch_jobs * BATCH_WINDOW_FACTOR;
+    jobs = calloc(window, sizeof(batch_job_t));
+    worker_fds = calloc(window, sizeof(struct pollfd));
+    results = mmap(NULL, window * sizeof(batch_result_t), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (!jobs || !worker_fds || results == MAP_FAILED)
+    {
+        perror("batch");
+        free(jobs);
+        jobs = NULL;
+        free(worker_fds);
+        worker_fds = NULL;
+        if (results != MAP_FAILED)
+            munmap(results, window * sizeof(batch_result_t));
+        results = NULL;
+        return -1;
+    }
+
+    for (int i = 0; i < window; i++)
+    {
+        jobs[i].pidfd = -1;
+        jobs[i].out_fd = -1;
+        jobs[i].err_fd = -1;
+    }
+    head = queued = running = 0;
+
+    // Workers are reaped here, not by the SIGCHLD handler
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &saved_mask);
+    return 0;
+}
+
+/**
+ * @brief Drain the -j scheduler and release its resources.
+ */
+static void stop_jobs(void)
+{
+    if (!jobs)
+        return;
+
+    drain_jobs();
+    sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+
+    for (int i = 0; i < window; i++)
+    {
+        if (jobs[i].out_fd >= 0)
+            close(jobs[i].out_fd);
+        if (jobs[i].err_fd >= 0)
+            close(jobs[i].err_fd);
+    }
+    free(jobs);
+    jobs = NULL;
+    free(worker_fds);
+    worker_fds = NULL;
+    munmap(results, window * sizeof(batch_result_t));
+    results = NULL;
+}
+
+/**
+ * @brief Trim and execute one script line.
+ * @param text Line text (not terminated, without the newline)
+ * @param len Line length
+ * @return 0 on success, -1 on allocation failure
+ */
+static int run_script_line(const char *text, size_t len)
+{
+    if (len + 1 > line_cap)
+    {
+        size_t cap = line_cap ? line_cap : 256;
+        while (cap < len + 1)
+            cap *= 2;
+
+        char *grown = realloc(line_buf, cap);
+        if (!grown)
+        {
+            perror("realloc");
+            return -1;
+        }
+        line_buf = grown;
+        line_cap = cap;
+    }
+
+    memcpy(line_buf, text, len);
+    char *line = trim_spaces(line_buf, len);
+    if (!*line)
+        return 0;
+
+    if (jobs && !is_barrier_line(line) && dispatch_line(line) == 0)
+        return 0;
+
+    // Sequential line, or a barrier: everything before it finishes first
+    if (jobs)
+        drain_jobs();
+    execute_line(line);
+    metrics_publish(&stats);
+    stats_shm_sync(&stats);
+    return 0;
+}
+
+/**
+ * @brief Execute every complete line in a block of script text.
+ * @param data Script text
+ * @param len Length of data
+ * @param final Treat a trailing line without newline as complete
+ * @return Number of bytes consumed, or -1 on error
+ */
+static ssize_t run_script_block(const char *data, size_t len, int final)
+{
+    size_t pos = 0;
+
+    while (pos < len)
+    {
+        const char *newline = memchr(data + pos, '\n', len - pos);
+        if (!newline && !final)
+            break;
+
+        size_t end = newline ? (size_t)(newline - data) : len;
+        if (run_script_line(data + pos, end - pos) == -1)
+            return -1;
+        pos = newline ? end + 1 : len;
+    }
+
+    return (ssize_t)pos;
+}
+
+/**
+ * @brief Run a mapped regular file as a script.
+ * @return 0 on success, -1 on error, 1 if the file cannot be mapped
+ */
+static int run_mapped_script(int fd, size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return 1;
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    // The script is consumed in one go, so commands that read stdin see EOF
+    lseek(fd, 0, SEEK_END);
+
+    ssize_t status = run_script_block(data, size, 1);
+    munmap(data, size);
+    return status == -1 ? -1 : 0;
+}
+
+/**
+ * @brief Run a pipe or other unmappable input, reading it in large blocks.
+ * @return 0 on success, -1 on error
+ */
+static int run_streamed_script(int fd)
+{
+    size_t cap = BATCH_BLOCK_SIZE, used = 0;
+    char *buf = malloc(cap);
+    if (!buf)
+    {
+        perror("malloc");
+        return -1;
+    }
+
+    int status = 0;
+    while (1)
+    {
+        // Keep room for a full block after any partial line carried over
+        if (cap - used < BATCH_BLOCK_SIZE / 2)
+        {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown)
+            {
+                perror("realloc");
+                status = -1;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+
+        ssize_t n = read(fd, buf + used, cap - used);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            status = -1;
+            break;
+        }
+
+        used += n;
+        ssize_t consumed = run_script_block(buf, used, n == 0);
+        if (consumed < 0)
+        {
+            status = -1;
+            break;
+        }
+
+        memmove(buf, buf + consumed, used - consumed);
+        used -= consumed;
+        if (n == 0)
+            break;
+    }
+
+    free(buf);
+    return status;
+}
+
+/**
+ * @brief Execute a script without prompts, mapping it when possible.
+ *
+ * With -j N, up to N lines run at once in worker processes; their output,
+ * statistics and log records are applied in input order as they finish.
+ * @param fd Script descriptor (a file opened for -f, or stdin)
+ * @return 0 on success, -1 on error
+ */
+int run_batch(int fd)
+{
+    struct stat st;
+    int status = 1;
+
+    if (batch_jobs > 1)
+        start_jobs();
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        status = run_mapped_script(fd, (size_t)st.st_size);
+    if (status == 1)
+        status = run_streamed_script(fd);
+    stop_jobs();
+
+    free(line_buf);
+    line_buf = NULL;
+    line_cap = 0;
+    return status;
+}
@@ -0,0 +1,305 @@
+#include "../include/shell.h"
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <time.h>
+
+/*
+ * Result cache for deterministic builtin calls (--builtin-cache SIZE). A
+ * call is keyed by a normalized form the builtin writes (for mcalc, its
+ * parsed operands), and found through a keyed SipHash-2-4 of that key; the full key is compared on lookup, so a
+ * hash collision can never return the wrong result. An entry holds the
+ * call's stdout and exit status. Entries live in one LRU list and the least
+ * recently used ones are dropped to keep the total size within the budget.
+ */
+
+static builtin_cache_entry_t **buckets = NULL;
+static size_t bucket_count = 0;
+static size_t entry_count = 0;
+static builtin_cache_entry_t *lru_head = NULL; // Most recently used
+static builtin_cache_entry_t *lru_tail = NULL; // Next to be evicted
+static size_t budget = 0;
+static size_t used = 0;
+static uint64_t sip_key[2];
+
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+static void sip_round(uint64_t v[4])
+{
+    v[0] += v[1];
+    v[1] = ROTL64(v[1], 13) ^ v[0];
+    v[0] = ROTL64(v[0], 32);
+    v[2] += v[3];
+    v[3] = ROTL64(v[3], 16) ^ v[2];
+    v[0] += v[3];
+    v[3] = ROTL64(v[3], 21) ^ v[0];
+    v[2] += v[1];
+    v[1] = ROTL64(v[1], 17) ^ v[2];
+    v[2] = ROTL64(v[2], 32);
+}
+
+/**
+ * @brief SipHash-2-4 of a byte string
+ * @param data Bytes to hash
+ * @param len Number of bytes
+ * @return 64-bit hash under sip_key
+ */
+static uint64_t siphash(const unsigned char *data, size_t len)
+{
+    uint64_t v[4] = {0x736f6d6570736575ull ^ sip_key[0], 0x646f72616e646f6dull ^ sip_key[1],
+                     0x6c7967656e657261ull ^ sip_key[0], 0x7465646279746573ull ^ sip_key[1]};
+    size_t tail = len & 7;
+
+    for (const unsigned char *end = data + (len - tail); data < end; data += 8)
+    {
+        uint64_t m;
+        memcpy(&m, data, 8); // Host byte order: hashes never leave the process
+        v[3] ^= m;
+        sip_round(v);
+        sip_round(v);
+        v[0] ^= m;
+    }
+
+    uint64_t last = (uint64_t)len << 56;
+    for (size_t i = 0; i < tail; i++)
+        last |= (uint64_t)data[i] << (8 * i);
+
+    v[3] ^= last;
+    sip_round(v);
+    sip_round(v);
+    v[0] ^= last;
+    v[2] ^= 0xff;
+    for (int i = 0; i < 4; i++)
+        sip_round(v);
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+/**
+ * @brief Enable the cache
+ * @param size Memory budget in bytes, entries and keys included
+ * @return 0 on success, -1 on error
+ */
+int builtin_cache_init(long long size)
+{
+    buckets = calloc(BUILTIN_CACHE_BUCKETS, sizeof(*buckets));
+    if (!buckets)
+    {
+        perror("builtin-cache");
+        return -1;
+    }
+    bucket_count = BUILTIN_CACHE_BUCKETS;
+    budget = (size_t)size;
+
+    // A random key keeps crafted arguments from piling into one bucket
+    if (getrandom(sip_key, sizeof(sip_key), GRND_NONBLOCK) != (ssize_t)sizeof(sip_key))
+    {
+        sip_key[0] = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+        sip_key[1] = (uint64_t)(uintptr_t)&sip_key ^ 0x9E3779B97F4A7C15ull;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether --builtin-cache is on
+ */
+int builtin_cache_enabled(void)
+{
+    return buckets != NULL;
+}
+
+static void lru_unlink(builtin_cache_entry_t *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        lru_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        lru_tail = entry->prev;
+}
+
+static void lru_push_front(builtin_cache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = lru_head;
+    if (lru_head)
+        lru_head->prev = entry;
+    lru_head = entry;
+    if (!lru_tail)
+        lru_tail = entry;
+}
+
+static size_t entry_size(const builtin_cache_entry_t *entry)
+{
+    return sizeof(*entry) + entry->key_len + entry->output_len;
+}
+
+/**
+ * @brief Remove an entry from its bucket and the LRU list and free it
+ */
+static void drop_entry(builtin_cache_entry_t *entry)
+{
+    builtin_cache_entry_t **link = &buckets[entry->hash & (bucket_count - 1)];
+    while (*link != entry)
+        link = &(*link)->chain;
+    *link = entry->chain;
+
+    lru_unlink(entry);
+    used -= entry_size(entry);
+    entry_count--;
+    free(entry);
+}
+
+/**
+ * @brief Double the bucket array once the chains get long
+ */
+static void grow_buckets(void)
+{
+    size_t new_count = bucket_count * 2;
+    builtin_cache_entry_t **grown = calloc(new_count, sizeof(*grown));
+    if (!grown)
+        return; // Longer chains, still correct
+
+    for (size_t i = 0; i < bucket_count; i++)
+    {
+        builtin_cache_entry_t *entry = buckets[i];
+        while (entry)
+        {
+            builtin_cache_entry_t *next = entry->chain;
+            entry->chain = grown[entry->hash & (new_count - 1)];
+            grown[entry->hash & (new_count - 1)] = entry;
+            entry = next;
+        }
+    }
+    free(buckets);
+    buckets = grown;
+    bucket_count = new_count;
+}
+
+static builtin_cache_entry_t *lookup(uint64_t hash, const char *key, size_t key_len)
+{
+    for (builtin_cache_entry_t *entry = buckets[hash & (bucket_count - 1)]; entry; entry = entry->chain)
+    {
+        if (entry->hash == hash && entry->key_len == key_len && memcmp(entry->data, key, key_len) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Store a result, evicting least recently used entries to make room
+ */
+static void insert(uint64_t hash, const char *key, size_t key_len, const char *output, size_t output_len, int status)
+{
+    size_t size = sizeof(builtin_cache_entry_t) + key_len + output_len;
+    if (size > budget)
+        return;
+
+    while (used + size > budget && lru_tail)
+    {
+        drop_entry(lru_tail);
+        stats.cache_evictions++;
+    }
+
+    builtin_cache_entry_t *entry = malloc(size);
+    if (!entry)
+        return;
+    entry->hash = hash;
+    entry->key_len = key_len;
+    entry->output_len = output_len;
+    entry->status = status;
+    memcpy(entry->data, key, key_len);
+    memcpy(entry->data + key_len, output, output_len);
+
+    if (entry_count >= bucket_count)
+        grow_buckets();
+    size_t bucket = hash & (bucket_count - 1);
+    entry->chain = buckets[bucket];
+    buckets[bucket] = entry;
+    lru_push_front(entry);
+    used += size;
+    entry_count++;
+}
+
+/**
+ * @brief Run a deterministic builtin through the cache
+ *
+ * A hit writes the stored output and returns the stored status without
+ * calling run. On a miss, run's stdout descriptor is pointed at a memfd,
+ * and what it wrote is stored and then copied to the real stdout.
+ *
+ * @param cmd Builtin call
+ * @param key_of Writes the normalized key of cmd; returns -1 if cmd cannot be cached
+ * @param run Builtin implementation
+ * @return Exit status of the call
+ */
+int builtin_cache_run(command_t *cmd, int (*key_of)(const command_t *, FILE *), int (*run)(command_t *))
+{
+    char *key = NULL;
+    size_t key_len = 0;
+    FILE *key_stream = open_memstream(&key, &key_len);
+    if (!key_stream)
+        return run(cmd);
+
+    int keyed = key_of(cmd, key_stream);
+    if (fclose(key_stream) != 0 || keyed == -1)
+    {
+        free(key);
+        return run(cmd);
+    }
+
+    uint64_t hash = siphash((const unsigned char *)key, key_len);
+    builtin_cache_entry_t *entry = lookup(hash, key, key_len);
+    int status;
+
+    if (entry)
+    {
+        stats.cache_hits++;
+        lru_unlink(entry);
+        lru_push_front(entry);
+        fwrite(entry->data + entry->key_len, 1, entry->output_len, stdout);
+        status = entry->status;
+    }
+    else
+    {
+        stats.cache_misses++;
+
+        // Captured at the descriptor, so output written any way other than stdio is kept too
+        int capture = capture_open("builtin-cache");
+        int saved = capture == -1 ? -1 : redirect_fd(STDOUT_FILENO, capture);
+        if (saved != -1)
+        {
+            status = run(cmd);
+            restore_fd(STDOUT_FILENO, saved);
+
+            size_t output_len;
+            char *output = capture_map(capture, &output_len);
+            if (output)
+                fwrite(output, 1, output_len, stdout);
+            insert(hash, key, key_len, output ? output : "", output_len, status);
+            if (output)
+                munmap(output, output_len);
+        }
+        else
+        {
+            status = run(cmd);
+        }
+        if (capture != -1)
+            close(capture);
+    }
+
+    free(key);
+    return status;
+}
+
+/**
+ * @brief Release every cached result
+ */
+void builtin_cache_free(void)
+{
+    while (lru_tail)
+        drop_entry(lru_tail);
+    free(buckets);
+    buckets = NULL;
+    bucket_count = 0;
+}
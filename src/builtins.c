@@ -1,343 +1,272 @@
 #include "../include/shell.h"
 
 /**
- * @brief Allocate and initialize a matrix with the given dimensions.
- * @param rows Number of rows
- * @param cols Number of columns
- * @return Pointer to allocated matrix or NULL on failure
- */
-static matrix_t *create_matrix(int rows, int cols)
-{
-    matrix_t *mat = malloc(sizeof(matrix_t));
-    if (!mat)
-        return NULL;
-
-    mat->rows = rows;
-    mat->cols = cols;
-    mat->data = calloc(rows * cols, sizeof(double));
-    if (!mat->data)
-    {
-        free(mat);
-        return NULL;
-    }
-    return mat;
-}
-
-/**
- * @brief Free the memory associated with a matrix.
- * @param mat Pointer to the matrix to free
+ * @brief Free an array of matrices and the array itself
+ * @param matrices Array of matrix pointers
+ * @param count Number of matrices in the array
  */
-static void free_matrix(matrix_t *mat)
+static void free_matrices(matrix_t **matrices, int count)
 {
-    if (mat)
+    for (int i = 0; i < count; i++)
     {
-        free(mat->data);
-        free(mat);
+        free_matrix(matrices[i]);
     }
+    free(matrices);
 }
 
 /**
- * @brief Parse a matrix from a string in the format "(rows,cols:val1,val2,...,valN)".
- * @param str Input string to parse
- * @return Dynamically allocated matrix or NULL on format/parse error
+ * @brief Parse one mcalc operand and append the resulting matrices
+ *
+ * An operand is a "(rows,cols:...)" literal, "@path", which loads every
+ * matrix stored in the file (text or binary format), or "$NAME", which
+ * shares a matrix from the session store without parsing or copying.
+ *
+ * @return 0 on success, -1 on error
  */
-static matrix_t *parse_matrix(const char *str)
+static int load_mcalc_operand(const char *arg, matrix_t ***matrices, int *count, int *capacity)
 {
-    if (!str || str[0] != '(' || !strchr(str, ')'))
+    if (arg[0] == '@')
     {
-        return NULL;
+        return load_matrix_file(arg + 1, matrices, count, capacity);
     }
 
-    // Find the parts
-    const char *comma1 = strchr(str + 1, ',');
-    const char *colon = strchr(str + 1, ':');
-    const char *end = strchr(str + 1, ')');
-
-    if (!comma1 || !colon || !end || comma1 >= colon || colon >= end)
+    if (arg[0] == '$')
     {
-        return NULL;
-    }
-
-    // Parse dimensions
-    int rows = atoi(str + 1);
-    int cols = atoi(comma1 + 1);
-
-    if (rows <= 0 || cols <= 0)
-    {
-        return NULL;
+        matrix_t *named = matrix_store_get(arg + 1);
+        if (!named)
+        {
+            return -1;
+        }
+        if (append_matrix(matrices, count, capacity, retain_matrix(named)) == -1)
+        {
+            free_matrix(named);
+            return -1;
+        }
+        return 0;
     }
 
-    matrix_t *mat = create_matrix(rows, cols);
+    matrix_t *mat = parse_matrix(arg);
     if (!mat)
-        return NULL;
-
-    // Parse values
-    const char *values = colon + 1;
-    char *values_copy = strndup(values, end - values);
-    if (!values_copy)
     {
-        free_matrix(mat);
-        return NULL;
+        return -1;
     }
 
-    char *token = strtok(values_copy, ",");
-    int index = 0;
-
-    while (token && index < rows * cols)
-    {
-        mat->data[index] = atof(token);
-        token = strtok(NULL, ",");
-        index++;
-    }
-
-    free(values_copy);
-
-    if (index != rows * cols)
+    if (append_matrix(matrices, count, capacity, mat) == -1)
     {
         free_matrix(mat);
-        return NULL;
+        return -1;
     }
-
-    return mat;
+    return 0;
 }
 
 /**
- * @brief Check if two matrices have the same dimensions.
- * @param m1 First matrix
- * @param m2 Second matrix
- * @return 1 if compatible, 0 otherwise
+ * @brief Check that a string is a valid matrix variable name ([A-Za-z_][A-Za-z0-9_]*)
+ * @param name Candidate name
+ * @return 1 if valid, 0 otherwise
  */
-static int matrices_compatible(matrix_t *m1, matrix_t *m2)
+static int is_valid_matrix_name(const char *name)
 {
-    return (m1->rows == m2->rows && m1->cols == m2->cols);
+    if (!isalpha((unsigned char)*name) && *name != '_')
+        return 0;
+
+    for (const char *p = name + 1; *p; p++)
+    {
+        if (!isalnum((unsigned char)*p) && *p != '_')
+            return 0;
+    }
+    return 1;
 }
 
 /**
- * @brief Thread function to perform matrix addition or subtraction.
- * @param arg Pointer to thread_arg_t structure containing inputs and operation type
- * @return Pointer to result matrix or NULL on error/incompatibility
+ * @brief "mcalc let NAME operand": parse once and keep the matrix for the session
+ * @param cmd Command structure
+ * @return 0 on success, 1 on error
  */
-static void *matrix_operation_thread(void *arg)
+static int mcalc_let(command_t *cmd)
 {
-    thread_arg_t *args = (thread_arg_t *)arg;
-
-    if (!matrices_compatible(args->left, args->right))
+    if (cmd->argc != 4 || !is_valid_matrix_name(cmd->args[2]))
     {
-        return NULL;
+        printf("ERR_MAT_INPUT\n");
+        return 1;
     }
 
-    args->result = create_matrix(args->left->rows, args->left->cols);
-    if (!args->result)
-        return NULL;
-
-    int size = args->left->rows * args->left->cols;
+    matrix_t **matrices = NULL;
+    int matrix_count = 0, capacity = 0;
 
-    if (args->operation == 'A')
-    { // ADD
-        for (int i = 0; i < size; i++)
-        {
-            args->result->data[i] = args->left->data[i] + args->right->data[i];
-        }
+    // The operand must describe exactly one matrix
+    if (load_mcalc_operand(cmd->args[3], &matrices, &matrix_count, &capacity) == -1 ||
+        matrix_count != 1)
+    {
+        free_matrices(matrices, matrix_count);
+        printf("ERR_MAT_INPUT\n");
+        return 1;
     }
-    else if (args->operation == 'S')
-    { // SUB
-        for (int i = 0; i < size; i++)
+
+    matrix_t *mat = matrices[0];
+    free(matrices);
+
+    // A mapped @file can be rewritten or truncated later; the name keeps a private copy
+    if (mat->mapping)
+    {
+        matrix_t *copy = copy_matrix(mat);
+        free_matrix(mat);
+        if (!copy)
         {
-            args->result->data[i] = args->left->data[i] - args->right->data[i];
+            printf("ERR_MAT_INPUT\n");
+            return 1;
         }
+        mat = copy;
     }
 
-    return args->result;
+    if (matrix_store_set(cmd->args[2], mat) == -1)
+    {
+        free_matrix(mat);
+        return 1;
+    }
+    return 0;
 }
 
 /**
- * @brief Compute the result of a sequence of matrix operations (addition or subtraction) in parallel.
- * @param matrices Array of matrix pointers
- * @param count Number of matrices
- * @param operation 'A' for addition, 'S' for subtraction
- * @return Result matrix or NULL on failure
+ * @brief "mcalc free NAME...": drop named matrices from the session store
+ * @param cmd Command structure
+ * @return 0 on success, 1 if a name was not bound
  */
-static matrix_t *compute_matrices_parallel(matrix_t **matrices, int count, char operation)
+static int mcalc_free(command_t *cmd)
 {
-    if (count == 1)
+    if (cmd->argc < 3)
     {
-        // Base case: return copy of single matrix
-        matrix_t *result = create_matrix(matrices[0]->rows, matrices[0]->cols);
-        if (!result)
-            return NULL;
-
-        int size = matrices[0]->rows * matrices[0]->cols;
-        memcpy(result->data, matrices[0]->data, size * sizeof(double));
-        return result;
-    }
-
-    if (count == 2)
-    {
-        // Base case: compute two matrices
-        thread_arg_t arg = {matrices[0], matrices[1], NULL, operation};
-        matrix_operation_thread(&arg);
-        return arg.result;
+        printf("ERR_MAT_INPUT\n");
+        return 1;
     }
 
-    if (operation == 'S')
+    int status = 0;
+    for (int i = 2; i < cmd->argc; i++)
     {
-        // For subtraction, we use a left-associative parallel approach
-        // Split into two halves: left half and right half
-        // Compute: (left_result) - (right_result)
-        // where left_result = matrices[0] - matrices[1] - ... - matrices[mid-1]
-        // and right_result = matrices[mid] + matrices[mid+1] + ... + matrices[count-1]
-
-        int mid = count / 2;
-        if (mid == 0)
-            mid = 1; // Ensure at least one matrix in left part
-
-        // Recursively compute left part (subtraction)
-        matrix_t *left_result = compute_matrices_parallel(matrices, mid, 'S');
-        if (!left_result)
-            return NULL;
-
-        // Recursively compute right part (addition, since we'll subtract the sum)
-        matrix_t *right_result = compute_matrices_parallel(&matrices[mid], count - mid, 'A');
-        if (!right_result)
+        if (matrix_store_remove(cmd->args[i]) == -1)
         {
-            free_matrix(left_result);
-            return NULL;
+            fprintf(stderr, "mcalc: %s: no such matrix\n", cmd->args[i]);
+            status = 1;
         }
+    }
+    return status;
+}
 
-        // Now compute left_result - right_result
-        thread_arg_t arg = {left_result, right_result, NULL, 'S'};
-        matrix_operation_thread(&arg);
-
-        // Clean up intermediate results
-        free_matrix(left_result);
-        free_matrix(right_result);
-
-        return arg.result;
+/**
+ * @brief Print an mcalc result or store it in a binary matrix file, then free it
+ * @param result Result matrix (released)
+ * @param output_file Path given with -o, or NULL to print
+ * @return 0 on success, 1 on error
+ */
+static int emit_mcalc_result(matrix_t *result, const char *output_file)
+{
+    int status = 0;
+    if (output_file)
+    {
+        status = (save_matrix_file(output_file, result) == -1) ? 1 : 0;
     }
     else
     {
-        // Parallel tree code for ADD operations
-        int pairs = count / 2;
-        int remainder = count % 2;
-
-        matrix_t **next_level = malloc((pairs + remainder) * sizeof(matrix_t *));
-        if (!next_level)
-            return NULL;
-
-        pthread_t *threads = malloc(pairs * sizeof(pthread_t));
-        thread_arg_t *args = malloc(pairs * sizeof(thread_arg_t));
-
-        if (!threads || !args)
-        {
-            free(next_level);
-            free(threads);
-            free(args);
-            return NULL;
-        }
-
-        // Create threads for pairs
-        for (int i = 0; i < pairs; i++)
-        {
-            args[i].left = matrices[i * 2];
-            args[i].right = matrices[i * 2 + 1];
-            args[i].result = NULL;
-            args[i].operation = operation;
-
-            if (pthread_create(&threads[i], NULL, matrix_operation_thread, &args[i]) != 0)
-            {
-                for (int j = 0; j < i; j++)
-                {
-                    pthread_join(threads[j], NULL);
-                    if (args[j].result)
-                        free_matrix(args[j].result);
-                }
-                free(next_level);
-                free(threads);
-                free(args);
-                return NULL;
-            }
-        }
-
-        // Wait for all threads and collect results
-        for (int i = 0; i < pairs; i++)
-        {
-            pthread_join(threads[i], NULL);
-            next_level[i] = args[i].result;
-
-            if (!next_level[i])
-            {
-                for (int j = 0; j < pairs; j++)
-                {
-                    if (next_level[j])
-                        free_matrix(next_level[j]);
-                }
-                free(next_level);
-                free(threads);
-                free(args);
-                return NULL;
-            }
-        }
+        print_matrix(result);
+    }
 
-        // Handle odd matrix (if any)
-        if (remainder)
-        {
-            next_level[pairs] = matrices[count - 1];
-        }
+    free_matrix(result);
+    return status;
+}
 
-        free(threads);
-        free(args);
+/**
+ * @brief Check whether an mcalc computation depends on nothing but its arguments
+ *
+ * Literal operands qualify; files ("@path"), named matrices ("$NAME", or bare
+ * names in an expression) and -o do not, since their results can change or
+ * the call has a side effect.
+ *
+ * @param cmd Command structure
+ * @return 1 if the result can be cached, 0 otherwise
+ */
+static int mcalc_is_deterministic(const command_t *cmd)
+{
+    if (cmd->argc > 1 && strcmp(cmd->args[1], "-o") == 0)
+        return 0;
 
-        // Recursive call for next level
-        matrix_t *final_result = compute_matrices_parallel(next_level, pairs + remainder, operation);
+    for (int i = 1; i < cmd->argc; i++)
+    {
+        const char *arg = cmd->args[i];
+        if (i == cmd->argc - 1 && cmd->argc > 2)
+            continue; // The operation
 
-        // Clean up intermediate results (but not the odd one if it exists)
-        for (int i = 0; i < pairs; i++)
+        for (const char *p = arg; *p; p++)
         {
-            free_matrix(next_level[i]);
+            if (*p == '@' || *p == '$' || *p == '_' || isalpha((unsigned char)*p))
+                return 0;
         }
-
-        free(next_level);
-        return final_result;
     }
+    return 1;
 }
 
 /**
- * @brief Print a matrix to stdout in the format "(rows,cols:val1,val2,...)".
- * @param mat Pointer to matrix to print
+ * @brief Write the cache key of a deterministic mcalc call
+ *
+ * Operands are parsed and written in canonical form, so calls that spell
+ * the same matrices differently ("1" or "1.0", spacing in an expression)
+ * share one cache entry.
+ *
+ * @param cmd Command accepted by mcalc_is_deterministic()
+ * @param out Stream the key is written to
+ * @return 0 on success, -1 if the call cannot be keyed (it then runs uncached)
  */
-
-static void print_matrix(matrix_t *mat)
+static int mcalc_cache_key(const command_t *cmd, FILE *out)
 {
-    printf("(%d,%d:", mat->rows, mat->cols);
-
-    int size = mat->rows * mat->cols;
-    for (int i = 0; i < size; i++)
+    if (cmd->argc == 2)
     {
-        if (i > 0)
-            printf(",");
-
-        // Check if it's a whole number
-        if (mat->data[i] == (int)mat->data[i])
-        {
-            printf("%d", (int)mat->data[i]);
-        }
-        else
-        {
-            printf("%.10g", mat->data[i]);
-        }
+        if (!is_matrix_expression(cmd->args[1]))
+            return -1;
+        fputc('E', out);
+        return write_expression_key(cmd->args[1], out);
     }
 
-    printf(")\n");
+    fputc('O', out);
+    for (int i = 1; i < cmd->argc - 1; i++)
+    {
+        matrix_t *mat = parse_matrix(cmd->args[i]);
+        if (!mat)
+            return -1;
+        write_matrix_key(mat, out);
+        free_matrix(mat);
+    }
+    fputs(cmd->args[cmd->argc - 1], out); // The operation
+    return 0;
 }
 
 /**
- * @brief Matrix calculator built-in command
+ * @brief Compute an mcalc result from operands or an expression and print it
  * @param cmd Command structure
  * @return 0 on success, 1 on error
  */
-static int builtin_mcalc(command_t *cmd)
+static int mcalc_compute(command_t *cmd)
 {
-    if (cmd->argc < 4)
+    const char *output_file = NULL;
+    int first = 1;
+
+    // "-o out.mat" stores the result in the binary matrix format instead of printing it
+    if (cmd->argc > 2 && strcmp(cmd->args[1], "-o") == 0)
+    {
+        output_file = cmd->args[2];
+        first = 3;
+    }
+
+    // A single argument with operators is an element-wise expression, e.g. "A + B - C*2"
+    if (cmd->argc - first == 1 && is_matrix_expression(cmd->args[first]))
+    {
+        matrix_t *result = evaluate_matrix_expression(cmd->args[first]);
+        if (!result)
+        {
+            printf("ERR_MAT_INPUT\n");
+            return 1;
+        }
+        return emit_mcalc_result(result, output_file);
+    }
+
+    if (cmd->argc - first < 2)
     {
         printf("ERR_MAT_INPUT\n");
         return 1;
@@ -345,100 +274,152 @@ static int builtin_mcalc(command_t *cmd)
 
     // Last argument should be operation
     char *operation = cmd->args[cmd->argc - 1];
-    if (strcmp(operation, "ADD") != 0 && strcmp(operation, "SUB") != 0)
+    if (strcmp(operation, "ADD") != 0 && strcmp(operation, "SUB") != 0 &&
+        strcmp(operation, "MUL") != 0)
     {
         printf("ERR_MAT_INPUT\n");
         return 1;
     }
 
-    int matrix_count = cmd->argc - 2; // Exclude command name and operation
+    // Parse all operands; files may contribute any number of matrices
+    matrix_t **matrices = NULL;
+    int matrix_count = 0, capacity = 0;
+
+    for (int i = first; i < cmd->argc - 1; i++)
+    {
+        if (load_mcalc_operand(cmd->args[i], &matrices, &matrix_count, &capacity) == -1)
+        {
+            free_matrices(matrices, matrix_count);
+            printf("ERR_MAT_INPUT\n");
+            return 1;
+        }
+    }
+
     if (matrix_count < 2)
     {
+        free_matrices(matrices, matrix_count);
         printf("ERR_MAT_INPUT\n");
         return 1;
     }
 
-    // Parse all matrices
-    matrix_t **matrices = malloc(matrix_count * sizeof(matrix_t *));
-    if (!matrices)
+    char op = (strcmp(operation, "ADD") == 0) ? 'A' : (strcmp(operation, "SUB") == 0) ? 'S' : 'M';
+
+    // Check compatibility: same shape for ADD/SUB, matching inner dimensions for MUL
+    int compatible = 1;
+    if (op == 'M')
     {
-        return 1;
+        compatible = matrices_chain_compatible(matrices, matrix_count);
     }
-
-    for (int i = 0; i < matrix_count; i++)
+    else
     {
-        matrices[i] = parse_matrix(cmd->args[i + 1]);
-        if (!matrices[i])
+        for (int i = 1; i < matrix_count && compatible; i++)
         {
-            // Clean up and return error
-            for (int j = 0; j < i; j++)
-            {
-                free_matrix(matrices[j]);
-            }
-            free(matrices);
-            printf("ERR_MAT_INPUT\n");
-            return 1;
+            compatible = matrices_compatible(matrices[0], matrices[i]);
         }
     }
 
-    // Check compatibility
-    for (int i = 1; i < matrix_count; i++)
+    if (!compatible)
     {
-        if (!matrices_compatible(matrices[0], matrices[i]))
-        {
-            for (int j = 0; j < matrix_count; j++)
-            {
-                free_matrix(matrices[j]);
-            }
-            free(matrices);
-            printf("ERR_MAT_INPUT\n");
-            return 1;
-        }
+        free_matrices(matrices, matrix_count);
+        printf("ERR_MAT_INPUT\n");
+        return 1;
     }
 
-    char op = (strcmp(operation, "ADD") == 0) ? 'A' : 'S';
-    matrix_t *result = compute_matrices_parallel(matrices, matrix_count, op);
+    matrix_t *result = (op == 'M') ? matrix_chain_multiply(matrices, matrix_count)
+                                   : compute_matrices_parallel(matrices, matrix_count, op);
+
+    // Operands are released first: the output file may be one of the mapped inputs
+    free_matrices(matrices, matrix_count);
 
     if (!result)
     {
-        for (int i = 0; i < matrix_count; i++)
-        {
-            free_matrix(matrices[i]);
-        }
-        free(matrices);
         return 1;
     }
 
-    // Print result
-    print_matrix(result);
+    return emit_mcalc_result(result, output_file);
+}
 
-    // Clean up
-    for (int i = 0; i < matrix_count; i++)
+/**
+ * @brief Matrix calculator built-in command
+ *
+ * Usage: mcalc [-o out.mat] operand... ADD|SUB|MUL
+ *        mcalc [-o out.mat] "expression"
+ *        mcalc let NAME operand | mcalc vars | mcalc free NAME...
+ *
+ * With --builtin-cache, computations over literals are answered from the
+ * result cache when the same call was made before.
+ *
+ * @param cmd Command structure
+ * @return 0 on success, 1 on error
+ */
+static int builtin_mcalc(command_t *cmd)
+{
+    if (cmd->argc > 1)
     {
-        free_matrix(matrices[i]);
+        if (strcmp(cmd->args[1], "let") == 0)
+            return mcalc_let(cmd);
+        if (strcmp(cmd->args[1], "free") == 0)
+            return mcalc_free(cmd);
+        if (strcmp(cmd->args[1], "vars") == 0 && cmd->argc == 2)
+        {
+            matrix_store_list(stdout);
+            return 0;
+        }
     }
-    free(matrices);
-    free_matrix(result);
 
-    return 0;
+    if (builtin_cache_enabled() && mcalc_is_deterministic(cmd))
+        return builtin_cache_run(cmd, mcalc_cache_key, mcalc_compute);
+    return mcalc_compute(cmd);
 }
 
 /**
  * @brief Custom tee implementation
+ *
+ * Usage: my_tee [-a] [-p] [-b SIZE] file...
+ *   -a       append to the files instead of truncating them
+ *   -p       parallel fan-out: one writer thread per output, so a slow
+ *            output does not hold back the others
+ *   -b SIZE  high-water mark for -p (bytes, K/M/G suffix); implies -p
+ *
+ * Without -p, a shell started with -u copies through io_uring.
+ *
  * @param cmd Command structure
  * @return 0 on success, 1 on error
  */
 static int builtin_my_tee(command_t *cmd)
 {
-    int append = 0, start = 1;
+    int append = 0, parallel = 0, start = 1;
+    long long high_water = TEE_DEFAULT_HIGH_WATER;
 
-    if (cmd->args[1] && strcmp(cmd->args[1], "-a") == 0)
+    for (; start < cmd->argc && cmd->args[start][0] == '-'; start++)
     {
-        append = 1;
-        start = 2;
+        if (strcmp(cmd->args[start], "-a") == 0)
+        {
+            append = 1;
+        }
+        else if (strcmp(cmd->args[start], "-p") == 0)
+        {
+            parallel = 1;
+        }
+        else if (strcmp(cmd->args[start], "-b") == 0 && start + 1 < cmd->argc &&
+                 (high_water = parse_size(cmd->args[start + 1])) > 0)
+        {
+            parallel = 1;
+            start++;
+        }
+        else
+        {
+            fprintf(stderr, "my_tee: invalid option '%s'\n", cmd->args[start]);
+            return 1;
+        }
     }
 
-    int fds[(append == 0) ? MAX_ARGS - 1 : MAX_ARGS - 2], count = 0;
+    int *fds = malloc((cmd->argc > 1 ? cmd->argc : 1) * sizeof(int)), count = 0;
+    if (!fds)
+    {
+        perror("malloc");
+        return 1;
+    }
 
     for (int i = start; i < cmd->argc; ++i)
     {
@@ -450,27 +431,142 @@ static int builtin_my_tee(command_t *cmd)
             // Close already opened fds before returning
             for (int j = 0; j < count; ++j)
                 close(fds[j]);
+            free(fds);
             return 1;
         }
         count++;
     }
 
-    char buf[BUFFER_SIZE];
-    ssize_t n;
-    while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0)
+    int status = 0;
+    int result;
+    if (parallel)
+        result = tee_fanout(STDIN_FILENO, STDOUT_FILENO, fds, count, (size_t)high_water);
+    else if (use_io_uring)
+        result = tee_uring(STDIN_FILENO, STDOUT_FILENO, fds, count);
+    else
+        result = tee_stream(STDIN_FILENO, STDOUT_FILENO, fds, count);
+    if (result == -1)
     {
-        write(STDOUT_FILENO, buf, n);
-        for (int i = 0; i < count; ++i)
-        {
-            write(fds[i], buf, n);
-        }
+        perror("my_tee");
+        status = 1;
     }
 
     for (int i = 0; i < count; ++i)
     {
         close(fds[i]);
     }
+    free(fds);
+
+    return status;
+}
+
+/**
+ * @brief Run a command under resource limits
+ *
+ * Usage: limit [-t DURATION] [-c DURATION] [-m SIZE] command [args...]
+ *   -t DURATION  wall-clock timeout (e.g. 5s, 500ms, 2m); SIGTERM, then SIGKILL
+ *   -c DURATION  CPU time limit (RLIMIT_CPU)
+ *   -m SIZE      address-space limit (RLIMIT_AS; K/M/G suffix)
+ *
+ * @param cmd Command structure
+ * @return Exit status of the command, 124 on timeout, 1 on usage error
+ */
+static int builtin_limit(command_t *cmd)
+{
+    limit_spec_t spec = {0};
+    int start = limit_command_start(cmd->args, cmd->argc);
+
+    for (int i = 1; i < start; i += 2)
+    {
+        const char *opt = cmd->args[i], *value = cmd->args[i + 1];
+        int valid;
+
+        if (strcmp(opt, "-t") == 0)
+            valid = (spec.timeout = parse_duration(value)) > 0;
+        else if (strcmp(opt, "-c") == 0)
+            valid = (spec.cpu_seconds = parse_duration(value)) > 0;
+        else if (strcmp(opt, "-m") == 0)
+            valid = (spec.memory = parse_size(value)) > 0;
+        else
+            valid = 0;
+
+        if (!valid)
+        {
+            fprintf(stderr, "limit: invalid option '%s %s'\n", opt, value);
+            return 1;
+        }
+    }
+
+    if (start >= cmd->argc)
+    {
+        fprintf(stderr, "usage: limit [-t DURATION] [-c DURATION] [-m SIZE] command [args...]\n");
+        return 1;
+    }
+
+    command_t limited = *cmd;
+    limited.args = cmd->args + start;
+    limited.argc = cmd->argc - start;
+
+    char *line = reconstruct_command_string(cmd);
+    int status = run_limited(&limited, &spec, line ? line : cmd->args[start]);
+    free(line);
+    return status;
+}
 
+/**
+ * @brief Print one history entry with its number
+ */
+static void print_history_entry(size_t n)
+{
+    size_t len;
+    const char *text = history_get(n, &len);
+    printf("%6zu  %.*s\n", n, (int)len, text);
+}
+
+/**
+ * @brief List or search the command history
+ *
+ * Usage: history [N] | history -s TEXT | history -p PREFIX
+ *   N          the last N entries (all without N)
+ *   -s TEXT    entries containing TEXT
+ *   -p PREFIX  entries starting with PREFIX
+ *
+ * @param cmd Command structure
+ * @return 0 on success, 1 on usage error
+ */
+static int builtin_history(command_t *cmd)
+{
+    size_t total = history_refresh();
+
+    if (cmd->argc >= 3 && (strcmp(cmd->args[1], "-s") == 0 || strcmp(cmd->args[1], "-p") == 0))
+    {
+        // The pattern may have been split into several arguments
+        command_t pattern_cmd = *cmd;
+        pattern_cmd.args = cmd->args + 2;
+        pattern_cmd.argc = cmd->argc - 2;
+        char *pattern = reconstruct_command_string(&pattern_cmd);
+        if (!pattern)
+            return 1;
+
+        history_query_t query;
+        history_query_init(&query, pattern, strlen(pattern), cmd->args[1][1] == 'p');
+        for (size_t n = history_find(&query, 1, 1); n; n = history_find(&query, n + 1, 1))
+            print_history_entry(n);
+        free(pattern);
+        return 0;
+    }
+
+    char *end = NULL;
+    long last = cmd->argc == 2 ? strtol(cmd->args[1], &end, 10) : 0;
+    if (cmd->argc > 2 || (end && (*end || last < 0)))
+    {
+        fprintf(stderr, "usage: history [N] | history -s TEXT | history -p PREFIX\n");
+        return 1;
+    }
+
+    size_t first = (cmd->argc == 2 && (size_t)last < total) ? total - (size_t)last + 1 : 1;
+    for (size_t n = first; n <= total; n++)
+        print_history_entry(n);
     return 0;
 }
 
@@ -525,7 +621,25 @@ int is_builtin(const char *cmd_str)
 {
     return (strcmp(cmd_str, "cd") == 0 || strcmp(cmd_str, "exit") == 0) ||
            strcmp(cmd_str, "my_tee") == 0 ||
-           strcmp(cmd_str, "mcalc") == 0;
+           strcmp(cmd_str, "mcalc") == 0 ||
+           strcmp(cmd_str, "limit") == 0 ||
+           strcmp(cmd_str, "history") == 0;
+}
+
+/**
+ * @brief Check whether a builtin can run inside the shell as a pipeline stage
+ *
+ * These builtins read stdin and write stdout/stderr, so a pipeline does
+ * not have to fork for them. mcalc let/free change the named matrices of
+ * the shell they run in; is_barrier_line() keeps such lines out of -j and
+ * --serve workers, so the change lands in the shell in every mode.
+ *
+ * @param cmd_str Command name
+ * @return 1 if the builtin can run in the shell, 0 otherwise
+ */
+int is_stream_builtin(const char *cmd_str)
+{
+    return strcmp(cmd_str, "my_tee") == 0 || strcmp(cmd_str, "mcalc") == 0 || strcmp(cmd_str, "history") == 0;
 }
 
 /**
@@ -551,6 +665,14 @@ int execute_builtin(command_t *cmd)
     {
         return builtin_mcalc(cmd);
     }
+    else if (strcmp(cmd->args[0], "limit") == 0)
+    {
+        return builtin_limit(cmd);
+    }
+    else if (strcmp(cmd->args[0], "history") == 0)
+    {
+        return builtin_history(cmd);
+    }
 
     return -1; // Should never reach here
 }
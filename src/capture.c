@@ -0,0 +1,97 @@
+#include "../include/shell.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * In-shell output capture. Builtin pipeline stages run inside the shell with
+ * their standard descriptors temporarily pointed elsewhere; output that has
+ * to be held for a later consumer goes to an anonymous memfd instead of a
+ * pipe, so it has no 64 KiB backpressure and can be handed on as a file
+ * descriptor or mapped without copying.
+ */
+
+/**
+ * @brief Create an empty capture buffer
+ * @param name Name shown for the memfd in /proc/<pid>/fd
+ * @return memfd descriptor, -1 on error
+ */
+int capture_open(const char *name)
+{
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("memfd_create");
+    }
+    return fd;
+}
+
+/**
+ * @brief Map the contents of a capture buffer read-only
+ * @param fd Capture buffer from capture_open()
+ * @param len Output: number of bytes mapped
+ * @return Mapping of the buffer, NULL if it is empty or cannot be mapped
+ */
+void *capture_map(int fd, size_t *len)
+{
+    struct stat st;
+
+    *len = 0;
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
+        return NULL;
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    *len = (size_t)st.st_size;
+    return data;
+}
+
+/**
+ * @brief Point a standard descriptor at another file for an in-shell stage
+ * @param target Descriptor to replace (STDIN_FILENO, STDOUT_FILENO or STDERR_FILENO)
+ * @param fd File the descriptor should refer to
+ * @return Saved copy of the original descriptor for restore_fd(), -1 on error
+ */
+int redirect_fd(int target, int fd)
+{
+    // Output buffered for the old file must not end up in the new one
+    if (target == STDOUT_FILENO)
+        fflush(stdout);
+    else if (target == STDERR_FILENO)
+        fflush(stderr);
+
+    int saved = fcntl(target, F_DUPFD_CLOEXEC, 10);
+    if (saved == -1)
+    {
+        perror("dup");
+        return -1;
+    }
+
+    if (dup2(fd, target) == -1)
+    {
+        perror("dup2");
+        close(saved);
+        return -1;
+    }
+    return saved;
+}
+
+/**
+ * @brief Undo redirect_fd()
+ * @param target Descriptor that was redirected
+ * @param saved Value returned by redirect_fd(); -1 is ignored
+ */
+void restore_fd(int target, int saved)
+{
+    if (saved == -1)
+        return;
+
+    if (target == STDOUT_FILENO)
+        fflush(stdout);
+    else if (target == STDERR_FILENO)
+        fflush(stderr);
+
+    dup2(saved, target);
+    close(saved);
+}
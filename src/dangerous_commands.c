@@ -1,19 +1,119 @@
 #include "../include/shell.h"
+#include <sys/mman.h>
 
 // Global variables
-char dangerous_cmds[MAX_DANGEROUS_CMDS][MAX_CMD_LEN];
+char **dangerous_cmds = NULL;
 size_t dangerous_cmds_count = 0;
+static size_t dangerous_cmds_capacity = 0;
+
+/* Per-entry [exact, base] match counts, shared with forked workers so their hits count too */
+unsigned long *dangerous_hits = NULL;
 command_stats_t stats = {0};
 
+/*
+ * Hash indexes of the blacklist, built when it is loaded: one keyed by the
+ * whole entry (first entry wins), one by its base command (last entry
+ * wins, as the scan reported it). A lookup costs the same for 10 entries
+ * or 100000; without the indexes (allocation failed) the list is scanned.
+ */
+static blacklist_slot_t *exact_index = NULL;
+static blacklist_slot_t *base_index = NULL;
+static size_t index_mask = 0;
+
 /**
- * Extracts the base command (first word) from a command string
+ * Locates the base command (first word) of a command string
  *
  * @param cmd Full command string
- * @param base_cmd Output buffer for base command
+ * @param len Output: length of the base command
+ * @return Pointer to the first character of the base command
+ */
+static const char *base_command(const char *cmd, size_t *len)
+{
+    while (isspace((unsigned char)*cmd))
+        cmd++;
+
+    *len = strcspn(cmd, " \t\n\v\f\r");
+    return cmd;
+}
+
+static uint32_t key_hash(const char *key, size_t len)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    return hash;
+}
+
+/**
+ * Finds the slot of a key in a blacklist index
+ *
+ * @param index exact_index or base_index
+ * @param key Whole command, or its base command (not NUL-terminated)
+ * @param len Length of key
+ * @param hash key_hash() of key
+ * @return Slot holding the key, or the empty slot where it belongs
  */
-static void extract_base_command(const char *cmd, char *base_cmd)
+static blacklist_slot_t *index_slot(blacklist_slot_t *index, const char *key, size_t len, uint32_t hash)
 {
-    sscanf(cmd, "%s", base_cmd);
+    for (size_t s = hash & index_mask;; s = (s + 1) & index_mask)
+    {
+        blacklist_slot_t *slot = &index[s];
+        if (slot->entry == -1)
+            return slot;
+        if (slot->hash != hash)
+            continue;
+
+        const char *entry = dangerous_cmds[slot->entry];
+        size_t entry_len = strlen(entry);
+        if (index == base_index)
+            entry = base_command(entry, &entry_len);
+        if (entry_len == len && memcmp(entry, key, len) == 0)
+            return slot;
+    }
+}
+
+/**
+ * Builds the hash indexes of the loaded blacklist
+ *
+ * @return 0 on success, -1 on allocation failure (lookups then scan the list)
+ */
+static int build_indexes(void)
+{
+    size_t size = 16;
+    while (size < dangerous_cmds_count * 2)
+        size *= 2;
+
+    exact_index = malloc(size * sizeof(blacklist_slot_t));
+    base_index = malloc(size * sizeof(blacklist_slot_t));
+    if (!exact_index || !base_index)
+    {
+        free(exact_index);
+        free(base_index);
+        exact_index = base_index = NULL;
+        return -1;
+    }
+    for (size_t s = 0; s < size; s++)
+        exact_index[s].entry = base_index[s].entry = -1;
+    index_mask = size - 1;
+
+    for (size_t i = 0; i < dangerous_cmds_count; i++)
+    {
+        size_t len = strlen(dangerous_cmds[i]);
+        uint32_t hash = key_hash(dangerous_cmds[i], len);
+        blacklist_slot_t *slot = index_slot(exact_index, dangerous_cmds[i], len, hash);
+        if (slot->entry == -1)
+        {
+            slot->hash = hash;
+            slot->entry = (int)i;
+        }
+
+        const char *base = base_command(dangerous_cmds[i], &len);
+        hash = key_hash(base, len);
+        slot = index_slot(base_index, base, len, hash);
+        slot->hash = hash;
+        slot->entry = (int)i;
+    }
+    return 0;
 }
 
 /**
@@ -24,7 +124,7 @@ static void extract_base_command(const char *cmd, char *base_cmd)
  */
 size_t load_dangerous_commands(const char *filename)
 {
-    dangerous_cmds_count = 0;
+    free_dangerous_commands();
     FILE *file = fopen(filename, "r");
 
     if (!file)
@@ -33,22 +133,67 @@ size_t load_dangerous_commands(const char *filename)
         return 0;
     }
 
-    char line[MAX_CMD_LEN];
-    while (dangerous_cmds_count < MAX_DANGEROUS_CMDS &&
-           read_line(line, sizeof(line), file))
+    char *buffer = NULL, *line;
+    size_t capacity = 0;
+    while ((line = read_line(&buffer, &capacity, file)))
     {
-        if (strlen(line) > 0)
+        if (!*line)
+            continue;
+
+        if (dangerous_cmds_count == dangerous_cmds_capacity)
+        {
+            size_t new_capacity = dangerous_cmds_capacity ? dangerous_cmds_capacity * 2 : 64;
+            char **grown = realloc(dangerous_cmds, new_capacity * sizeof(char *));
+            if (!grown)
+                break;
+            dangerous_cmds = grown;
+            dangerous_cmds_capacity = new_capacity;
+        }
+
+        if ((dangerous_cmds[dangerous_cmds_count] = strdup(line)))
         {
-            strncpy(dangerous_cmds[dangerous_cmds_count], line, MAX_CMD_LEN);
-            dangerous_cmds[dangerous_cmds_count][MAX_CMD_LEN - 1] = '\0';
             dangerous_cmds_count++;
         }
     }
 
+    free(buffer);
     fclose(file);
+
+    if (dangerous_cmds_count > 0)
+    {
+        dangerous_hits = mmap(NULL, dangerous_cmds_count * 2 * sizeof(unsigned long), PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (dangerous_hits == MAP_FAILED)
+            dangerous_hits = NULL;
+        build_indexes();
+    }
     return dangerous_cmds_count;
 }
 
+/**
+ * Releases the loaded dangerous command list
+ */
+void free_dangerous_commands(void)
+{
+    for (size_t i = 0; i < dangerous_cmds_count; i++)
+    {
+        free(dangerous_cmds[i]);
+    }
+    if (dangerous_hits)
+    {
+        munmap(dangerous_hits, dangerous_cmds_count * 2 * sizeof(unsigned long));
+        dangerous_hits = NULL;
+    }
+    free(exact_index);
+    free(base_index);
+    exact_index = base_index = NULL;
+    index_mask = 0;
+    free(dangerous_cmds);
+    dangerous_cmds = NULL;
+    dangerous_cmds_count = 0;
+    dangerous_cmds_capacity = 0;
+}
+
 /**
  * Checks if a command is considered dangerous
  *
@@ -58,17 +203,30 @@ size_t load_dangerous_commands(const char *filename)
  */
 int is_dangerous_command(const char *cmd, int *dangerous_cmd_index)
 {
-    char cmd_base[MAX_CMD_LEN];
-    extract_base_command(cmd, cmd_base);
+    size_t base_len;
+    const char *cmd_base = base_command(cmd, &base_len);
+
+    if (base_index)
+    {
+        // An exact match has the same base command, so a base miss settles it
+        const blacklist_slot_t *base = index_slot(base_index, cmd_base, base_len, key_hash(cmd_base, base_len));
+        if (base->entry == -1)
+            return 0;
+
+        size_t len = strlen(cmd);
+        const blacklist_slot_t *exact = index_slot(exact_index, cmd, len, key_hash(cmd, len));
+        *dangerous_cmd_index = exact->entry != -1 ? exact->entry : base->entry;
+        return exact->entry != -1 ? 2 : 1;
+    }
 
     int found_base = 0;
 
     for (size_t i = 0; i < dangerous_cmds_count; i++)
     {
-        char dangerous_cmd_base[MAX_CMD_LEN];
-        extract_base_command(dangerous_cmds[i], dangerous_cmd_base);
+        size_t dangerous_base_len;
+        const char *dangerous_cmd_base = base_command(dangerous_cmds[i], &dangerous_base_len);
 
-        if (strcmp(cmd_base, dangerous_cmd_base) == 0)
+        if (base_len == dangerous_base_len && memcmp(cmd_base, dangerous_cmd_base, base_len) == 0)
         {
             found_base = 1;
             *dangerous_cmd_index = i;
@@ -89,12 +247,14 @@ int is_dangerous_command(const char *cmd, int *dangerous_cmd_index)
 }
 
 /**
- * Checks pipeline for dangerous commands
+ * Checks the commands of a pipeline against the dangerous command list
  *
  * @param pipeline Pipeline to check
+ * @param warn Report base-command matches; when 0 only exact matches count,
+ *             so a second pass over the same line does not warn twice
  * @return 0: Safe to execute, -1: Block execution
  */
-int check_dangerous_pipeline(pipeline_t *pipeline)
+static int check_pipeline_commands(pipeline_t *pipeline, int warn)
 {
     if (dangerous_cmds_count == 0)
     {
@@ -103,11 +263,38 @@ int check_dangerous_pipeline(pipeline_t *pipeline)
 
     for (int i = 0; i < pipeline->cmd_count; i++)
     {
-        char cmd_str[MAX_CMD_LEN];
-        reconstruct_command_string(&pipeline->commands[i], cmd_str);
+        // limit runs its command itself: check that command, not "limit -t 5 ..."
+        command_t checked = pipeline->commands[i];
+        while (checked.argc > 1 && strcmp(checked.args[0], "limit") == 0)
+        {
+            int start = limit_command_start(checked.args, checked.argc);
+            if (start >= checked.argc)
+                break;
+            checked.args += start;
+            checked.argc -= start;
+        }
+
+        char *cmd_str = reconstruct_command_string(&checked);
+        if (!cmd_str)
+        {
+            perror("malloc");
+            return -1;
+        }
 
         int dangerous_cmd_index = -1;
         int matching_level = is_dangerous_command(cmd_str, &dangerous_cmd_index);
+        free(cmd_str);
+
+        if (matching_level == 1 && !warn)
+        {
+            continue;
+        }
+
+        if (matching_level > 0 && dangerous_hits)
+        {
+            __atomic_fetch_add(&dangerous_hits[dangerous_cmd_index * 2 + (matching_level == 1)], 1,
+                               __ATOMIC_RELAXED);
+        }
 
         if (matching_level == 2)
         {
@@ -130,3 +317,29 @@ int check_dangerous_pipeline(pipeline_t *pipeline)
 
     return 0; // Safe to execute
 }
+
+/**
+ * Checks pipeline for dangerous commands
+ *
+ * @param pipeline Pipeline to check
+ * @return 0: Safe to execute, -1: Block execution
+ */
+int check_dangerous_pipeline(pipeline_t *pipeline)
+{
+    return check_pipeline_commands(pipeline, 1);
+}
+
+/**
+ * Checks a pipeline again once its wildcards have been expanded
+ *
+ * A pattern can expand to a blocked command ("rm -rf /et?" to "rm -rf /etc"),
+ * so exact matches block here too; warnings were already given for the line
+ * as typed.
+ *
+ * @param pipeline Pipeline after expand_globs()
+ * @return 0: Safe to execute, -1: Block execution
+ */
+int check_dangerous_expanded(pipeline_t *pipeline)
+{
+    return check_pipeline_commands(pipeline, 0);
+}
@@ -1,22 +1,59 @@
 #include "../include/shell.h"
 
 /**
- * @brief Setup stderr redirection for a command
- * @param cmd Command with potential stderr redirection
+ * @brief Start an external command through the pre-forked launcher
+ * @param cmd Command to start
+ * @param io Files opened for the command's redirections
+ * @param in_fd Descriptor for the command's stdin
+ * @param out_fd Descriptor for the command's stdout
+ * @param is_background Whether the command's exit is not waited for
+ * @return Process id, -1 to fall back to fork()
  */
-static void setup_error_redirection(const command_t *cmd)
+static pid_t launch_external(const command_t *cmd, const redirect_set_t *io, int in_fd, int out_fd, int is_background)
 {
-    if (cmd->stderr_file)
+    int fds[3] = {in_fd, out_fd, STDERR_FILENO};
+    redirect_resolve(io, fds);
+    return launcher_spawn(cmd->args, fds[0], fds[1], fds[2], is_background);
+}
+
+/**
+ * @brief Run a builtin inside the shell with its descriptors pointed elsewhere
+ * @param cmd Builtin command
+ * @param io Files opened for the command's redirections
+ * @param in_fd Descriptor for its stdin
+ * @param out_fd Descriptor for its stdout
+ * @return Exit status of the builtin, 1 if its descriptors could not be set up
+ */
+static int run_builtin_stage(command_t *cmd, const redirect_set_t *io, int in_fd, int out_fd)
+{
+    int fds[3] = {in_fd, out_fd, STDERR_FILENO};
+    redirect_resolve(io, fds);
+
+    // stderr first: 2>&1 may refer to the stdout that is replaced next
+    int saved_in = -1, saved_out = -1, saved_err = -1, result = 1;
+    if ((fds[2] == STDERR_FILENO || (saved_err = redirect_fd(STDERR_FILENO, fds[2])) != -1) &&
+        (fds[1] == STDOUT_FILENO || (saved_out = redirect_fd(STDOUT_FILENO, fds[1])) != -1) &&
+        (fds[0] == STDIN_FILENO || (saved_in = redirect_fd(STDIN_FILENO, fds[0])) != -1))
     {
-        int stderr_fd = open(cmd->stderr_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (stderr_fd == -1)
-        {
-            perror("open stderr file");
-            exit(1);
-        }
-        dup2(stderr_fd, STDERR_FILENO);
-        close(stderr_fd);
+        result = execute_builtin(cmd);
     }
+
+    restore_fd(STDIN_FILENO, saved_in);
+    restore_fd(STDOUT_FILENO, saved_out);
+    restore_fd(STDERR_FILENO, saved_err);
+    return result;
+}
+
+/**
+ * @brief Convert a wait status to the shell's exit status convention
+ * @param status Status from waitpid() or launcher_wait()
+ * @return Exit code, or -1 if the process did not exit normally
+ */
+static int exit_code(int status)
+{
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    return -1;
 }
 
 /**
@@ -44,16 +81,35 @@ static void setup_pipe_right(int pipefd[2])
 /**
  * @brief Fork and execute external command
  * @param cmd Command to execute
+ * @param io Files opened for the command's redirections
  * @param is_background Whether to run in background
  * @return Exit status or special codes
  */
-static int fork_and_execute_external(const command_t *cmd, int is_background)
+static int fork_and_execute_external(const command_t *cmd, const redirect_set_t *io, int is_background)
 {
+    fflush(stdout); // keep buffered builtin output ahead of the child's
+
+    if (launcher_active())
+    {
+        pid_t pid = launch_external(cmd, io, STDIN_FILENO, STDOUT_FILENO, is_background);
+        if (pid > 0)
+        {
+            if (is_background)
+                return -2;
+
+            int status;
+            if (launcher_wait(pid, &status) == -1)
+                return -1;
+            return exit_code(status);
+        }
+        // Otherwise fall back to forking the shell
+    }
+
     pid_t pid = fork();
 
     if (pid == 0)
     {
-        setup_error_redirection(cmd);
+        redirect_apply(io);
         execvp(cmd->args[0], cmd->args);
         perror("execvp");
         exit(127);
@@ -64,9 +120,7 @@ static int fork_and_execute_external(const command_t *cmd, int is_background)
         {
             int status;
             waitpid(pid, &status, 0);
-            if (WIFEXITED(status))
-                return WEXITSTATUS(status);
-            return -1;
+            return exit_code(status);
         }
         return -2;
     }
@@ -80,28 +134,260 @@ static int fork_and_execute_external(const command_t *cmd, int is_background)
 /**
  * @brief Execute a simple (non-piped) command
  * @param cmd Command to execute
+ * @param io Files opened for the command's redirections
  * @param is_background Whether to run in background
  * @return Exit status
  */
-static int execute_simple_command(command_t *cmd, int is_background)
+static int execute_simple_command(command_t *cmd, const redirect_set_t *io, int is_background)
 {
     if (is_builtin(cmd->args[0]))
     {
-        return execute_builtin(cmd);
+        return run_builtin_stage(cmd, io, STDIN_FILENO, STDOUT_FILENO);
     }
     else
     {
-        return fork_and_execute_external(cmd, is_background);
+        return fork_and_execute_external(cmd, io, is_background);
     }
 }
 
+/**
+ * @brief Combine the wait statuses of both sides of a pipeline
+ * @param status1 Status of the left command
+ * @param status2 Status of the right command
+ * @return Exit status of the pipeline
+ */
+static int pipeline_exit_code(int status1, int status2)
+{
+    // If either command failed with 127 (command not found), return 127
+    if ((WIFEXITED(status1) && WEXITSTATUS(status1) == 127) || (WIFEXITED(status2) && WEXITSTATUS(status2) == 127))
+    {
+        return 127;
+    }
+
+    return exit_code(status2);
+}
+
+/**
+ * @brief Execute a pipeline of two external commands through the launcher
+ * @param pipeline Pipeline containing two commands
+ * @param io Files opened for the redirections of each command
+ * @param result Output: exit status when the pipeline was launched
+ * @return 1 if launched, 0 to fall back to forking the shell
+ */
+static int launch_piped_commands(pipeline_t *pipeline, const redirect_set_t io[2], int *result)
+{
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        *result = -1;
+        return 1;
+    }
+
+    int bg = pipeline->is_background;
+    pid_t pid1 = launch_external(&pipeline->commands[0], &io[0], STDIN_FILENO, pipefd[1], bg);
+    if (pid1 == -1)
+    {
+        // Nothing started (request too large or helper gone): fork instead
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return 0;
+    }
+
+    pid_t pid2 = launch_external(&pipeline->commands[1], &io[1], pipefd[0], STDOUT_FILENO, bg);
+    close(pipefd[0]);
+    close(pipefd[1]);
+
+    if (pid2 == -1)
+    {
+        // The right side could not start; let the left one finish
+        int status;
+        if (!bg)
+            launcher_wait(pid1, &status);
+        *result = -1;
+        return 1;
+    }
+
+    if (bg)
+    {
+        *result = -2;
+        return 1;
+    }
+
+    int status1, status2;
+    if (launcher_wait(pid1, &status1) == -1 || launcher_wait(pid2, &status2) == -1)
+    {
+        *result = -1;
+        return 1;
+    }
+
+    *result = pipeline_exit_code(status1, status2);
+    return 1;
+}
+
+/**
+ * @brief Check whether a pipeline can run with its builtin stages in the shell
+ * @param pipeline Pipeline containing two commands
+ * @return 1 if at least one stage is a stream builtin and neither stage is
+ *         another builtin, 0 otherwise
+ */
+static int runs_in_shell(const pipeline_t *pipeline)
+{
+    const char *left = pipeline->commands[0].args[0];
+    const char *right = pipeline->commands[1].args[0];
+
+    if (pipeline->is_background)
+        return 0;
+    if (is_builtin(left) && !is_stream_builtin(left))
+        return 0;
+    if (is_builtin(right) && !is_stream_builtin(right))
+        return 0;
+    return is_stream_builtin(left) || is_stream_builtin(right);
+}
+
+/**
+ * @brief Start an external pipeline stage
+ * @param cmd Command to start
+ * @param io Files opened for the command's redirections
+ * @param in_fd Descriptor for the command's stdin
+ * @param out_fd Descriptor for the command's stdout
+ * @param launched Output: 1 if the launcher started it, 0 if it was forked
+ * @return Process id, -1 on error
+ */
+static pid_t start_external_stage(const command_t *cmd, const redirect_set_t *io, int in_fd, int out_fd, int *launched)
+{
+    *launched = 0;
+    if (launcher_active())
+    {
+        pid_t pid = launch_external(cmd, io, in_fd, out_fd, 0);
+        if (pid != -1)
+        {
+            *launched = 1;
+            return pid;
+        }
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (in_fd != STDIN_FILENO)
+            dup2(in_fd, STDIN_FILENO);
+        if (out_fd != STDOUT_FILENO)
+            dup2(out_fd, STDOUT_FILENO);
+        redirect_apply(io);
+        execvp(cmd->args[0], cmd->args);
+        perror("execvp");
+        exit(127);
+    }
+    else if (pid == -1)
+    {
+        perror("fork");
+    }
+    return pid;
+}
+
+/**
+ * @brief Wait for an external pipeline stage
+ * @param pid Process id from start_external_stage()
+ * @param launched Whether the launcher started it
+ * @return Exit code of the stage, -1 if it did not exit normally
+ */
+static int wait_external_stage(pid_t pid, int launched)
+{
+    int status;
+
+    if (pid == -1)
+        return -1;
+    if (launched ? launcher_wait(pid, &status) == -1 : waitpid(pid, &status, 0) == -1)
+        return -1;
+    return exit_code(status);
+}
+
+/**
+ * @brief Execute a pipeline whose builtin stages run inside the shell
+ *
+ * A builtin on the left writes into a memfd capture buffer that becomes the
+ * right stage's stdin once the builtin is done; a builtin on the right reads
+ * the external left stage's output from a pipe. Neither case forks the shell
+ * for the builtin.
+ *
+ * @param pipeline Pipeline accepted by runs_in_shell()
+ * @param io Files opened for the redirections of each command
+ * @return Exit status
+ */
+static int execute_in_shell(pipeline_t *pipeline, const redirect_set_t io[2])
+{
+    command_t *left = &pipeline->commands[0], *right = &pipeline->commands[1];
+    int left_code, right_code, launched;
+
+    if (is_stream_builtin(left->args[0]))
+    {
+        int capture_fd = capture_open("pipe-capture");
+        if (capture_fd == -1)
+        {
+            return -1;
+        }
+
+        left_code = run_builtin_stage(left, &io[0], STDIN_FILENO, capture_fd);
+        lseek(capture_fd, 0, SEEK_SET);
+
+        if (is_stream_builtin(right->args[0]))
+        {
+            right_code = run_builtin_stage(right, &io[1], capture_fd, STDOUT_FILENO);
+        }
+        else
+        {
+            pid_t pid = start_external_stage(right, &io[1], capture_fd, STDOUT_FILENO, &launched);
+            right_code = wait_external_stage(pid, launched);
+        }
+        close(capture_fd);
+    }
+    else
+    {
+        int pipefd[2];
+        if (pipe2(pipefd, O_CLOEXEC) == -1)
+        {
+            perror("pipe");
+            return -1;
+        }
+
+        pid_t pid = start_external_stage(left, &io[0], STDIN_FILENO, pipefd[1], &launched);
+        close(pipefd[1]); // the builtin must see EOF once the left side exits
+        right_code = run_builtin_stage(right, &io[1], pipefd[0], STDOUT_FILENO);
+        close(pipefd[0]);
+        left_code = wait_external_stage(pid, launched);
+    }
+
+    // If either command failed with 127 (command not found), return 127
+    if (left_code == 127 || right_code == 127)
+    {
+        return 127;
+    }
+    return right_code;
+}
+
 /**
  * @brief Execute piped commands
  * @param pipeline Pipeline containing two commands
+ * @param io Files opened for the redirections of each command
  * @return Exit status
  */
-static int execute_piped_commands(pipeline_t *pipeline)
+static int execute_piped_commands(pipeline_t *pipeline, const redirect_set_t io[2])
 {
+    fflush(stdout); // children must not inherit unflushed output
+
+    if (runs_in_shell(pipeline))
+    {
+        return execute_in_shell(pipeline, io);
+    }
+
+    int result;
+    if (launcher_active() && !is_builtin(pipeline->commands[0].args[0]) &&
+        !is_builtin(pipeline->commands[1].args[0]) && launch_piped_commands(pipeline, io, &result))
+    {
+        return result;
+    }
+
     int pipefd[2];
     if (pipe(pipefd) == -1)
     {
@@ -114,7 +400,7 @@ static int execute_piped_commands(pipeline_t *pipeline)
     if (pid1 == 0)
     {
         setup_pipe_left(pipefd);
-        setup_error_redirection(&pipeline->commands[0]);
+        redirect_apply(&io[0]);
 
         if (is_builtin(pipeline->commands[0].args[0]))
         {
@@ -133,7 +419,7 @@ static int execute_piped_commands(pipeline_t *pipeline)
     if (pid2 == 0)
     {
         setup_pipe_right(pipefd);
-        setup_error_redirection(&pipeline->commands[1]);
+        redirect_apply(&io[1]);
 
         if (is_builtin(pipeline->commands[1].args[0]))
         {
@@ -158,15 +444,7 @@ static int execute_piped_commands(pipeline_t *pipeline)
         waitpid(pid1, &status1, 0);
         waitpid(pid2, &status2, 0);
 
-        // If either command failed with 127 (command not found), return 127
-        if ((WIFEXITED(status1) && WEXITSTATUS(status1) == 127) || (WIFEXITED(status2) && WEXITSTATUS(status2) == 127))
-        {
-            return 127;
-        }
-
-        if (WIFEXITED(status2))
-            return WEXITSTATUS(status2);
-        return -1;
+        return pipeline_exit_code(status1, status2);
     }
 
     return -2;
@@ -179,14 +457,34 @@ static int execute_piped_commands(pipeline_t *pipeline)
  */
 int execute_pipeline(pipeline_t *pipeline)
 {
+    // Every redirection is opened up front; a missing file stops the whole line
+    redirect_set_t io[2];
+    int foreground = !pipeline->is_background;
+    if (redirect_open(&pipeline->commands[0], &io[0], foreground) == -1)
+    {
+        return 1;
+    }
+    if (pipeline->cmd_count == 2 && redirect_open(&pipeline->commands[1], &io[1], foreground) == -1)
+    {
+        redirect_close(&io[0]);
+        return 1;
+    }
+
+    int result;
     if (pipeline->cmd_count == 1)
     {
-        return execute_simple_command(&pipeline->commands[0], pipeline->is_background);
+        result = execute_simple_command(&pipeline->commands[0], &io[0], pipeline->is_background);
     }
     else
     {
-        return execute_piped_commands(pipeline);
+        result = execute_piped_commands(pipeline, io);
+    }
+
+    for (int i = 0; i < pipeline->cmd_count; i++)
+    {
+        redirect_close(&io[i]);
     }
+    return result;
 }
 
 /**
@@ -215,6 +513,15 @@ int execute_line(const char *line)
         return -1; // Dangerous command blocked
     }
 
+    // Wildcards are expanded only after the check has seen the line as typed,
+    // and the expanded line is checked again
+    int expanded = expand_globs(pipeline);
+    if (expanded == -1 || (expanded > 0 && check_dangerous_expanded(pipeline) == -1))
+    {
+        free_pipeline(pipeline);
+        return -1;
+    }
+
     // Time the command execution
     struct timeval start, end;
     gettimeofday(&start, NULL);
@@ -230,6 +537,10 @@ int execute_line(const char *line)
         update_command_stats(&stats, elapsed_time);
         log_command_execution(log_file, line, elapsed_time);
     }
+    else if (result == -2)
+    {
+        stats.background_jobs++;
+    }
 
     free_pipeline(pipeline);
     return result;
@@ -0,0 +1,478 @@
+#include "../include/shell.h"
+#include <pwd.h>
+
+/*
+ * Tokenizer with $VAR, ${VAR} and ~ expansion. A line is scanned once and
+ * every token, expanded and unquoted, is written straight into the line's
+ * arena. The arguments of mcalc, run bare or under limit, are not
+ * expanded: there $NAME names a matrix, not an environment variable. Variables are found through a hash index of environ built on first
+ * use; the shell never changes its own environment, so the index lives for
+ * the session and is only rebuilt if environ is ever moved.
+ */
+
+typedef struct
+{
+    const char *entry; // "NAME=value" in environ, NULL for an empty slot
+    size_t name_len;   // Length of NAME
+    uint32_t hash;     // name_hash() of NAME
+} env_slot_t;
+
+/*
+ * Bytes are copied as they are scanned. The head chunk always has room for
+ * the rest of the input plus a terminator, since unexpanded text never grows;
+ * only an expansion has to check for space.
+ */
+typedef struct
+{
+    arena_chunk_t **arena; // Arena the token is written into
+    char *token;           // Start of the token being written, in the head chunk
+    char *out;             // Next byte of the token
+    const char *end;       // End of the input
+} token_writer_t;
+
+static env_slot_t *env_slots = NULL;
+static size_t env_mask = 0;
+static char **indexed_environ = NULL; // environ the index was built from
+
+/**
+ * @brief Allocate an arena chunk
+ * @param size Capacity in bytes
+ * @return New chunk, or NULL on allocation failure
+ */
+arena_chunk_t *arena_new(size_t size)
+{
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + size);
+    if (!chunk)
+        return NULL;
+
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->size = size;
+    return chunk;
+}
+
+/**
+ * @brief Free an arena and everything carved out of it
+ * @param arena Most recent chunk (may be NULL)
+ */
+void arena_free(arena_chunk_t *arena)
+{
+    while (arena)
+    {
+        arena_chunk_t *next = arena->next;
+        free(arena);
+        arena = next;
+    }
+}
+
+/**
+ * @brief Carve a block out of an arena (unaligned: the arena holds strings)
+ * @param arena In/out: arena, given a new chunk when the current one is full
+ * @param size Bytes needed
+ * @return Block, or NULL on allocation failure
+ */
+char *arena_alloc(arena_chunk_t **arena, size_t size)
+{
+    arena_chunk_t *chunk = *arena;
+    if (!chunk || chunk->size - chunk->used < size)
+    {
+        size_t grown_size = chunk ? chunk->size * 2 : 0;
+        if (grown_size < size + ARENA_SLACK)
+            grown_size = size + ARENA_SLACK;
+
+        arena_chunk_t *grown = arena_new(grown_size);
+        if (!grown)
+            return NULL;
+        grown->next = chunk;
+        *arena = chunk = grown;
+    }
+
+    char *block = chunk->data + chunk->used;
+    chunk->used += size;
+    return block;
+}
+
+/**
+ * @brief Make room for n more bytes of the current token and the rest of the input
+ *
+ * A token that outgrows the chunk moves to a new, larger one; tokens already
+ * finished stay where they are.
+ *
+ * @param w Token writer
+ * @param n Bytes about to be written
+ * @param rest Unscanned input
+ * @return 0 on success, -1 on allocation failure
+ */
+static int token_reserve(token_writer_t *w, size_t n, const char *rest)
+{
+    arena_chunk_t *chunk = *w->arena;
+    size_t need = n + (size_t)(w->end - rest) + 1;
+    if ((size_t)(chunk->data + chunk->size - w->out) >= need)
+        return 0;
+
+    size_t len = (size_t)(w->out - w->token);
+    size_t size = chunk->size * 2;
+    if (size < len + need + ARENA_SLACK)
+        size = len + need + ARENA_SLACK;
+
+    arena_chunk_t *grown = arena_new(size);
+    if (!grown)
+        return -1;
+    memcpy(grown->data, w->token, len);
+    chunk->used = (size_t)(w->token - chunk->data);
+    grown->next = chunk;
+    *w->arena = grown;
+    w->token = grown->data;
+    w->out = grown->data + len;
+    return 0;
+}
+
+/**
+ * @brief Write an expanded value into the current token
+ * @param rest Input after the reference being replaced
+ * @return 0 on success, -1 on allocation failure
+ */
+static int token_put(token_writer_t *w, const char *value, size_t len, const char *rest)
+{
+    if (token_reserve(w, len, rest) == -1)
+        return -1;
+    memcpy(w->out, value, len);
+    w->out += len;
+    return 0;
+}
+
+/**
+ * @brief Terminate the token being written and start the next one after it
+ * @return The finished token
+ */
+static char *token_finish(token_writer_t *w)
+{
+    char *token = w->token;
+    *w->out++ = '\0';
+    w->token = w->out;
+    return token;
+}
+
+static uint32_t name_hash(const char *name, size_t len)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    return hash;
+}
+
+/**
+ * @brief Build the hash index of environ
+ * @return 0 on success, -1 on allocation failure
+ */
+static int index_environment(void)
+{
+    size_t count = 0;
+    while (environ && environ[count])
+        count++;
+
+    size_t size = 16;
+    while (size < count * 2)
+        size *= 2;
+
+    env_slot_t *slots = calloc(size, sizeof(env_slot_t));
+    if (!slots)
+        return -1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *eq = strchr(environ[i], '=');
+        if (!eq)
+            continue;
+
+        size_t len = (size_t)(eq - environ[i]);
+        uint32_t hash = name_hash(environ[i], len);
+        size_t s = hash & (size - 1);
+        while (slots[s].entry &&
+               !(slots[s].hash == hash && slots[s].name_len == len && memcmp(slots[s].entry, environ[i], len) == 0))
+            s = (s + 1) & (size - 1);
+
+        // The first definition wins, as with getenv()
+        if (!slots[s].entry)
+        {
+            slots[s].entry = environ[i];
+            slots[s].name_len = len;
+            slots[s].hash = hash;
+        }
+    }
+
+    free(env_slots);
+    env_slots = slots;
+    env_mask = size - 1;
+    indexed_environ = environ;
+    return 0;
+}
+
+/**
+ * @brief Look up an environment variable
+ * @param name Variable name (not NUL-terminated)
+ * @param len Length of name
+ * @param value_len Output: length of the value
+ * @return Value, or NULL if the variable is not set
+ */
+static const char *lookup_variable(const char *name, size_t len, size_t *value_len)
+{
+    const char *entry = NULL;
+
+    if ((!env_slots || environ != indexed_environ) && index_environment() == -1)
+    {
+        // No index: scan environ as getenv() would
+        for (char **env = environ; env && *env && !entry; env++)
+        {
+            if (strncmp(*env, name, len) == 0 && (*env)[len] == '=')
+                entry = *env;
+        }
+    }
+    else
+    {
+        uint32_t hash = name_hash(name, len);
+        for (size_t s = hash & env_mask; env_slots[s].entry; s = (s + 1) & env_mask)
+        {
+            if (env_slots[s].hash == hash && env_slots[s].name_len == len &&
+                memcmp(env_slots[s].entry, name, len) == 0)
+            {
+                entry = env_slots[s].entry;
+                break;
+            }
+        }
+    }
+
+    if (!entry)
+        return NULL;
+    *value_len = strlen(entry + len + 1);
+    return entry + len + 1;
+}
+
+/**
+ * @brief Expand a $NAME or ${NAME} reference
+ *
+ * A variable that is not set expands to nothing; a '$' that starts no
+ * reference is literal.
+ *
+ * @param w Token writer
+ * @param pos In/out: position of the '$', moved past the reference
+ * @return 0 on success, -1 on allocation failure
+ */
+static int expand_variable(token_writer_t *w, const char **pos)
+{
+    const char *start = *pos, *p = start + 1;
+    int braced = *p == '{';
+    if (braced)
+        p++;
+
+    const char *name = p;
+    if (isalpha((unsigned char)*p) || *p == '_')
+    {
+        while (isalnum((unsigned char)*p) || *p == '_')
+            p++;
+    }
+    size_t len = (size_t)(p - name);
+    if (len == 0 || (braced && *p != '}'))
+    {
+        *w->out++ = '$';
+        *pos = start + 1;
+        return 0;
+    }
+    if (braced)
+        p++;
+    *pos = p;
+
+    size_t value_len;
+    const char *value = lookup_variable(name, len, &value_len);
+    if (!value)
+        return 0;
+    return token_put(w, value, value_len, p);
+}
+
+/**
+ * @brief Expand a leading ~ or ~user
+ *
+ * Left as written when HOME is not set or the user does not exist.
+ *
+ * @param w Token writer
+ * @param pos In/out: position of the '~', moved past the user name if expanded
+ * @return 0 on success, -1 on allocation failure
+ */
+static int expand_tilde(token_writer_t *w, const char **pos)
+{
+    const char *user = *pos + 1;
+    size_t len = strcspn(user, "/ \t\n");
+    const char *home = NULL;
+    size_t home_len = 0;
+
+    if (len == 0)
+    {
+        home = lookup_variable("HOME", 4, &home_len);
+    }
+    else
+    {
+        char name[256];
+        if (len < sizeof(name))
+        {
+            memcpy(name, user, len);
+            name[len] = '\0';
+            struct passwd *pw = getpwnam(name);
+            if (pw)
+            {
+                home = pw->pw_dir;
+                home_len = strlen(home);
+            }
+        }
+    }
+
+    if (!home)
+        return 0;
+    *pos = user + len;
+    return token_put(w, home, home_len, user + len);
+}
+
+static int token_ends(char c, int quoted)
+{
+    return c == '\0' || (quoted ? c == '"' : (c == ' ' || c == '\t' || c == '\n'));
+}
+
+/**
+ * Splits a string into whitespace-separated tokens, honouring double quotes
+ *
+ * $NAME and ${NAME} are expanded everywhere, inside double quotes too, except
+ * in the arguments of mcalc (also after "limit [opts]"); ~ and ~user are expanded at the start of an
+ * unquoted token. An expanded value
+ * always stays part of its one token.
+ *
+ * @param str String to split
+ * @param arena In/out: arena the tokens are written into; allocated if NULL
+ * @param tokens_dest Output: NULL-terminated, heap-allocated token vector
+ *                    that grows with the input; the caller frees the vector
+ *                    and, with arena_free(), the arena
+ * @param globs_dest Output (may be NULL): heap-allocated flags, 1 for each
+ *                   token with an unquoted *, ? or [ typed on the line, or
+ *                   NULL when there is none; the caller frees it
+ * @return Number of tokens, or -1 on allocation failure
+ */
+int tokenize(const char *str, arena_chunk_t **arena, char ***tokens_dest, unsigned char **globs_dest)
+{
+    int count = 0, capacity = 8;
+    char **tokens = malloc((capacity + 1) * sizeof(char *));
+    unsigned char *globs = NULL; // Allocated with the first wildcard token
+    size_t len = strlen(str);
+    token_writer_t w = {arena, NULL, NULL, str + len};
+    const char *p = str;
+    int mcalc_args = 0; // After "mcalc", $NAME is a matrix reference
+    int command_at = 0; // Token naming the command, past any "limit [opts]"
+    int limited = 0;    // command_at is inside a limit call
+
+    if (!tokens)
+        return -1;
+    if (!*arena && !(*arena = arena_new(len + 1 + ARENA_SLACK)))
+    {
+        free(tokens);
+        return -1;
+    }
+    w.token = w.out = (*arena)->data + (*arena)->used;
+    if (token_reserve(&w, 0, str) == -1)
+    {
+        free(tokens);
+        return -1;
+    }
+
+    while (*p)
+    {
+        // Skip leading whitespace
+        while (*p == ' ' || *p == '\t' || *p == '\n')
+            p++;
+
+        if (!*p)
+            break;
+
+        int quoted = *p == '"';
+        int wildcard = 0;
+        int status = 0;
+        if (quoted)
+            p++; // Skip opening quote
+        else if (*p == '~')
+            status = expand_tilde(&w, &p);
+
+        // A quoted token runs to the closing quote (or the end), an unquoted one to whitespace
+        while (status == 0 && !token_ends(*p, quoted))
+        {
+            if (*p == '$' && !mcalc_args)
+                status = expand_variable(&w, &p);
+            else
+            {
+                wildcard |= !quoted && (*p == '*' || *p == '?' || *p == '[');
+                *w.out++ = *p++;
+            }
+        }
+        if (quoted && *p == '"')
+            p++; // Move past the closing quote
+
+        char *token = status == 0 ? token_finish(&w) : NULL;
+        if (token && count == capacity)
+        {
+            capacity *= 2;
+            char **grown = realloc(tokens, (capacity + 1) * sizeof(char *));
+            if (grown)
+                tokens = grown;
+            else
+                token = NULL;
+
+            unsigned char *grown_globs = globs && token ? realloc(globs, capacity) : NULL;
+            if (grown_globs)
+            {
+                memset(grown_globs + capacity / 2, 0, capacity / 2);
+                globs = grown_globs;
+            }
+            else if (globs)
+            {
+                token = NULL;
+            }
+        }
+        if (token && wildcard && globs_dest && !globs && !(globs = calloc(capacity, 1)))
+            token = NULL;
+        if (!token)
+        {
+            free(tokens);
+            free(globs);
+            return -1;
+        }
+        if (wildcard && globs)
+            globs[count] = 1;
+        if (count == command_at && !mcalc_args)
+        {
+            // Same option rule as limit_command_start(): every option takes a value
+            if (limited && token[0] == '-')
+                command_at += 2;
+            else if (strcmp(token, "limit") == 0)
+            {
+                command_at++;
+                limited = 1;
+            }
+            else if (strcmp(token, "mcalc") == 0)
+                mcalc_args = 1;
+        }
+        tokens[count++] = token;
+    }
+
+    (*arena)->used = (size_t)(w.out - (*arena)->data);
+    tokens[count] = NULL;
+    *tokens_dest = tokens;
+    if (globs_dest)
+        *globs_dest = globs;
+    return count;
+}
+
+/**
+ * @brief Release the environment index
+ */
+void expand_free(void)
+{
+    free(env_slots);
+    env_slots = NULL;
+    env_mask = 0;
+    indexed_environ = NULL;
+}
@@ -0,0 +1,556 @@
+#include "../include/shell.h"
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+/*
+ * Wildcard expansion (*, ? and [...]) of unquoted arguments. It runs after
+ * the dangerous-command check, so blacklist entries such as "rm -rf *" are
+ * matched against the line as typed. Directories are read with getdents64()
+ * and their sorted listings are kept, keyed by device, inode and mtime: a
+ * glob over a directory that has not changed neither reads nor sorts it again,
+ * and matches come out in order without sorting them.
+ */
+
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct
+{
+    uint64_t prefix;    // 8 bytes of the name, big-endian and zero-padded: the sort key
+    uint32_t name;      // Offset of the name in the listing's names
+    unsigned char type; // d_type (DT_UNKNOWN if the file system does not say)
+} glob_entry_t;
+
+typedef struct
+{
+    dev_t dev;             // Directory identity...
+    ino_t ino;
+    struct timespec mtime; // ...and the version that was listed
+    int trusted;           // Listed long enough after its last change for mtime to show the next one
+    int pinned;            // Walks iterating over the listing; it is not evicted or rescanned meanwhile
+    uint64_t last_used;    // LRU clock value, 0 for a free slot
+    char *names;           // NUL-terminated names, without "." and ".."
+    glob_entry_t *entries; // Sorted by name
+    size_t count;          // Entries
+} glob_dir_t;
+
+typedef struct
+{
+    arena_chunk_t **arena; // Line arena the matches are written into
+    char **args;           // New argument vector
+    int count;             // Arguments so far
+    int capacity;          // Slots in args, not counting the NULL terminator
+} glob_out_t;
+
+static glob_dir_t dir_cache[GLOB_CACHE_DIRS];
+static uint64_t use_clock = 0;
+
+/**
+ * @brief 8 bytes of a name as a big-endian integer, zero-padded after its end
+ */
+static uint64_t name_prefix(const char *name)
+{
+    uint64_t prefix = 0;
+    int ended = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        ended = ended || name[i] == '\0';
+        prefix = prefix << 8 | (ended ? 0 : (unsigned char)name[i]);
+    }
+    return prefix;
+}
+
+/* qsort_r() comparison; names points at the names shifted by the bytes the prefixes cover */
+static int compare_entries(const void *a, const void *b, void *names)
+{
+    const glob_entry_t *x = a, *y = b;
+    if (x->prefix != y->prefix)
+        return x->prefix < y->prefix ? -1 : 1;
+
+    // Equal prefixes holding a NUL mean equal names
+    if (!(x->prefix & 0xff))
+        return 0;
+    return strcmp((const char *)names + x->name, (const char *)names + y->name);
+}
+
+static void release_listing(glob_dir_t *dir)
+{
+    free(dir->names);
+    free(dir->entries);
+    memset(dir, 0, sizeof(*dir));
+}
+
+/**
+ * @brief Sort entries by name
+ *
+ * A least-significant-digit radix sort on the 8-byte prefixes that skips the
+ * bytes every name has in common. Names sharing their whole prefix are sorted
+ * the same way on their next 8 bytes, or compared directly when only a few
+ * are left.
+ *
+ * @param entries Entries, prefix holding bytes [offset, offset + 8) of each name
+ * @param count Number of entries
+ * @param names Names of the listing
+ * @param offset Name bytes the prefixes start at
+ * @param tmp Scratch space for count entries
+ */
+static void sort_entries(glob_entry_t *entries, size_t count, char *names, size_t offset, glob_entry_t *tmp)
+{
+    if (count <= GLOB_RADIX_MIN)
+    {
+        qsort_r(entries, count, sizeof(glob_entry_t), compare_entries, names + offset + 8);
+        return;
+    }
+
+    glob_entry_t *src = entries, *dst = tmp;
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t counts[256] = {0};
+        for (size_t i = 0; i < count; i++)
+            counts[(src[i].prefix >> shift) & 0xff]++;
+        if (counts[(src[0].prefix >> shift) & 0xff] == count)
+            continue;
+
+        size_t pos = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            size_t n = counts[b];
+            counts[b] = pos;
+            pos += n;
+        }
+        for (size_t i = 0; i < count; i++)
+            dst[counts[(src[i].prefix >> shift) & 0xff]++] = src[i];
+
+        glob_entry_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != entries)
+        memcpy(entries, src, count * sizeof(glob_entry_t));
+
+    for (size_t i = 0, j; i < count; i = j)
+    {
+        for (j = i + 1; j < count && entries[j].prefix == entries[i].prefix; j++)
+            ;
+        if (j - i == 1 || !(entries[i].prefix & 0xff))
+            continue;
+
+        for (size_t k = i; k < j; k++)
+            entries[k].prefix = name_prefix(names + entries[k].name + offset + 8);
+        sort_entries(entries + i, j - i, names, offset + 8, tmp);
+    }
+}
+
+/**
+ * @brief Read and sort a directory's entries
+ * @param fd Open directory
+ * @param dir Slot to fill (names, entries and count)
+ * @return 0 on success, -1 on error
+ */
+static int read_listing(int fd, glob_dir_t *dir)
+{
+    size_t names_size = 4096, names_len = 0, capacity = 64, count = 0;
+    char *dents = malloc(GLOB_DENTS_SIZE);
+    char *names = malloc(names_size);
+    glob_entry_t *entries = malloc(capacity * sizeof(glob_entry_t));
+    int failed = !dents || !names || !entries;
+    long n;
+
+    while (!failed && (n = syscall(SYS_getdents64, fd, dents, GLOB_DENTS_SIZE)) != 0)
+    {
+        failed = n < 0;
+        for (long pos = 0; !failed && pos < n;)
+        {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(dents + pos);
+            pos += d->d_reclen;
+            if (d->d_name[0] == '.' && (d->d_name[1] == '\0' || (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+                continue;
+
+            size_t len = strlen(d->d_name) + 1;
+            if (names_len + len > names_size)
+            {
+                names_size = 2 * names_size + len;
+                char *grown = realloc(names, names_size);
+                failed = !grown;
+                names = grown ? grown : names;
+            }
+            if (!failed && count == capacity)
+            {
+                capacity *= 2;
+                glob_entry_t *grown = realloc(entries, capacity * sizeof(glob_entry_t));
+                failed = !grown;
+                entries = grown ? grown : entries;
+            }
+            if (failed)
+                break;
+
+            memcpy(names + names_len, d->d_name, len);
+            entries[count].prefix = name_prefix(d->d_name);
+            entries[count].name = (uint32_t)names_len;
+            entries[count].type = d->d_type;
+            names_len += len;
+            count++;
+        }
+    }
+    free(dents);
+
+    if (failed)
+    {
+        free(names);
+        free(entries);
+        return -1;
+    }
+
+    glob_entry_t *tmp = malloc(count * sizeof(glob_entry_t));
+    if (tmp)
+        sort_entries(entries, count, names, 0, tmp);
+    else
+        qsort_r(entries, count, sizeof(glob_entry_t), compare_entries, names + 8);
+    free(tmp);
+
+    dir->names = names;
+    dir->entries = entries;
+    dir->count = count;
+    return 0;
+}
+
+/**
+ * @brief Sorted listing of a directory, from the cache when it is unchanged
+ * @param path Directory
+ * @return Listing, or NULL if the directory cannot be read
+ */
+static glob_dir_t *get_listing(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode))
+        return NULL;
+
+    glob_dir_t *slot = NULL, *victim = NULL;
+    for (int i = 0; i < GLOB_CACHE_DIRS && !slot; i++)
+    {
+        glob_dir_t *dir = &dir_cache[i];
+        if (dir->last_used && dir->dev == st.st_dev && dir->ino == st.st_ino)
+            slot = dir;
+        else if (!dir->pinned && (!victim || dir->last_used < victim->last_used))
+            victim = dir;
+    }
+
+    if (slot && (slot->pinned || (slot->trusted && slot->mtime.tv_sec == st.st_mtim.tv_sec &&
+                                  slot->mtime.tv_nsec == st.st_mtim.tv_nsec)))
+    {
+        slot->last_used = ++use_clock;
+        return slot;
+    }
+    if (!slot)
+        slot = victim;
+    if (!slot)
+        return NULL; // Every listing is being walked
+    release_listing(slot);
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    // The mtime is taken before reading, so a change made meanwhile is seen next time
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (fstat(fd, &st) == -1 || read_listing(fd, slot) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+
+    slot->dev = st.st_dev;
+    slot->ino = st.st_ino;
+    slot->mtime = st.st_mtim;
+    slot->trusted = (now.tv_sec - st.st_mtim.tv_sec) + (now.tv_nsec - st.st_mtim.tv_nsec) / 1e9 > GLOB_CACHE_SETTLE;
+    slot->last_used = ++use_clock;
+    return slot;
+}
+
+/**
+ * @brief Match one character against the pattern element at pat
+ * @return Position after the element if it matches, NULL otherwise
+ */
+static const char *match_element(const char *pat, const char *pat_end, char c)
+{
+    if (*pat == '?')
+        return pat + 1;
+    if (*pat != '[')
+        return *pat == c ? pat + 1 : NULL;
+
+    const char *p = pat + 1;
+    int negate = p < pat_end && (*p == '!' || *p == '^');
+    if (negate)
+        p++;
+
+    // A ']' right after the opening bracket is a member, not the end
+    int found = 0;
+    const char *first = p;
+    while (p < pat_end && (*p != ']' || p == first))
+    {
+        if (p + 2 < pat_end && p[1] == '-' && p[2] != ']')
+        {
+            found |= (unsigned char)c >= (unsigned char)p[0] && (unsigned char)c <= (unsigned char)p[2];
+            p += 3;
+        }
+        else
+        {
+            found |= *p == c;
+            p++;
+        }
+    }
+
+    // Without a closing bracket the '[' is an ordinary character
+    if (p == pat_end)
+        return c == '[' ? pat + 1 : NULL;
+    return found != negate ? p + 1 : NULL;
+}
+
+/**
+ * @brief Match a file name against one component of a pattern
+ * @param pat Pattern component (no '/')
+ * @param pat_end End of the component
+ * @param name File name
+ * @return 1 if the name matches, 0 otherwise
+ */
+static int match_component(const char *pat, const char *pat_end, const char *name)
+{
+    const char *star_pat = NULL, *star_name = NULL;
+
+    while (*name)
+    {
+        if (pat < pat_end && *pat == '*')
+        {
+            star_pat = ++pat;
+            star_name = name;
+            continue;
+        }
+
+        const char *next = pat < pat_end ? match_element(pat, pat_end, *name) : NULL;
+        if (next)
+        {
+            pat = next;
+            name++;
+        }
+        else if (star_pat)
+        {
+            // Let the last '*' swallow one more character
+            pat = star_pat;
+            name = ++star_name;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    while (pat < pat_end && *pat == '*')
+        pat++;
+    return pat == pat_end;
+}
+
+static int has_wildcard(const char *pat, const char *pat_end)
+{
+    for (; pat < pat_end; pat++)
+    {
+        if (*pat == '*' || *pat == '?' || *pat == '[')
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Append an argument to the new vector
+ * @param text Argument, copied into the arena unless it is already there
+ * @param len Length of text
+ * @param copy Whether text has to be copied
+ * @return 0 on success, -1 on allocation failure
+ */
+static int emit(glob_out_t *out, const char *text, size_t len, int copy)
+{
+    if (out->count == out->capacity)
+    {
+        char **grown = realloc(out->args, (2 * (size_t)out->capacity + 1) * sizeof(char *));
+        if (!grown)
+            return -1;
+        out->args = grown;
+        out->capacity *= 2;
+    }
+
+    char *arg = (char *)text;
+    if (copy)
+    {
+        arg = arena_alloc(out->arena, len + 1);
+        if (!arg)
+            return -1;
+        memcpy(arg, text, len);
+        arg[len] = '\0';
+    }
+    out->args[out->count++] = arg;
+    return 0;
+}
+
+/**
+ * @brief Check that a matched entry is a directory
+ * @param path Its path, NUL-terminated
+ * @param type d_type from the listing
+ */
+static int is_directory(const char *path, unsigned char type)
+{
+    struct stat st;
+    if (type == DT_DIR)
+        return 1;
+    if (type != DT_UNKNOWN && type != DT_LNK)
+        return 0;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * @brief Expand the rest of a pattern below a directory
+ * @param out Argument vector being built
+ * @param path Buffer of PATH_MAX bytes holding the directory, with a trailing '/' (empty for the current directory)
+ * @param path_len Length of the directory in path
+ * @param pattern Remaining pattern components
+ * @return 0 on success, -1 on allocation failure
+ */
+static int glob_walk(glob_out_t *out, char *path, size_t path_len, const char *pattern)
+{
+    const char *end = strchrnul(pattern, '/');
+    const char *rest = end;
+    while (*rest == '/')
+        rest++;
+    int dir_only = *end == '/'; // "dir*/" matches directories only
+    size_t comp_len = (size_t)(end - pattern);
+
+    if (!has_wildcard(pattern, end))
+    {
+        if (path_len + comp_len + 2 > PATH_MAX)
+            return 0;
+        memcpy(path + path_len, pattern, comp_len);
+        path_len += comp_len;
+        if (dir_only)
+            path[path_len++] = '/';
+        path[path_len] = '\0';
+
+        if (*rest)
+            return glob_walk(out, path, path_len, rest);
+
+        struct stat st;
+        if (dir_only ? stat(path, &st) == -1 || !S_ISDIR(st.st_mode) : lstat(path, &st) == -1)
+            return 0;
+        return emit(out, path, path_len, 1);
+    }
+
+    path[path_len] = '\0';
+    glob_dir_t *dir = get_listing(path_len ? path : ".");
+    if (!dir)
+        return 0;
+
+    // Hidden names only match a pattern that starts with a '.'
+    int status = 0;
+    dir->pinned++;
+    for (size_t i = 0; i < dir->count && status == 0; i++)
+    {
+        const char *name = dir->names + dir->entries[i].name;
+        if ((name[0] == '.' && pattern[0] != '.') || !match_component(pattern, end, name))
+            continue;
+
+        size_t len = strlen(name);
+        if (path_len + len + 2 > PATH_MAX)
+            continue;
+        memcpy(path + path_len, name, len + 1);
+
+        if (!dir_only)
+            status = emit(out, path, path_len + len, 1);
+        else if (is_directory(path, dir->entries[i].type))
+        {
+            path[path_len + len] = '/';
+            path[path_len + len + 1] = '\0';
+            status = *rest ? glob_walk(out, path, path_len + len + 1, rest) : emit(out, path, path_len + len + 1, 1);
+        }
+    }
+    dir->pinned--;
+    return status;
+}
+
+/**
+ * @brief Replace wildcard arguments by the sorted paths they match
+ *
+ * A pattern that matches nothing is passed on as written. The argument
+ * vector grows as needed; the matched paths are written into the line arena.
+ *
+ * @param pipeline Parsed line
+ * @return Number of commands that had wildcards, -1 on allocation failure
+ */
+int expand_globs(pipeline_t *pipeline)
+{
+    int expanded = 0;
+    for (int c = 0; c < pipeline->cmd_count; c++)
+    {
+        command_t *cmd = &pipeline->commands[c];
+        if (!cmd->globs)
+            continue;
+
+        glob_out_t out = {&pipeline->arena, NULL, 0, cmd->argc + 8};
+        out.args = malloc((out.capacity + 1) * sizeof(char *));
+        int status = out.args ? 0 : -1;
+
+        for (int i = 0; i < cmd->argc && status == 0; i++)
+        {
+            const char *arg = cmd->args[i];
+            int before = out.count;
+            if (cmd->globs[i])
+            {
+                char path[PATH_MAX];
+                size_t path_len = 0;
+                const char *pattern = arg;
+                if (*pattern == '/')
+                {
+                    path[path_len++] = '/';
+                    while (*pattern == '/')
+                        pattern++;
+                }
+                status = glob_walk(&out, path, path_len, pattern);
+            }
+            if (status == 0 && out.count == before)
+                status = emit(&out, arg, strlen(arg), 0);
+        }
+
+        if (status == -1)
+        {
+            perror("glob");
+            free(out.args);
+            return -1;
+        }
+
+        out.args[out.count] = NULL;
+        free(cmd->args);
+        free(cmd->globs);
+        cmd->args = out.args;
+        cmd->argc = out.count;
+        cmd->globs = NULL;
+        expanded++;
+    }
+    return expanded;
+}
+
+/**
+ * @brief Release every cached directory listing
+ */
+void glob_cache_free(void)
+{
+    for (int i = 0; i < GLOB_CACHE_DIRS; i++)
+        release_listing(&dir_cache[i]);
+    use_clock = 0;
+}
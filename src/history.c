@@ -0,0 +1,541 @@
+#include "../include/shell.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Persistent command history. Entries are appended to a plain text file,
+ * one per line, each with a single O_APPEND write(), so shells sharing the
+ * file never interleave partial entries. Reads go through a read-only
+ * mapping reserved larger than the file and an array of line offsets;
+ * entries appended by other shells are picked up by scanning only the new
+ * bytes. Reading a mapped page past the end of the file faults, so the size
+ * is checked again before entries are read; if another program truncated
+ * the file, the index is dropped and rebuilt from what is left. Filters are
+ * built from pread() copies, so a truncation only stops the builder.
+ *
+ * Searches consult a trigram filter per block of HISTORY_BLOCK_ENTRIES
+ * entries and only scan blocks where every trigram of the pattern has its
+ * bit set. A background thread builds the filters for the entries present at
+ * startup; blocks completed later are filtered inline, and blocks without a
+ * filter yet are scanned.
+ */
+
+#define FILTER_WORDS (HISTORY_FILTER_BITS / 64)
+
+static int history_fd = -1;
+static const char *map = NULL;   // Read-only view of the file
+static size_t map_size = 0;      // Reserved length of map
+static size_t map_used = 0;      // Bytes of complete entries indexed
+static uint64_t *offsets = NULL; // offsets[i]: start of entry i; offsets[count]: map_used
+static size_t count = 0;
+static size_t offsets_cap = 0;
+static uint64_t (*filters)[FILTER_WORDS] = NULL;
+static size_t filters_cap = 0;     // Blocks filters has room for
+static size_t indexed_blocks = 0;  // Blocks with a filter, published by the builder
+static pthread_t builder;
+static pid_t builder_pid = 0;      // Process the builder thread runs in; 0 if none
+static size_t builder_blocks = 0;  // Blocks the builder was started for
+static int builder_stop = 0;
+
+/**
+ * @brief Filter bit of a trigram
+ */
+static uint32_t gram_bit(unsigned char a, unsigned char b, unsigned char c)
+{
+    uint64_t key = a | (uint64_t)b << 8 | (uint64_t)c << 16;
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 40) % HISTORY_FILTER_BITS;
+}
+
+/**
+ * @brief Build the trigram filter of one block
+ *
+ * Each entry contributes the trigrams of "\n" + entry, so a prefix search
+ * can require the anchored trigram as well.
+ *
+ * @param block Block number
+ * @param buf In/out: scratch buffer the block is read into, grown as needed (caller frees)
+ * @param cap In/out: size of buf
+ * @return 0 on success, -1 if the block could not be read (the file shrank)
+ */
+static int build_filter(size_t block, char **buf, size_t *cap)
+{
+    size_t first = block * HISTORY_BLOCK_ENTRIES;
+    size_t start = offsets[first], size = offsets[first + HISTORY_BLOCK_ENTRIES] - start;
+    if (size > *cap)
+    {
+        char *grown = realloc(*buf, size);
+        if (!grown)
+            return -1;
+        *buf = grown;
+        *cap = size;
+    }
+    if (pread(history_fd, *buf, size, (off_t)start) != (ssize_t)size)
+        return -1;
+
+    uint64_t *filter = filters[block];
+    memset(filter, 0, sizeof(filters[0]));
+
+    for (size_t e = first; e < first + HISTORY_BLOCK_ENTRIES; e++)
+    {
+        const unsigned char *text = (const unsigned char *)*buf + (offsets[e] - start);
+        size_t len = offsets[e + 1] - offsets[e] - 1;
+        if (len < 2)
+            continue;
+
+        unsigned char a = '\n', b = text[0];
+        for (size_t i = 1; i < len; i++)
+        {
+            uint32_t bit = gram_bit(a, b, text[i]);
+            filter[bit / 64] |= 1ull << (bit % 64);
+            a = b;
+            b = text[i];
+        }
+    }
+    return 0;
+}
+
+static void *build_filters(void *arg)
+{
+    size_t blocks = (size_t)(uintptr_t)arg;
+    char *buf = NULL;
+    size_t cap = 0;
+
+    for (size_t b = indexed_blocks; b < blocks && !__atomic_load_n(&builder_stop, __ATOMIC_RELAXED); b++)
+    {
+        if (build_filter(b, &buf, &cap) == -1)
+            break;
+        __atomic_store_n(&indexed_blocks, b + 1, __ATOMIC_RELEASE);
+    }
+    free(buf);
+    return NULL;
+}
+
+/**
+ * @brief Wait for the builder thread; afterwards the index belongs to the caller alone
+ * @param stop Ask the builder to give up on the remaining blocks
+ */
+static void join_builder(int stop)
+{
+    // A forked copy of the shell has the builder's data but not the thread
+    if (builder_pid && builder_pid == getpid())
+    {
+        __atomic_store_n(&builder_stop, stop, __ATOMIC_RELAXED);
+        pthread_join(builder, NULL);
+    }
+    builder_pid = 0;
+    builder_stop = 0;
+}
+
+/**
+ * @brief Map (or remap) enough of the file to cover size bytes
+ * @return 0 on success, -1 on error
+ */
+static int reserve_map(size_t size)
+{
+    size_t reserve = size * 2 > HISTORY_MIN_MAP ? size * 2 : HISTORY_MIN_MAP;
+    void *view = mmap(NULL, reserve, PROT_READ, MAP_SHARED, history_fd, 0);
+    if (view == MAP_FAILED)
+    {
+        perror("history: mmap");
+        return -1;
+    }
+
+    join_builder(0);
+    if (map)
+        munmap((void *)map, map_size);
+    map = view;
+    map_size = reserve;
+    return 0;
+}
+
+/**
+ * @brief Forget every indexed entry, after the file shrank under them
+ */
+static void reset_index(void)
+{
+    join_builder(1); // It reads entries that may be gone
+    count = 0;
+    map_used = 0;
+    indexed_blocks = 0;
+}
+
+/**
+ * @brief Index the complete lines added to the file since the last call
+ *
+ * If the file is now shorter than what was indexed, it was truncated or
+ * rewritten in place, and it is indexed again from the start.
+ */
+static void load_new_entries(void)
+{
+    struct stat st;
+    if (fstat(history_fd, &st) == -1)
+        return;
+    if ((size_t)st.st_size < map_used)
+        reset_index();
+    if ((size_t)st.st_size <= map_used)
+        return;
+    if ((size_t)st.st_size > map_size && reserve_map((size_t)st.st_size) == -1)
+        return;
+
+    const char *end = map + st.st_size;
+    for (const char *p = map + map_used; p < end;)
+    {
+        const char *newline = memchr(p, '\n', (size_t)(end - p));
+        if (!newline)
+            break; // Another shell is still writing it
+
+        if (count + 2 > offsets_cap)
+        {
+            join_builder(0); // It reads offsets
+
+            size_t cap = offsets_cap ? offsets_cap * 2 : 4096;
+            uint64_t *grown = realloc(offsets, cap * sizeof(*offsets));
+            if (!grown)
+            {
+                perror("history");
+                return;
+            }
+            grown[0] = 0;
+            offsets = grown;
+            offsets_cap = cap;
+        }
+
+        offsets[++count] = (uint64_t)(newline + 1 - map);
+        map_used = (size_t)(newline + 1 - map);
+        p = newline + 1;
+    }
+}
+
+/**
+ * @brief Filter every complete block that has no filter yet
+ */
+static void index_new_blocks(void)
+{
+    size_t blocks = count / HISTORY_BLOCK_ENTRIES;
+    if (blocks > filters_cap)
+    {
+        size_t cap = filters_cap ? filters_cap : 64;
+        while (cap < blocks)
+            cap *= 2;
+
+        void *grown = realloc(filters, cap * sizeof(filters[0]));
+        if (!grown)
+            return; // Unfiltered blocks are scanned
+        filters = grown;
+        filters_cap = cap;
+    }
+
+    char *buf = NULL;
+    size_t cap = 0;
+    for (size_t b = indexed_blocks; b < blocks && build_filter(b, &buf, &cap) == 0; b++)
+    {
+        indexed_blocks = b + 1;
+    }
+    free(buf);
+}
+
+/**
+ * @brief Open the history file and start indexing it
+ *
+ * With path NULL the file is $SECURESHELL_HISTORY, or HISTORY_FILE in $HOME;
+ * an empty path disables history.
+ *
+ * @param path History file, NULL for the default
+ * @return 0 on success or when disabled, -1 on error
+ */
+int history_open(const char *path)
+{
+    char default_path[4096];
+    if (!path)
+        path = getenv("SECURESHELL_HISTORY");
+    if (!path && getenv("HOME"))
+    {
+        snprintf(default_path, sizeof(default_path), "%s/%s", getenv("HOME"), HISTORY_FILE);
+        path = default_path;
+    }
+    if (!path || !*path)
+        return 0;
+
+    history_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (history_fd == -1)
+    {
+        perror(path);
+        return -1;
+    }
+    if (reserve_map(0) == -1)
+    {
+        history_close();
+        return -1;
+    }
+    load_new_entries();
+
+    // The filters for what is already on disk are built off the prompt path
+    size_t blocks = count / HISTORY_BLOCK_ENTRIES;
+    filters_cap = blocks > 64 ? blocks * 2 : 64;
+    filters = malloc(filters_cap * sizeof(filters[0]));
+    if (!filters)
+        filters_cap = 0;
+    else if (blocks > 0 && pthread_create(&builder, NULL, build_filters, (void *)(uintptr_t)blocks) == 0)
+    {
+        builder_pid = getpid();
+        builder_blocks = blocks;
+    }
+    return 0;
+}
+
+/**
+ * @brief Stop indexing and release the history
+ */
+void history_close(void)
+{
+    join_builder(1);
+    if (map)
+        munmap((void *)map, map_size);
+    if (history_fd != -1)
+        close(history_fd);
+
+    free(offsets);
+    free(filters);
+    history_fd = -1;
+    map = NULL;
+    map_size = map_used = 0;
+    offsets = NULL;
+    count = offsets_cap = 0;
+    filters = NULL;
+    filters_cap = indexed_blocks = 0;
+}
+
+/**
+ * @brief Pick up entries appended since the last call, by this or any other shell
+ * @return Number of entries
+ */
+size_t history_refresh(void)
+{
+    if (history_fd == -1)
+        return 0;
+
+    load_new_entries();
+    if (builder_pid && (builder_pid != getpid() || __atomic_load_n(&indexed_blocks, __ATOMIC_ACQUIRE) == builder_blocks))
+        join_builder(0);
+    if (!builder_pid)
+        index_new_blocks();
+    return count;
+}
+
+/**
+ * @brief Number of entries covered by search filters
+ */
+size_t history_indexed(void)
+{
+    return __atomic_load_n(&indexed_blocks, __ATOMIC_ACQUIRE) * HISTORY_BLOCK_ENTRIES;
+}
+
+/**
+ * @brief Append a line to the history file
+ * @param line Line as executed
+ * @return 0 on success, -1 on error
+ */
+int history_add(const char *line)
+{
+    if (history_fd == -1 || !*line)
+        return 0;
+
+    // One write() per entry: O_APPEND keeps concurrent shells' entries whole
+    size_t len = strlen(line);
+    char stack_buf[BUFFER_SIZE];
+    char *entry = len < sizeof(stack_buf) ? stack_buf : malloc(len + 1);
+    if (!entry)
+    {
+        perror("history");
+        return -1;
+    }
+    memcpy(entry, line, len);
+    entry[len] = '\n';
+
+    ssize_t written = write(history_fd, entry, len + 1);
+    if (written != (ssize_t)(len + 1))
+        perror("history");
+    if (entry != stack_buf)
+        free(entry);
+    return written == (ssize_t)(len + 1) ? 0 : -1;
+}
+
+/**
+ * @brief Make sure every indexed entry is still inside the file
+ *
+ * Cheaper than history_refresh(): only when the file shrank is anything
+ * re-read, and then entry numbers may change.
+ */
+static void check_truncated(void)
+{
+    struct stat st;
+    if (history_fd != -1 && map_used > 0 && fstat(history_fd, &st) == 0 && (size_t)st.st_size < map_used)
+        load_new_entries();
+}
+
+/**
+ * @brief Text of an indexed entry, without checking the file size
+ */
+static const char *entry_text(size_t n, size_t *len)
+{
+    if (n < 1 || n > count)
+        return NULL;
+
+    *len = offsets[n] - offsets[n - 1] - 1;
+    return map + offsets[n - 1];
+}
+
+/**
+ * @brief Look up an entry
+ * @param n Entry number, from 1
+ * @param len Output: length of the entry
+ * @return Entry text (not terminated), NULL if there is no such entry
+ */
+const char *history_get(size_t n, size_t *len)
+{
+    check_truncated();
+    return entry_text(n, len);
+}
+
+/**
+ * @brief Compile a search
+ * @param query Output: compiled search
+ * @param text Pattern (kept by reference)
+ * @param len Length of text
+ * @param prefix Match at the start of entries only
+ */
+void history_query_init(history_query_t *query, const char *text, size_t len, int prefix)
+{
+    query->text = text;
+    query->len = len;
+    query->prefix = prefix;
+    query->gram_count = 0;
+
+    // Substrings contribute their own trigrams, prefixes those of "\n" + prefix
+    const unsigned char *p = (const unsigned char *)text;
+    for (size_t i = prefix ? 1 : 2; i < len && query->gram_count < HISTORY_QUERY_GRAMS; i++)
+    {
+        unsigned char a = prefix && i == 1 ? '\n' : p[i - 2];
+        query->grams[query->gram_count++] = gram_bit(a, p[i - 1], p[i]);
+    }
+}
+
+static int block_may_match(const history_query_t *query, size_t block)
+{
+    for (int i = 0; i < query->gram_count; i++)
+    {
+        uint32_t bit = query->grams[i];
+        if (!(filters[block][bit / 64] & (1ull << (bit % 64))))
+            return 0;
+    }
+    return 1;
+}
+
+static int entry_matches(const history_query_t *query, size_t n)
+{
+    size_t len;
+    const char *text = entry_text(n, &len);
+
+    if (query->prefix)
+        return len >= query->len && memcmp(text, query->text, query->len) == 0;
+    return memmem(text, len, query->text, query->len) != NULL;
+}
+
+/**
+ * @brief Find the nearest matching entry
+ * @param query Compiled search
+ * @param from First entry number to look at
+ * @param direction 1 to search towards newer entries, -1 towards older ones
+ * @return Matching entry number, 0 if none
+ */
+size_t history_find(const history_query_t *query, size_t from, int direction)
+{
+    check_truncated();
+    size_t ready = __atomic_load_n(&indexed_blocks, __ATOMIC_ACQUIRE);
+
+    for (size_t n = from; n >= 1 && n <= count;)
+    {
+        size_t block = (n - 1) / HISTORY_BLOCK_ENTRIES;
+        if (block < ready && !block_may_match(query, block))
+        {
+            // Skip the rest of the block
+            n = direction > 0 ? (block + 1) * HISTORY_BLOCK_ENTRIES + 1 : block * HISTORY_BLOCK_ENTRIES;
+            continue;
+        }
+
+        if (entry_matches(query, n))
+            return n;
+        n += direction;
+    }
+    return 0;
+}
+
+/**
+ * @brief Expand a history event at the start of a line
+ *
+ * Supports !! (last entry), !n, !-n, !prefix and !?text[?]; the rest of the
+ * line is appended to the entry.
+ *
+ * @param line Line as typed
+ * @param expanded Output: expanded line (caller frees), NULL if not an event
+ * @return 1 if expanded, 0 if the line is not an event, -1 if the event was not found
+ */
+int history_expand(const char *line, char **expanded)
+{
+    *expanded = NULL;
+    if (history_fd == -1 || line[0] != '!' || line[1] == '\0' || isspace((unsigned char)line[1]) || line[1] == '=')
+        return 0;
+
+    size_t total = history_refresh(), n = 0;
+    const char *designator = line + 1;
+    size_t len = strcspn(designator, " \t");
+    history_query_t query;
+
+    if (designator[0] == '!')
+    {
+        n = total;
+        len = 1;
+    }
+    else if (designator[0] == '?')
+    {
+        size_t text_len = strcspn(designator + 1, "?");
+        history_query_init(&query, designator + 1, text_len, 0);
+        n = history_find(&query, total, -1);
+        len = 1 + text_len + (designator[1 + text_len] == '?');
+    }
+    else if (isdigit((unsigned char)designator[0]) || (designator[0] == '-' && isdigit((unsigned char)designator[1])))
+    {
+        char *end;
+        long value = strtol(designator, &end, 10);
+        len = (size_t)(end - designator);
+        if (value > 0)
+            n = (size_t)value;
+        else if (value < 0 && (size_t)-value <= total)
+            n = total + 1 - (size_t)-value;
+    }
+    else
+    {
+        history_query_init(&query, designator, len, 1);
+        n = history_find(&query, total, -1);
+    }
+
+    size_t entry_len;
+    const char *entry = history_get(n, &entry_len);
+    if (!entry)
+    {
+        fprintf(stderr, "!%.*s: event not found\n", (int)len, designator);
+        return -1;
+    }
+
+    const char *rest = designator + len;
+    size_t rest_len = strlen(rest);
+    *expanded = malloc(entry_len + rest_len + 1);
+    if (!*expanded)
+    {
+        perror("history");
+        return -1;
+    }
+    memcpy(*expanded, entry, entry_len);
+    memcpy(*expanded + entry_len, rest, rest_len + 1);
+    return 1;
+}
@@ -0,0 +1,440 @@
+#include "../include/shell.h"
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <poll.h>
+
+/*
+ * Pre-forked launcher. fork() cost grows with the caller's address space,
+ * so with -L the shell forks a helper at startup, while it is still small,
+ * and asks it to start external commands. Requests travel over a
+ * SOCK_SEQPACKET socketpair with the command's stdin/stdout/stderr and the
+ * shell's current directory (an O_PATH descriptor) attached via SCM_RIGHTS,
+ * and the shell's environment packed after argv, so commands see the shell
+ * as it is now rather than as it was at startup. The helper replies with the
+ * pid, and later with the exit status once it has reaped the process.
+ */
+
+static int launcher_fd = -1;
+static pid_t launcher_pid = 0;
+static pid_t launcher_owner = 0; // Forked copies of the shell must not share the socket
+
+/* Exit records received while waiting for a different process */
+static launcher_record_t *pending = NULL;
+static int pending_count = 0;
+static int pending_cap = 0;
+
+/**
+ * @brief Send a record from the helper to the shell.
+ */
+static void send_record(int sock, int type, pid_t pid, int status)
+{
+    launcher_record_t record = {.type = type, .pid = pid, .status = status};
+    while (send(sock, &record, sizeof(record), MSG_NOSIGNAL) == -1 && errno == EINTR)
+    {
+    }
+}
+
+/**
+ * @brief Receive one request with its descriptors.
+ * @param sock Launcher socket
+ * @param buf Buffer for the request (LAUNCHER_MAX_REQUEST bytes)
+ * @param fds Output: stdin, stdout, stderr and working directory for the command
+ * @return Message length, 0 when the shell has gone away, -1 on error
+ */
+static ssize_t receive_request(int sock, char *buf, int fds[LAUNCHER_FDS])
+{
+    union
+    {
+        char buf[CMSG_SPACE(LAUNCHER_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {.iov_base = buf, .iov_len = LAUNCHER_MAX_REQUEST};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf,
+                         .msg_controllen = sizeof(control.buf)};
+
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0)
+        return n;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(LAUNCHER_FDS * sizeof(int)))
+    {
+        errno = EPROTO;
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), LAUNCHER_FDS * sizeof(int));
+    return n;
+}
+
+/**
+ * @brief Start one requested command from the helper.
+ */
+static void launch_command(int sock, char *buf, ssize_t len, int fds[LAUNCHER_FDS], pid_t **detached,
+                           int *detached_count)
+{
+    launcher_request_t *req = (launcher_request_t *)buf;
+    char **argv = NULL;
+
+    // Every string takes at least its NUL, which bounds both counts
+    if ((size_t)len < sizeof(*req) || sizeof(*req) + req->args_len != (size_t)len || req->argc < 1 ||
+        req->envc < 0 || (size_t)req->argc + (size_t)req->envc > req->args_len ||
+        !(argv = calloc((size_t)req->argc + (size_t)req->envc + 2, sizeof(char *))))
+    {
+        send_record(sock, LAUNCHER_SPAWNED, -EINVAL, 0);
+        return;
+    }
+
+    char **envp = argv + req->argc + 1;
+    char *arg = buf + sizeof(*req), *end = buf + len;
+    buf[len - 1] = '\0';
+    for (int i = 0; i < req->argc + req->envc && arg < end; i++)
+    {
+        if (i < req->argc)
+            argv[i] = arg;
+        else
+            envp[i - req->argc] = arg;
+        arg += strlen(arg) + 1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+
+        dup2(fds[0], STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[2], STDERR_FILENO);
+        if (fchdir(fds[3]) == -1)
+        {
+            perror("launcher: fchdir");
+            _exit(126);
+        }
+        execvpe(argv[0], argv, envp);
+        perror("execvp");
+        _exit(127);
+    }
+
+    free(argv);
+    send_record(sock, LAUNCHER_SPAWNED, pid < 0 ? -errno : pid, 0);
+
+    if (pid > 0 && req->detached)
+    {
+        pid_t *grown = realloc(*detached, (*detached_count + 1) * sizeof(pid_t));
+        if (grown)
+        {
+            *detached = grown;
+            (*detached)[(*detached_count)++] = pid;
+        }
+    }
+}
+
+/**
+ * @brief Helper main loop: serve spawn requests and report exits until the shell closes the socket.
+ */
+static void launcher_main(int sock)
+{
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+    int sig_fd = signalfd(-1, &chld, SFD_CLOEXEC);
+
+    // Ctrl-C is meant for the command in the foreground, not for the helper
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+
+    char *buf = malloc(LAUNCHER_MAX_REQUEST);
+    pid_t *detached = NULL;
+    int detached_count = 0;
+
+    struct pollfd fds[2] = {{.fd = sock, .events = POLLIN}, {.fd = sig_fd, .events = POLLIN}};
+    while (buf && sig_fd >= 0)
+    {
+        if (poll(fds, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents)
+        {
+            struct signalfd_siginfo info;
+            if (read(sig_fd, &info, sizeof(info)) == -1 && errno != EAGAIN)
+                break;
+
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            {
+                int reported = 1;
+                for (int i = 0; i < detached_count; i++)
+                {
+                    if (detached[i] == pid)
+                    {
+                        detached[i] = detached[--detached_count];
+                        reported = 0;
+                        break;
+                    }
+                }
+                if (reported)
+                    send_record(sock, LAUNCHER_EXITED, pid, status);
+            }
+        }
+
+        if (fds[0].revents)
+        {
+            int cmd_fds[LAUNCHER_FDS];
+            ssize_t n = receive_request(sock, buf, cmd_fds);
+            if (n == 0 || (n < 0 && errno != EINTR && errno != EPROTO))
+                break; // shell exited
+
+            if (n > 0)
+            {
+                launch_command(sock, buf, n, cmd_fds, &detached, &detached_count);
+                for (int i = 0; i < LAUNCHER_FDS; i++)
+                    close(cmd_fds[i]);
+            }
+        }
+    }
+
+    _exit(0);
+}
+
+/**
+ * @brief Fork the launcher helper. Call early, while the shell is small.
+ * @return 0 on success, -1 if the shell should keep forking itself
+ */
+int launcher_start(void)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+    {
+        perror("socketpair");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        close(sv[0]);
+        launcher_main(sv[1]);
+    }
+
+    close(sv[1]);
+    launcher_fd = sv[0];
+    launcher_pid = pid;
+    launcher_owner = getpid();
+    return 0;
+}
+
+/**
+ * @brief Check whether spawns go through the launcher.
+ * @return 1 if the launcher is running, 0 otherwise
+ */
+int launcher_active(void)
+{
+    return launcher_fd >= 0 && getpid() == launcher_owner;
+}
+
+/**
+ * @brief Read the next record from the helper.
+ * @return 0 on success, -1 if the helper is gone
+ */
+static int read_record(launcher_record_t *record)
+{
+    ssize_t n;
+    do
+    {
+        n = recv(launcher_fd, record, sizeof(*record), 0);
+    } while (n == -1 && errno == EINTR);
+
+    if (n != (ssize_t)sizeof(*record))
+    {
+        fprintf(stderr, "launcher: helper exited, falling back to fork()\n");
+        launcher_stop();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Keep an exit record until someone waits for its process.
+ */
+static void stash_record(const launcher_record_t *record)
+{
+    if (pending_count == pending_cap)
+    {
+        int cap = pending_cap ? pending_cap * 2 : 8;
+        launcher_record_t *grown = realloc(pending, cap * sizeof(*grown));
+        if (!grown)
+            return;
+        pending = grown;
+        pending_cap = cap;
+    }
+    pending[pending_count++] = *record;
+}
+
+/**
+ * @brief Start a command through the launcher.
+ *
+ * The command runs in the shell's current directory with the shell's
+ * current environment.
+ *
+ * @param argv NULL-terminated argument vector
+ * @param in_fd Descriptor for the command's stdin
+ * @param out_fd Descriptor for the command's stdout
+ * @param err_fd Descriptor for the command's stderr
+ * @param detached Background command whose exit is not waited for
+ * @return Process id, or -1 on error (errno set; EMSGSIZE if argv and the environment are too long for a request)
+ */
+pid_t launcher_spawn(char *const argv[], int in_fd, int out_fd, int err_fd, int detached)
+{
+    if (!launcher_active())
+    {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    launcher_request_t req = {.argc = 0, .envc = 0, .detached = detached, .args_len = 0};
+    for (; argv[req.argc]; req.argc++)
+        req.args_len += strlen(argv[req.argc]) + 1;
+    for (; environ && environ[req.envc]; req.envc++)
+        req.args_len += strlen(environ[req.envc]) + 1;
+
+    if (sizeof(req) + req.args_len > LAUNCHER_MAX_REQUEST)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    char *msg = malloc(sizeof(req) + req.args_len);
+    if (!msg)
+        return -1;
+    memcpy(msg, &req, sizeof(req));
+    char *pos = msg + sizeof(req);
+    for (int i = 0; i < req.argc + req.envc; i++)
+    {
+        const char *str = i < req.argc ? argv[i] : environ[i - req.argc];
+        size_t len = strlen(str) + 1;
+        memcpy(pos, str, len);
+        pos += len;
+    }
+
+    int cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd_fd == -1)
+    {
+        free(msg);
+        return -1;
+    }
+
+    int fds[LAUNCHER_FDS] = {in_fd, out_fd, err_fd, cwd_fd};
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = {.iov_base = msg, .iov_len = sizeof(req) + req.args_len};
+    struct msghdr hdr = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf,
+                         .msg_controllen = sizeof(control.buf)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent;
+    do
+    {
+        sent = sendmsg(launcher_fd, &hdr, MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    free(msg);
+    close(cwd_fd);
+
+    if (sent == -1)
+    {
+        launcher_stop();
+        return -1;
+    }
+
+    // Exit records of earlier commands may arrive before our reply
+    launcher_record_t record;
+    while (read_record(&record) == 0)
+    {
+        if (record.type == LAUNCHER_SPAWNED)
+        {
+            if (record.pid < 0)
+            {
+                errno = -record.pid;
+                return -1;
+            }
+            return record.pid;
+        }
+        stash_record(&record);
+    }
+    return -1;
+}
+
+/**
+ * @brief Wait for a process started with launcher_spawn().
+ * @param pid Process id returned by launcher_spawn()
+ * @param status Output: waitpid()-style status
+ * @return pid on success, -1 if the helper is gone
+ */
+pid_t launcher_wait(pid_t pid, int *status)
+{
+    for (int i = 0; i < pending_count; i++)
+    {
+        if (pending[i].pid == pid)
+        {
+            *status = pending[i].status;
+            pending[i] = pending[--pending_count];
+            return pid;
+        }
+    }
+
+    launcher_record_t record;
+    while (read_record(&record) == 0)
+    {
+        if (record.type != LAUNCHER_EXITED)
+            continue;
+        if (record.pid == pid)
+        {
+            *status = record.status;
+            return pid;
+        }
+        stash_record(&record);
+    }
+    return -1;
+}
+
+/**
+ * @brief Shut the helper down (it exits when its socket closes).
+ */
+void launcher_stop(void)
+{
+    if (!launcher_active())
+        return;
+
+    close(launcher_fd);
+    launcher_fd = -1;
+    waitpid(launcher_pid, NULL, 0);
+    launcher_pid = 0;
+
+    free(pending);
+    pending = NULL;
+    pending_count = pending_cap = 0;
+}
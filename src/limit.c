@@ -0,0 +1,177 @@
+#include "../include/shell.h"
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+
+char limit_last_reason[64] = ""; // Limit exceeded by the most recent limited command
+
+/**
+ * @brief Arm a one-shot timerfd.
+ * @param fd timerfd
+ * @param seconds Delay in seconds
+ */
+static void arm_timer(int fd, double seconds)
+{
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = (time_t)seconds;
+    spec.it_value.tv_nsec = (long)((seconds - (double)spec.it_value.tv_sec) * 1e9);
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+        spec.it_value.tv_nsec = 1; // a zero value would disarm the timer
+    timerfd_settime(fd, 0, &spec, NULL);
+}
+
+/**
+ * @brief Child side: apply the limits and run the command.
+ */
+static void exec_limited(command_t *cmd, const limit_spec_t *spec)
+{
+    if (spec->memory > 0)
+    {
+        struct rlimit rl = {(rlim_t)spec->memory, (rlim_t)spec->memory};
+        if (setrlimit(RLIMIT_AS, &rl) == -1)
+            perror("limit: RLIMIT_AS");
+    }
+    if (spec->cpu_seconds > 0)
+    {
+        // SIGXCPU at the soft limit, SIGKILL one second later
+        rlim_t cpu = (rlim_t)(spec->cpu_seconds + 0.999);
+        struct rlimit rl = {cpu, cpu + 1};
+        if (setrlimit(RLIMIT_CPU, &rl) == -1)
+            perror("limit: RLIMIT_CPU");
+    }
+
+    // Redirections were applied around the limit builtin and are inherited here
+    if (is_builtin(cmd->args[0]))
+    {
+        int status = execute_builtin(cmd);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    execvp(cmd->args[0], cmd->args);
+    perror("execvp");
+    _exit(127);
+}
+
+/**
+ * @brief Wait for a limited child, enforcing the wall-clock timeout.
+ *
+ * The child is watched through a pidfd and the deadline through a timerfd
+ * in one poll(). At the deadline the child gets SIGTERM, and SIGKILL if it
+ * is still alive LIMIT_KILL_GRACE seconds later.
+ *
+ * @param pid Child process
+ * @param timeout Wall-clock limit in seconds, 0 for none
+ * @param timed_out Output: set when the deadline passed
+ * @return waitpid() status
+ */
+static int wait_limited(pid_t pid, double timeout, int *timed_out)
+{
+    int status = 0;
+    int pidfd = open_pidfd(pid);
+    int timer_fd = (timeout > 0) ? timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC) : -1;
+    int signals_sent = 0;
+
+    *timed_out = 0;
+    if (timer_fd >= 0)
+        arm_timer(timer_fd, timeout);
+
+    while (1)
+    {
+        pid_t done = waitpid(pid, &status, WNOHANG);
+        if (done == pid || (done == -1 && errno != EINTR))
+            break;
+
+        struct pollfd fds[2] = {{.fd = pidfd, .events = POLLIN}, {.fd = timer_fd, .events = POLLIN}};
+        int ready = poll(fds, 2, (pidfd >= 0) ? -1 : 10); // without a pidfd, re-check every 10 ms
+        if (ready <= 0)
+            continue;
+
+        if (timer_fd >= 0 && (fds[1].revents & POLLIN))
+        {
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) == -1)
+                continue;
+
+            *timed_out = 1;
+            if (signals_sent++ == 0)
+            {
+                kill(pid, SIGTERM);
+                arm_timer(timer_fd, LIMIT_KILL_GRACE);
+            }
+            else
+            {
+                kill(pid, SIGKILL);
+            }
+        }
+    }
+
+    if (pidfd >= 0)
+        close(pidfd);
+    if (timer_fd >= 0)
+        close(timer_fd);
+    return status;
+}
+
+/**
+ * @brief Run a command under resource limits.
+ *
+ * RLIMIT_AS and RLIMIT_CPU are set in the child before it runs the command
+ * (external or builtin). Violations are counted in the statistics and
+ * recorded in the audit log.
+ *
+ * @param cmd Command to run (args/argc describe the limited command)
+ * @param spec Limits to apply
+ * @param line Command line for the audit log
+ * @return Exit status of the command; LIMIT_TIMEOUT_STATUS on timeout, 128+signal if killed
+ */
+int run_limited(command_t *cmd, const limit_spec_t *spec, const char *line)
+{
+    // The wait loop reaps the child itself, not the SIGCHLD handler
+    sigset_t block, saved;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &saved);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        sigprocmask(SIG_SETMASK, &saved, NULL);
+        exec_limited(cmd, spec);
+    }
+    else if (pid < 0)
+    {
+        perror("fork");
+        sigprocmask(SIG_SETMASK, &saved, NULL);
+        return 1;
+    }
+
+    int timed_out;
+    int status = wait_limited(pid, spec->timeout, &timed_out);
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+
+    // Work out which limit, if any, stopped the command
+    char reason[64] = "";
+    int sig = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    if (timed_out)
+        snprintf(reason, sizeof(reason), "timeout %gs", spec->timeout);
+    else if (spec->cpu_seconds > 0 && (sig == SIGXCPU || sig == SIGKILL))
+        snprintf(reason, sizeof(reason), "cpu %gs", spec->cpu_seconds);
+    else if (spec->memory > 0 && (sig == SIGSEGV || sig == SIGBUS || sig == SIGABRT || sig == SIGKILL))
+        snprintf(reason, sizeof(reason), "memory %lld bytes", spec->memory);
+
+    if (reason[0])
+    {
+        fprintf(stderr, "limit: %s: %s exceeded\n", cmd->args[0], reason);
+        stats.limit_violations++;
+        log_limit_violation(log_file, line, reason);
+        memcpy(limit_last_reason, reason, sizeof(reason));
+    }
+
+    if (timed_out)
+        return LIMIT_TIMEOUT_STATUS;
+    if (sig)
+        return 128 + sig;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
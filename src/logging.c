@@ -1,10 +1,69 @@
 #include "../include/shell.h"
+#include <stdarg.h>
+
+/**
+ * @brief Format one record and append it to the audit log
+ *
+ * Records go through io_uring when it is active for the file, whatever
+ * their size, so stdio never writes between queued records; stdio is used
+ * only when the engine is off.
+ *
+ * @param file Log file
+ * @param format printf-style format of the record
+ */
+static void write_log_record(FILE *file, const char *format, ...)
+{
+    char stack_record[URING_LOG_SLOT_SIZE];
+    char *record = stack_record;
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(stack_record, sizeof(stack_record), format, args);
+    va_end(args);
+    if (len < 0)
+        return;
+
+    if ((size_t)len >= sizeof(stack_record))
+    {
+        record = malloc((size_t)len + 1);
+        if (!record)
+        {
+            perror("malloc");
+            return;
+        }
+        va_start(args, format);
+        vsnprintf(record, (size_t)len + 1, format, args);
+        va_end(args);
+    }
+
+    if (!use_io_uring || uring_log_write(fileno(file), record, (size_t)len) == -1)
+    {
+        fwrite(record, 1, (size_t)len, file);
+        fflush(file);
+    }
+
+    if (record != stack_record)
+        free(record);
+}
 
 void log_command_execution(FILE *file, const char *command_str, double elapsed_time)
 {
     if (!file)
         return;
 
-    fprintf(file, "%s : %.5f sec\n", command_str, elapsed_time);
-    fflush(file);
+    write_log_record(file, "%s : %.5f sec\n", command_str, elapsed_time);
+}
+
+/**
+ * @brief Record a command stopped by the limit builtin
+ * @param file Log file
+ * @param command_str Command line
+ * @param reason Which limit was exceeded, e.g. "timeout 5s"
+ */
+void log_limit_violation(FILE *file, const char *command_str, const char *reason)
+{
+    if (!file)
+        return;
+
+    write_log_record(file, "%s : LIMIT EXCEEDED (%s)\n", command_str, reason);
 }
@@ -1,4 +1,5 @@
 #include "../include/shell.h"
+#include <getopt.h>
 
 FILE *log_file = NULL; // Global variable
 
@@ -19,24 +20,45 @@ void setup_shell(void)
  */
 void shell_loop(void)
 {
+    char *buffer = NULL; // Reused across iterations, grows with the longest line
+    size_t capacity = 0;
+
     while (1)
     {
-        char line[MAX_CMD_LEN];
-
         display_prompt(&stats);
 
-        if (!read_line(line, sizeof(line), stdin))
+        char *line = read_line(&buffer, &capacity, stdin);
+        if (!line)
         {
             break; // EOF
         }
 
-        if (strlen(line) == 0)
+        if (*line == '\0')
         {
             continue;
         }
 
+        // History events run the entry they name, echoed first
+        char *expanded = NULL;
+        int event = history_expand(line, &expanded);
+        if (event == -1)
+        {
+            continue;
+        }
+        if (event == 1)
+        {
+            printf("%s\n", expanded);
+            line = expanded;
+        }
+
+        history_add(line);
         execute_line(line);
+        metrics_publish(&stats);
+        stats_shm_sync(&stats);
+        free(expanded);
     }
+
+    free(buffer);
 }
 
 /**
@@ -46,8 +68,29 @@ void cleanup_shell(void)
 {
     // Print on exit
     printf("%d\n", stats.blocked_cmd_count + stats.unblocked_dangerous_cmds_count);
+    if (batch_mode)
+    {
+        fflush(stdout);
+        print_stats_summary(stderr, &stats);
+    }
+
+    // The metrics thread reads the blacklist, so it goes first
+    metrics_stop();
+    stats_shm_sync(&stats);
+    stats_shm_detach();
+
+    // Release session-resident matrices
+    matrix_store_clear();
+    prompt_free();
+    history_close();
+    expand_free();
+    glob_cache_free();
+    builtin_cache_free();
+    launcher_stop();
+    free_dangerous_commands();
 
     // Close log file if open
+    uring_log_close();
     if (log_file && log_file != stdout && log_file != stderr)
     {
         fclose(log_file);
@@ -55,6 +98,19 @@ void cleanup_shell(void)
     }
 }
 
+/**
+ * @brief Print command line usage
+ * @param prog Program name
+ */
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-u] [-L] [-f script] [-j jobs] [--serve socket]\n"
+                    "       [--metrics-socket path] [--metrics-file path] [--stats-shm[=name]]\n"
+                    "       [--prompt template] [--history path] [--builtin-cache size] [--preallocate size]\n"
+                    "       [dangerous_commands_file] [log_file]\n",
+            prog);
+}
+
 /**
  * @brief Main function - entry point
  * @param argc Argument count
@@ -63,31 +119,148 @@ void cleanup_shell(void)
  */
 int main(int argc, char *argv[])
 {
-    if (argc > 3)
+    static const struct option long_options[] = {
+        {"serve", required_argument, NULL, 's'},
+        {"metrics-socket", required_argument, NULL, 'm'},
+        {"metrics-file", required_argument, NULL, 'M'},
+        {"stats-shm", optional_argument, NULL, 'S'},
+        {"prompt", required_argument, NULL, 'P'},
+        {"history", required_argument, NULL, 'H'},
+        {"builtin-cache", required_argument, NULL, 'C'},
+        {"preallocate", required_argument, NULL, 'A'},
+        {NULL, 0, NULL, 0}};
+    const char *script = NULL, *serve_path = NULL, *metrics_socket = NULL, *metrics_file = NULL;
+    const char *stats_shm = NULL, *history_path = NULL;
+    int opt, use_launcher = 0;
+    while ((opt = getopt_long(argc, argv, "uLf:j:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'u':
+            use_io_uring = 1;
+            break;
+        case 'L':
+            use_launcher = 1;
+            break;
+        case 'f':
+            script = optarg;
+            break;
+        case 's':
+            serve_path = optarg;
+            break;
+        case 'm':
+            metrics_socket = optarg;
+            break;
+        case 'M':
+            metrics_file = optarg;
+            break;
+        case 'S':
+            stats_shm = optarg ? optarg : STATS_SHM_NAME;
+            break;
+        case 'C':
+            if (parse_size(optarg) <= 0 || builtin_cache_init(parse_size(optarg)) == -1)
+            {
+                fprintf(stderr, "%s: --builtin-cache needs a positive size\n", argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'A':
+            redirect_preallocate = parse_size(optarg);
+            if (redirect_preallocate <= 0)
+            {
+                fprintf(stderr, "%s: --preallocate needs a positive size\n", argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'H':
+            history_path = optarg;
+            break;
+        case 'P':
+            if (prompt_compile(optarg) == -1)
+                return EXIT_FAILURE;
+            break;
+        case 'j':
+            batch_jobs = atoi(optarg);
+            if (batch_jobs < 1)
+            {
+                fprintf(stderr, "%s: -j needs a positive job count\n", argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int positional = argc - optind;
+    if (positional > 2)
     {
-        fprintf(stderr, "Usage: %s [dangerous_commands_file] [log_file]\n", argv[0]);
+        print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    // Fork the launcher first, while the shell is as small as it gets
+    if (use_launcher)
+    {
+        launcher_start();
+    }
+
+    // Batch mode: no prompt when running a script or reading a pipe/file
+    int script_fd = STDIN_FILENO;
+    if (script)
+    {
+        script_fd = open(script, O_RDONLY | O_CLOEXEC);
+        if (script_fd == -1)
+        {
+            perror(script);
+            return EXIT_FAILURE;
+        }
+    }
+    batch_mode = !serve_path && (script || !isatty(STDIN_FILENO));
+
     // Load dangerous commands if dangerous_commands_file is provided
-    if (argc > 1)
+    if (positional > 0)
     {
-        load_dangerous_commands(argv[1]);
+        load_dangerous_commands(argv[optind]);
     }
 
     // Open log file if provided
-    if (argc > 2)
+    if (positional > 1)
     {
-        log_file = fopen(argv[2], "a");
+        log_file = fopen(argv[optind + 1], "a");
         if (!log_file)
         {
             perror("fopen (log file)");
         }
+        else if (use_io_uring)
+        {
+            uring_log_open(fileno(log_file)); // stays on stdio if io_uring is unavailable
+        }
     }
 
+    int status = EXIT_SUCCESS;
     setup_shell();
-    shell_loop();
+    if ((stats_shm && stats_shm_attach(stats_shm) == -1) || metrics_start(metrics_socket, metrics_file) == -1)
+    {
+        cleanup_shell();
+        return EXIT_FAILURE;
+    }
+    if (serve_path)
+    {
+        if (run_server(serve_path) == -1)
+            status = EXIT_FAILURE;
+    }
+    else if (batch_mode)
+    {
+        run_batch(script_fd);
+    }
+    else
+    {
+        history_open(history_path); // optional: reports its own errors
+        shell_loop();
+    }
     cleanup_shell();
 
-    return EXIT_SUCCESS;
+    return status;
 }
@@ -0,0 +1,872 @@
+#include "../include/shell.h"
+
+/**
+ * @brief Allocate and initialize a matrix with the given dimensions.
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @return Pointer to allocated matrix or NULL on failure
+ */
+matrix_t *create_matrix(int rows, int cols)
+{
+    matrix_t *mat = malloc(sizeof(matrix_t));
+    if (!mat)
+        return NULL;
+
+    mat->rows = rows;
+    mat->cols = cols;
+    mat->mapping = NULL;
+    mat->refs = 1;
+    mat->nnz = 0;
+    mat->row_ptr = NULL;
+    mat->col_idx = NULL;
+    mat->values = NULL;
+    mat->data = calloc((size_t)rows * cols, sizeof(double));
+    if (!mat->data)
+    {
+        free(mat);
+        return NULL;
+    }
+    return mat;
+}
+
+/**
+ * @brief Take an additional reference to a matrix.
+ * @param mat Matrix to share
+ * @return mat
+ */
+matrix_t *retain_matrix(matrix_t *mat)
+{
+    mat->refs++;
+    return mat;
+}
+
+/**
+ * @brief Drop a reference to a matrix, freeing it with the last one.
+ * @param mat Pointer to the matrix to free
+ */
+void free_matrix(matrix_t *mat)
+{
+    if (mat && --mat->refs == 0)
+    {
+        if (mat->mapping)
+            release_matrix_mapping(mat->mapping);
+        else
+            free(mat->data);
+        free(mat->row_ptr);
+        free(mat->col_idx);
+        free(mat->values);
+        free(mat);
+    }
+}
+
+/**
+ * @brief Parse a matrix from a string in the format "(rows,cols:val1,val2,...,valN)".
+ *
+ * The sparse form "(rows,cols;r,c:v;...)" is also accepted, and dense input
+ * below MATRIX_SPARSE_DENSITY is stored as CSR.
+ *
+ * @param str Input string to parse
+ * @return Dynamically allocated matrix or NULL on format/parse error
+ */
+matrix_t *parse_matrix(const char *str)
+{
+    if (!str || str[0] != '(' || !strchr(str, ')'))
+    {
+        return NULL;
+    }
+
+    const char *semicolon = strchr(str + 1, ';');
+    const char *first_colon = strchr(str + 1, ':');
+    if (semicolon && (!first_colon || semicolon < first_colon))
+    {
+        return parse_sparse_matrix(str);
+    }
+
+    // Find the parts
+    const char *comma1 = strchr(str + 1, ',');
+    const char *colon = strchr(str + 1, ':');
+    const char *end = strchr(str + 1, ')');
+
+    if (!comma1 || !colon || !end || comma1 >= colon || colon >= end)
+    {
+        return NULL;
+    }
+
+    // Parse dimensions
+    int rows = atoi(str + 1);
+    int cols = atoi(comma1 + 1);
+
+    if (rows <= 0 || cols <= 0)
+    {
+        return NULL;
+    }
+
+    matrix_t *mat = create_matrix(rows, cols);
+    if (!mat)
+        return NULL;
+
+    // Parse values
+    const char *values = colon + 1;
+    char *values_copy = strndup(values, end - values);
+    if (!values_copy)
+    {
+        free_matrix(mat);
+        return NULL;
+    }
+
+    char *token = strtok(values_copy, ",");
+    int index = 0;
+
+    while (token && index < rows * cols)
+    {
+        mat->data[index] = atof(token);
+        token = strtok(NULL, ",");
+        index++;
+    }
+
+    free(values_copy);
+
+    if (index != rows * cols)
+    {
+        free_matrix(mat);
+        return NULL;
+    }
+
+    return sparsify_if_sparse(mat);
+}
+
+/**
+ * @brief Make an independent copy of a dense or sparse matrix.
+ * @param mat Matrix to copy
+ * @return Newly allocated copy or NULL on failure
+ */
+matrix_t *copy_matrix(const matrix_t *mat)
+{
+    if (mat->row_ptr)
+    {
+        matrix_t *copy = create_sparse_matrix(mat->rows, mat->cols, mat->nnz);
+        if (!copy)
+            return NULL;
+
+        memcpy(copy->row_ptr, mat->row_ptr, ((size_t)mat->rows + 1) * sizeof(size_t));
+        memcpy(copy->col_idx, mat->col_idx, mat->nnz * sizeof(int));
+        memcpy(copy->values, mat->values, mat->nnz * sizeof(double));
+        return copy;
+    }
+
+    matrix_t *copy = create_matrix(mat->rows, mat->cols);
+    if (!copy)
+        return NULL;
+
+    memcpy(copy->data, mat->data, (size_t)mat->rows * mat->cols * sizeof(double));
+    return copy;
+}
+
+/**
+ * @brief Append a matrix to a growable array of matrix pointers.
+ * @param matrices Array to grow (may point to NULL initially)
+ * @param count Number of used entries, incremented on success
+ * @param capacity Allocated entries, updated when the array grows
+ * @param mat Matrix to append
+ * @return 0 on success, -1 on allocation failure
+ */
+int append_matrix(matrix_t ***matrices, int *count, int *capacity, matrix_t *mat)
+{
+    if (*count == *capacity)
+    {
+        int new_capacity = (*capacity > 0) ? *capacity * 2 : 8;
+        matrix_t **grown = realloc(*matrices, new_capacity * sizeof(matrix_t *));
+        if (!grown)
+            return -1;
+
+        *matrices = grown;
+        *capacity = new_capacity;
+    }
+
+    (*matrices)[(*count)++] = mat;
+    return 0;
+}
+
+/**
+ * @brief Check if two matrices have the same dimensions.
+ * @param m1 First matrix
+ * @param m2 Second matrix
+ * @return 1 if compatible, 0 otherwise
+ */
+int matrices_compatible(matrix_t *m1, matrix_t *m2)
+{
+    return (m1->rows == m2->rows && m1->cols == m2->cols);
+}
+
+/**
+ * @brief Thread function to perform matrix addition or subtraction.
+ * @param arg Pointer to thread_arg_t structure containing inputs and operation type
+ * @return Pointer to result matrix or NULL on error/incompatibility
+ */
+static void *matrix_operation_thread(void *arg)
+{
+    thread_arg_t *args = (thread_arg_t *)arg;
+
+    if (!matrices_compatible(args->left, args->right))
+    {
+        return NULL;
+    }
+
+    if (args->left->row_ptr || args->right->row_ptr)
+    {
+        args->result = sparse_add_sub(args->left, args->right, args->operation);
+        return args->result;
+    }
+
+    args->result = create_matrix(args->left->rows, args->left->cols);
+    if (!args->result)
+        return NULL;
+
+    size_t size = (size_t)args->left->rows * args->left->cols;
+
+    if (args->operation == 'A')
+    { // ADD
+        for (size_t i = 0; i < size; i++)
+        {
+            args->result->data[i] = args->left->data[i] + args->right->data[i];
+        }
+    }
+    else if (args->operation == 'S')
+    { // SUB
+        for (size_t i = 0; i < size; i++)
+        {
+            args->result->data[i] = args->left->data[i] - args->right->data[i];
+        }
+    }
+
+    return args->result;
+}
+
+/**
+ * @brief Thread function adding the pairs of one ADD reduction level assigned to it.
+ * @param arg Pointer to pair_thread_arg_t structure
+ * @return arg; a pair that failed is left with a NULL result
+ */
+static void *matrix_pairs_thread(void *arg)
+{
+    pair_thread_arg_t *worker = (pair_thread_arg_t *)arg;
+
+    for (int i = worker->first_pair; i < worker->pair_count; i += worker->pair_stride)
+    {
+        matrix_operation_thread(&worker->pairs[i]);
+    }
+    return arg;
+}
+
+/**
+ * @brief Compute the result of a sequence of matrix operations (addition or subtraction) in parallel.
+ * @param matrices Array of matrix pointers
+ * @param count Number of matrices
+ * @param operation 'A' for addition, 'S' for subtraction
+ * @return Result matrix or NULL on failure
+ */
+matrix_t *compute_matrices_parallel(matrix_t **matrices, int count, char operation)
+{
+    if (count == 1)
+    {
+        // Base case: return copy of single matrix
+        return copy_matrix(matrices[0]);
+    }
+
+    if (count == 2)
+    {
+        // Base case: compute two matrices
+        thread_arg_t arg = {matrices[0], matrices[1], NULL, operation};
+        matrix_operation_thread(&arg);
+        return arg.result;
+    }
+
+    if (operation == 'S')
+    {
+        // For subtraction, we use a left-associative parallel approach
+        // Split into two halves: left half and right half
+        // Compute: (left_result) - (right_result)
+        // where left_result = matrices[0] - matrices[1] - ... - matrices[mid-1]
+        // and right_result = matrices[mid] + matrices[mid+1] + ... + matrices[count-1]
+
+        int mid = count / 2;
+        if (mid == 0)
+            mid = 1; // Ensure at least one matrix in left part
+
+        // Recursively compute left part (subtraction)
+        matrix_t *left_result = compute_matrices_parallel(matrices, mid, 'S');
+        if (!left_result)
+            return NULL;
+
+        // Recursively compute right part (addition, since we'll subtract the sum)
+        matrix_t *right_result = compute_matrices_parallel(&matrices[mid], count - mid, 'A');
+        if (!right_result)
+        {
+            free_matrix(left_result);
+            return NULL;
+        }
+
+        // Now compute left_result - right_result
+        thread_arg_t arg = {left_result, right_result, NULL, 'S'};
+        matrix_operation_thread(&arg);
+
+        // Clean up intermediate results
+        free_matrix(left_result);
+        free_matrix(right_result);
+
+        return arg.result;
+    }
+    else
+    {
+        // Parallel tree code for ADD operations
+        int pairs = count / 2;
+        int remainder = count % 2;
+
+        matrix_t **next_level = malloc((pairs + remainder) * sizeof(matrix_t *));
+        if (!next_level)
+            return NULL;
+
+        thread_arg_t *args = malloc(pairs * sizeof(thread_arg_t));
+        int thread_count = mcalc_thread_count(pairs);
+        pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+        pair_thread_arg_t *workers = malloc(thread_count * sizeof(pair_thread_arg_t));
+
+        if (!threads || !args || !workers)
+        {
+            free(next_level);
+            free(threads);
+            free(args);
+            free(workers);
+            return NULL;
+        }
+
+        for (int i = 0; i < pairs; i++)
+        {
+            args[i].left = matrices[i * 2];
+            args[i].right = matrices[i * 2 + 1];
+            args[i].result = NULL;
+            args[i].operation = operation;
+        }
+
+        // At most one thread per CPU, each adding every thread_count-th pair
+        int started = 0, failed = 0;
+        for (int i = 0; i < thread_count; i++)
+        {
+            pair_thread_arg_t worker = {args, pairs, i, thread_count};
+            workers[i] = worker;
+
+            if (pthread_create(&threads[i], NULL, matrix_pairs_thread, &workers[i]) != 0)
+            {
+                failed = 1;
+                break;
+            }
+            started++;
+        }
+
+        for (int i = 0; i < started; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+
+        // Collect results
+        for (int i = 0; i < pairs; i++)
+        {
+            next_level[i] = args[i].result;
+            if (!next_level[i])
+                failed = 1;
+        }
+
+        free(threads);
+        free(workers);
+        free(args);
+
+        if (failed)
+        {
+            for (int i = 0; i < pairs; i++)
+            {
+                if (next_level[i])
+                    free_matrix(next_level[i]);
+            }
+            free(next_level);
+            return NULL;
+        }
+
+        // Handle odd matrix (if any)
+        if (remainder)
+        {
+            next_level[pairs] = matrices[count - 1];
+        }
+
+        // Recursive call for next level
+        matrix_t *final_result = compute_matrices_parallel(next_level, pairs + remainder, operation);
+
+        // Clean up intermediate results (but not the odd one if it exists)
+        for (int i = 0; i < pairs; i++)
+        {
+            free_matrix(next_level[i]);
+        }
+
+        free(next_level);
+        return final_result;
+    }
+}
+
+/**
+ * @brief Print one matrix element, as an integer when it is a whole number.
+ * @param value Element to print
+ */
+static void print_matrix_value(double value)
+{
+    // Check if it's a whole number
+    if (value == (int)value)
+    {
+        printf("%d", (int)value);
+    }
+    else
+    {
+        printf("%.10g", value);
+    }
+}
+
+/**
+ * @brief Print a matrix to stdout in the format "(rows,cols:val1,val2,...)".
+ *
+ * Sparse matrices are expanded on the fly, without building a dense copy.
+ *
+ * @param mat Pointer to matrix to print
+ */
+
+void print_matrix(matrix_t *mat)
+{
+    printf("(%d,%d:", mat->rows, mat->cols);
+
+    if (mat->row_ptr)
+    {
+        for (int r = 0; r < mat->rows; r++)
+        {
+            size_t k = mat->row_ptr[r];
+            for (int c = 0; c < mat->cols; c++)
+            {
+                if (r > 0 || c > 0)
+                    printf(",");
+
+                if (k < mat->row_ptr[r + 1] && mat->col_idx[k] == c)
+                    print_matrix_value(mat->values[k++]);
+                else
+                    printf("0");
+            }
+        }
+        printf(")\n");
+        return;
+    }
+
+    size_t size = (size_t)mat->rows * mat->cols;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (i > 0)
+            printf(",");
+
+        print_matrix_value(mat->data[i]);
+    }
+
+    printf(")\n");
+}
+
+/**
+ * @brief Write a matrix in canonical binary form, as part of a cache key.
+ *
+ * Matrices with the same shape and element values give the same bytes,
+ * however their literals were written ("1" or "1.0"). Dense and sparse
+ * storage give different bytes.
+ *
+ * @param mat Matrix to write
+ * @param out Stream the key is written to
+ */
+void write_matrix_key(const matrix_t *mat, FILE *out)
+{
+    int shape[3] = {mat->rows, mat->cols, mat->row_ptr != NULL};
+    fwrite(shape, sizeof(shape), 1, out);
+
+    if (mat->row_ptr)
+    {
+        fwrite(mat->row_ptr, sizeof(size_t), (size_t)mat->rows + 1, out);
+        fwrite(mat->col_idx, sizeof(int), mat->nnz, out);
+        fwrite(mat->values, sizeof(double), mat->nnz, out);
+    }
+    else
+    {
+        fwrite(mat->data, sizeof(double), (size_t)mat->rows * mat->cols, out);
+    }
+}
+
+/* Blocking parameters for matrix multiplication: an MR x NR register tile of C
+ * is accumulated from an MC x KC packed panel of A (sized for L2) and a
+ * KC x NC packed panel of B (sized for L3). */
+#define MUL_MR 4
+#define MUL_NR 4
+#define MUL_MC 64
+#define MUL_KC 256
+#define MUL_NC 512
+
+/**
+ * @brief Number of worker threads used by mcalc for partitioned operations.
+ * @param tasks Number of independent tiles or row chunks available
+ * @return Thread count in the range [1, tasks]
+ */
+int mcalc_thread_count(int tasks)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        cpus = 1;
+    return (tasks < cpus) ? tasks : (int)cpus;
+}
+
+/**
+ * @brief Pack an mc x kc block of A into MR-row slivers, zero-padding the edge.
+ * @param a Source matrix
+ * @param ic First row of the block
+ * @param pc First column of the block
+ * @param mc Block rows
+ * @param kc Block columns
+ * @param packed Destination buffer (at least roundup(mc, MR) * kc doubles)
+ */
+static void pack_panel_a(const matrix_t *a, int ic, int pc, int mc, int kc, double *packed)
+{
+    for (int ir = 0; ir < mc; ir += MUL_MR)
+    {
+        for (int p = 0; p < kc; p++)
+        {
+            for (int i = 0; i < MUL_MR; i++)
+            {
+                *packed++ = (ir + i < mc) ? a->data[(size_t)(ic + ir + i) * a->cols + pc + p] : 0.0;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Pack a kc x nc block of B into NR-column slivers, zero-padding the edge.
+ * @param b Source matrix
+ * @param pc First row of the block
+ * @param jc First column of the block
+ * @param kc Block rows
+ * @param nc Block columns
+ * @param packed Destination buffer (at least roundup(nc, NR) * kc doubles)
+ */
+static void pack_panel_b(const matrix_t *b, int pc, int jc, int kc, int nc, double *packed)
+{
+    for (int jr = 0; jr < nc; jr += MUL_NR)
+    {
+        for (int p = 0; p < kc; p++)
+        {
+            const double *row = &b->data[(size_t)(pc + p) * b->cols + jc + jr];
+            for (int j = 0; j < MUL_NR; j++)
+            {
+                *packed++ = (jr + j < nc) ? row[j] : 0.0;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Register-tiled micro-kernel: C[mr x nr] += A_sliver * B_sliver.
+ * @param kc Shared dimension of the slivers
+ * @param a Packed A sliver (kc x MR)
+ * @param b Packed B sliver (kc x NR)
+ * @param c Top-left element of the C tile
+ * @param ldc Row stride of C
+ * @param mr Valid rows in the tile (<= MR)
+ * @param nr Valid columns in the tile (<= NR)
+ */
+static void mul_micro_kernel(int kc, const double *a, const double *b, double *c, int ldc, int mr, int nr)
+{
+    double acc[MUL_MR][MUL_NR] = {{0.0}};
+
+    for (int p = 0; p < kc; p++)
+    {
+        for (int i = 0; i < MUL_MR; i++)
+        {
+            for (int j = 0; j < MUL_NR; j++)
+            {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += MUL_MR;
+        b += MUL_NR;
+    }
+
+    for (int i = 0; i < mr; i++)
+    {
+        for (int j = 0; j < nr; j++)
+        {
+            c[(size_t)i * ldc + j] += acc[i][j];
+        }
+    }
+}
+
+/**
+ * @brief Thread function computing a strided subset of the MC x NC output tiles.
+ * @param arg Pointer to mul_thread_arg_t
+ * @return arg on success, NULL if the packing buffers could not be allocated
+ */
+static void *matrix_multiply_thread(void *arg)
+{
+    mul_thread_arg_t *args = (mul_thread_arg_t *)arg;
+    const matrix_t *a = args->left;
+    const matrix_t *b = args->right;
+    matrix_t *c = args->result;
+
+    int m = a->rows, n = b->cols, k = a->cols;
+    int tiles = args->tile_rows * args->tile_cols;
+
+    double *packed_a = malloc((size_t)MUL_MC * MUL_KC * sizeof(double));
+    double *packed_b = malloc((size_t)MUL_KC * (MUL_NC + MUL_NR) * sizeof(double));
+    if (!packed_a || !packed_b)
+    {
+        free(packed_a);
+        free(packed_b);
+        return NULL;
+    }
+
+    for (int t = args->first_tile; t < tiles; t += args->tile_stride)
+    {
+        int ic = (t / args->tile_cols) * MUL_MC;
+        int jc = (t % args->tile_cols) * MUL_NC;
+        int mc = (m - ic < MUL_MC) ? m - ic : MUL_MC;
+        int nc = (n - jc < MUL_NC) ? n - jc : MUL_NC;
+
+        for (int pc = 0; pc < k; pc += MUL_KC)
+        {
+            int kc = (k - pc < MUL_KC) ? k - pc : MUL_KC;
+
+            pack_panel_b(b, pc, jc, kc, nc, packed_b);
+            pack_panel_a(a, ic, pc, mc, kc, packed_a);
+
+            for (int jr = 0; jr < nc; jr += MUL_NR)
+            {
+                int nr = (nc - jr < MUL_NR) ? nc - jr : MUL_NR;
+                for (int ir = 0; ir < mc; ir += MUL_MR)
+                {
+                    int mr = (mc - ir < MUL_MR) ? mc - ir : MUL_MR;
+                    mul_micro_kernel(kc,
+                                     packed_a + (size_t)ir * kc,
+                                     packed_b + (size_t)jr * kc,
+                                     &c->data[(size_t)(ic + ir) * n + jc + jr],
+                                     n, mr, nr);
+                }
+            }
+        }
+    }
+
+    free(packed_a);
+    free(packed_b);
+    return args;
+}
+
+/**
+ * @brief Multiply two matrices with the cache-blocked kernel, parallel over output tiles.
+ * @param left Left operand (m x k)
+ * @param right Right operand (k x n)
+ * @return Newly allocated m x n product or NULL on mismatch/failure
+ */
+matrix_t *matrix_multiply(const matrix_t *left, const matrix_t *right)
+{
+    if (left->cols != right->rows)
+    {
+        return NULL;
+    }
+
+    // The blocked kernel works on dense panels; expand CSR operands first
+    if (left->row_ptr || right->row_ptr)
+    {
+        matrix_t *dense_left = left->row_ptr ? matrix_to_dense(left) : (matrix_t *)left;
+        matrix_t *dense_right = right->row_ptr ? matrix_to_dense(right) : (matrix_t *)right;
+        matrix_t *result = (dense_left && dense_right) ? matrix_multiply(dense_left, dense_right) : NULL;
+
+        if (dense_left && dense_left != left)
+            free_matrix(dense_left);
+        if (dense_right && dense_right != right)
+            free_matrix(dense_right);
+        return result;
+    }
+
+    matrix_t *result = create_matrix(left->rows, right->cols);
+    if (!result)
+        return NULL;
+
+    int tile_rows = (left->rows + MUL_MC - 1) / MUL_MC;
+    int tile_cols = (right->cols + MUL_NC - 1) / MUL_NC;
+    int thread_count = mcalc_thread_count(tile_rows * tile_cols);
+
+    if (thread_count == 1)
+    {
+        mul_thread_arg_t arg = {left, right, result, tile_rows, tile_cols, 0, 1};
+        if (!matrix_multiply_thread(&arg))
+        {
+            free_matrix(result);
+            return NULL;
+        }
+        return result;
+    }
+
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+    mul_thread_arg_t *args = malloc(thread_count * sizeof(mul_thread_arg_t));
+    if (!threads || !args)
+    {
+        free(threads);
+        free(args);
+        free_matrix(result);
+        return NULL;
+    }
+
+    int started = 0, failed = 0;
+    for (int i = 0; i < thread_count; i++)
+    {
+        mul_thread_arg_t arg = {left, right, result, tile_rows, tile_cols, i, thread_count};
+        args[i] = arg;
+
+        if (pthread_create(&threads[i], NULL, matrix_multiply_thread, &args[i]) != 0)
+        {
+            failed = 1;
+            break;
+        }
+        started++;
+    }
+
+    for (int i = 0; i < started; i++)
+    {
+        void *ret = NULL;
+        pthread_join(threads[i], &ret);
+        if (!ret)
+            failed = 1;
+    }
+
+    free(threads);
+    free(args);
+
+    if (failed)
+    {
+        free_matrix(result);
+        return NULL;
+    }
+    return result;
+}
+
+/**
+ * @brief Check that a chain of matrices can be multiplied left to right.
+ * @param matrices Array of matrix pointers
+ * @param count Number of matrices
+ * @return 1 if every adjacent pair agrees on the inner dimension, 0 otherwise
+ */
+int matrices_chain_compatible(matrix_t **matrices, int count)
+{
+    for (int i = 1; i < count; i++)
+    {
+        if (matrices[i - 1]->cols != matrices[i]->rows)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Multiply matrices[i..j] following the split table from the chain-order DP.
+ * @param matrices Array of matrix pointers
+ * @param split Split table, split[i * count + j] is the best split point for i..j
+ * @param count Total number of matrices (row stride of split)
+ * @param i First matrix of the range
+ * @param j Last matrix of the range
+ * @return Newly allocated product or NULL on failure
+ */
+static matrix_t *multiply_chain_range(matrix_t **matrices, const int *split, int count, int i, int j)
+{
+    if (i == j)
+    {
+        return copy_matrix(matrices[i]);
+    }
+
+    int s = split[i * count + j];
+
+    // Leaves are used in place; only intermediate products are allocated
+    matrix_t *left = (s == i) ? matrices[i] : multiply_chain_range(matrices, split, count, i, s);
+    if (!left)
+        return NULL;
+
+    matrix_t *right = (s + 1 == j) ? matrices[j] : multiply_chain_range(matrices, split, count, s + 1, j);
+    if (!right)
+    {
+        if (left != matrices[i])
+            free_matrix(left);
+        return NULL;
+    }
+
+    matrix_t *result = matrix_multiply(left, right);
+
+    if (left != matrices[i])
+        free_matrix(left);
+    if (right != matrices[j])
+        free_matrix(right);
+
+    return result;
+}
+
+/**
+ * @brief Multiply a chain of matrices using the cheapest association order.
+ *
+ * For three or more operands the classic O(n^3) matrix-chain dynamic program
+ * picks the parenthesization with the fewest scalar multiplications.
+ *
+ * @param matrices Array of matrix pointers
+ * @param count Number of matrices
+ * @return Newly allocated product or NULL on mismatch/failure
+ */
+matrix_t *matrix_chain_multiply(matrix_t **matrices, int count)
+{
+    if (!matrices_chain_compatible(matrices, count))
+    {
+        return NULL;
+    }
+
+    if (count <= 2)
+    {
+        return (count == 1) ? copy_matrix(matrices[0])
+                            : matrix_multiply(matrices[0], matrices[1]);
+    }
+
+    double *cost = calloc((size_t)count * count, sizeof(double));
+    int *split = calloc((size_t)count * count, sizeof(int));
+    if (!cost || !split)
+    {
+        free(cost);
+        free(split);
+        return NULL;
+    }
+
+    // cost[i][j] = min over s of cost[i][s] + cost[s+1][j] + rows_i * cols_s * cols_j
+    for (int len = 2; len <= count; len++)
+    {
+        for (int i = 0; i + len - 1 < count; i++)
+        {
+            int j = i + len - 1;
+            cost[i * count + j] = DBL_MAX;
+
+            for (int s = i; s < j; s++)
+            {
+                double c = cost[i * count + s] + cost[(s + 1) * count + j] +
+                           (double)matrices[i]->rows * matrices[s]->cols * matrices[j]->cols;
+                if (c < cost[i * count + j])
+                {
+                    cost[i * count + j] = c;
+                    split[i * count + j] = s;
+                }
+            }
+        }
+    }
+
+    matrix_t *result = multiply_chain_range(matrices, split, count, 0, count - 1);
+
+    free(cost);
+    free(split);
+    return result;
+}
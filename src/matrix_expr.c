@@ -0,0 +1,600 @@
+#include "../include/shell.h"
+
+/* Elements processed per block of the fused kernel (kept resident in L1) */
+#define EXPR_BLOCK 1024
+
+/* Minimum number of elements per expression worker thread */
+#define EXPR_MIN_WORK 65536
+
+static expr_node_t *parse_sum(const char **cursor);
+
+/**
+ * @brief Free an expression tree and drop its matrix references.
+ * @param node Root of the tree (may be NULL)
+ */
+static void free_expr(expr_node_t *node)
+{
+    if (!node)
+        return;
+
+    free_expr(node->left);
+    free_expr(node->right);
+    free_matrix(node->mat);
+    free(node);
+}
+
+/**
+ * @brief Allocate an expression node.
+ * @return New node or NULL on allocation failure (children are released)
+ */
+static expr_node_t *new_expr(char kind, expr_node_t *left, expr_node_t *right)
+{
+    expr_node_t *node = calloc(1, sizeof(expr_node_t));
+    if (!node)
+    {
+        free_expr(left);
+        free_expr(right);
+        return NULL;
+    }
+
+    node->kind = kind;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+/**
+ * @brief Skip spaces inside an expression.
+ */
+static const char *skip_expr_spaces(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+/**
+ * @brief Check whether '(' at p starts a "(rows,cols:" or "(rows,cols;" literal.
+ */
+static int is_literal_start(const char *p)
+{
+    p++;
+    if (!isdigit((unsigned char)*p))
+        return 0;
+    while (isdigit((unsigned char)*p))
+        p++;
+    if (*p++ != ',' || !isdigit((unsigned char)*p))
+        return 0;
+    while (isdigit((unsigned char)*p))
+        p++;
+    return *p == ':' || *p == ';';
+}
+
+/**
+ * @brief Load exactly one matrix from a literal, "@file" or "$NAME"/"NAME" token.
+ * @param token NUL-terminated operand text
+ * @return Matrix with one reference owned by the caller, or NULL
+ */
+static matrix_t *load_expr_operand(const char *token)
+{
+    if (token[0] == '(')
+        return parse_matrix(token);
+
+    if (token[0] == '@')
+    {
+        matrix_t **matrices = NULL;
+        int count = 0, capacity = 0;
+        int status = load_matrix_file(token + 1, &matrices, &count, &capacity);
+
+        matrix_t *mat = (status == 0 && count == 1) ? matrices[0] : NULL;
+        if (!mat)
+        {
+            for (int i = 0; i < count; i++)
+                free_matrix(matrices[i]);
+        }
+        free(matrices);
+        return mat;
+    }
+
+    matrix_t *named = matrix_store_get(token[0] == '$' ? token + 1 : token);
+    return named ? retain_matrix(named) : NULL;
+}
+
+/**
+ * @brief primary := number | '(' sum ')' | literal | '@'path | ['$']NAME
+ */
+static expr_node_t *parse_primary(const char **cursor)
+{
+    const char *p = skip_expr_spaces(*cursor);
+    const char *start = p;
+
+    if (*p == '(' && !is_literal_start(p))
+    {
+        *cursor = p + 1;
+        expr_node_t *inner = parse_sum(cursor);
+        p = skip_expr_spaces(*cursor);
+        if (!inner || *p != ')')
+        {
+            free_expr(inner);
+            return NULL;
+        }
+        *cursor = p + 1;
+        return inner;
+    }
+
+    if (isdigit((unsigned char)*p) || *p == '.')
+    {
+        char *stop;
+        double value = strtod(p, &stop);
+        if (stop == p)
+            return NULL;
+
+        expr_node_t *node = new_expr('N', NULL, NULL);
+        if (node)
+            node->number = value;
+        *cursor = stop;
+        return node;
+    }
+
+    // Operand token: a literal runs to its ')', anything else to a space or operator
+    if (*p == '(')
+    {
+        p = strchr(p, ')');
+        if (!p)
+            return NULL;
+        p++;
+    }
+    else if (*p == '@')
+    {
+        while (*p && *p != ' ' && *p != '\t' && *p != ')')
+            p++;
+    }
+    else
+    {
+        if (*p == '$')
+            p++;
+        while (isalnum((unsigned char)*p) || *p == '_')
+            p++;
+    }
+
+    if (p == start)
+        return NULL;
+
+    char *token = strndup(start, p - start);
+    if (!token)
+        return NULL;
+
+    matrix_t *mat = load_expr_operand(token);
+    free(token);
+    if (!mat)
+        return NULL;
+
+    expr_node_t *node = new_expr('M', NULL, NULL);
+    if (!node)
+    {
+        free_matrix(mat);
+        return NULL;
+    }
+    node->mat = mat;
+    *cursor = p;
+    return node;
+}
+
+/**
+ * @brief unary := '-' unary | primary
+ */
+static expr_node_t *parse_unary(const char **cursor)
+{
+    const char *p = skip_expr_spaces(*cursor);
+    if (*p == '-')
+    {
+        *cursor = p + 1;
+        expr_node_t *operand = parse_unary(cursor);
+        return operand ? new_expr('u', operand, NULL) : NULL;
+    }
+    return parse_primary(cursor);
+}
+
+/**
+ * @brief product := unary ('*' unary)*
+ */
+static expr_node_t *parse_product(const char **cursor)
+{
+    expr_node_t *node = parse_unary(cursor);
+
+    while (node)
+    {
+        const char *p = skip_expr_spaces(*cursor);
+        if (*p != '*')
+            break;
+
+        *cursor = p + 1;
+        expr_node_t *right = parse_unary(cursor);
+        if (!right)
+        {
+            free_expr(node);
+            return NULL;
+        }
+        node = new_expr('*', node, right);
+    }
+    return node;
+}
+
+/**
+ * @brief sum := product (('+' | '-') product)*
+ */
+static expr_node_t *parse_sum(const char **cursor)
+{
+    expr_node_t *node = parse_product(cursor);
+
+    while (node)
+    {
+        const char *p = skip_expr_spaces(*cursor);
+        if (*p != '+' && *p != '-')
+            break;
+
+        char op = *p;
+        *cursor = p + 1;
+        expr_node_t *right = parse_product(cursor);
+        if (!right)
+        {
+            free_expr(node);
+            return NULL;
+        }
+        node = new_expr(op, node, right);
+    }
+    return node;
+}
+
+/**
+ * @brief Count matrix leaves, i.e. the maximum number of terms.
+ */
+static int count_matrix_leaves(const expr_node_t *node)
+{
+    if (!node)
+        return 0;
+    return (node->kind == 'M') + count_matrix_leaves(node->left) + count_matrix_leaves(node->right);
+}
+
+/**
+ * @brief Flatten a tree into coefficient * matrix terms, folding scalars.
+ *
+ * Every operator is linear, so any valid expression reduces to a weighted
+ * sum of its operands; repeated operands are merged into one term.
+ *
+ * @param node Subtree to compile
+ * @param coef Coefficient applied to the whole subtree
+ * @param terms Term array (capacity = number of 'M' leaves)
+ * @param count Terms used so far
+ * @param scalar Output: value of the subtree if it contains no matrix
+ * @return 1 if the subtree contains a matrix, 0 if it is a pure scalar, -1 on error
+ */
+static int compile_expr(const expr_node_t *node, double coef, expr_term_t *terms, int *count, double *scalar)
+{
+    double left_value = 0.0, right_value = 0.0;
+    int left_kind, right_kind;
+
+    switch (node->kind)
+    {
+    case 'N':
+        *scalar = node->number;
+        return 0;
+
+    case 'M':
+        for (int i = 0; i < *count; i++)
+        {
+            if (terms[i].mat == node->mat)
+            {
+                terms[i].coef += coef;
+                return 1;
+            }
+        }
+        if (*count > 0 && !matrices_compatible((matrix_t *)terms[0].mat, node->mat))
+            return -1;
+        terms[*count].coef = coef;
+        terms[*count].mat = node->mat;
+        (*count)++;
+        return 1;
+
+    case 'u':
+        left_kind = compile_expr(node->left, -coef, terms, count, &left_value);
+        *scalar = -left_value;
+        return left_kind;
+
+    case '*':
+        // One side must be a pure scalar; fold it first so its value scales the other side
+        left_kind = count_matrix_leaves(node->left) > 0;
+        right_kind = count_matrix_leaves(node->right) > 0;
+        if (left_kind && right_kind)
+            return -1; // matrix * matrix is MUL, not an element-wise expression
+
+        if (!left_kind)
+        {
+            compile_expr(node->left, 1.0, terms, count, &left_value);
+            right_kind = compile_expr(node->right, coef * left_value, terms, count, &right_value);
+            *scalar = left_value * right_value;
+            return right_kind;
+        }
+        compile_expr(node->right, 1.0, terms, count, &right_value);
+        return compile_expr(node->left, coef * right_value, terms, count, &left_value);
+
+    case '+':
+    case '-':
+        left_kind = compile_expr(node->left, coef, terms, count, &left_value);
+        right_kind = compile_expr(node->right, node->kind == '-' ? -coef : coef, terms, count, &right_value);
+        if (left_kind == -1 || right_kind == -1 || left_kind != right_kind)
+            return -1; // scalars and matrices cannot be added
+        *scalar = (node->kind == '-') ? left_value - right_value : left_value + right_value;
+        return left_kind;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Fused kernel: result = sum(coef_k * M_k) over a row range in one pass.
+ *
+ * Dense terms are combined block by block so each block of the result stays
+ * in cache while every input is streamed once; sparse terms are scattered
+ * into the same rows afterwards.
+ */
+static void *expr_eval_thread(void *arg)
+{
+    expr_thread_arg_t *args = (expr_thread_arg_t *)arg;
+    int cols = args->result->cols;
+    size_t begin = (size_t)args->row_begin * cols;
+    size_t end = (size_t)args->row_end * cols;
+    double *out = args->result->data;
+
+    for (size_t block = begin; block < end; block += EXPR_BLOCK)
+    {
+        size_t block_end = (end - block < EXPR_BLOCK) ? end : block + EXPR_BLOCK;
+        int first = 1;
+
+        for (int k = 0; k < args->term_count; k++)
+        {
+            const matrix_t *mat = args->terms[k].mat;
+            double coef = args->terms[k].coef;
+            if (mat->row_ptr)
+                continue;
+
+            if (first)
+            {
+                for (size_t i = block; i < block_end; i++)
+                    out[i] = coef * mat->data[i];
+                first = 0;
+            }
+            else
+            {
+                for (size_t i = block; i < block_end; i++)
+                    out[i] += coef * mat->data[i];
+            }
+        }
+    }
+
+    for (int k = 0; k < args->term_count; k++)
+    {
+        const matrix_t *mat = args->terms[k].mat;
+        if (!mat->row_ptr)
+            continue;
+
+        for (int r = args->row_begin; r < args->row_end; r++)
+        {
+            double *row = &out[(size_t)r * cols];
+            for (size_t j = mat->row_ptr[r]; j < mat->row_ptr[r + 1]; j++)
+                row[mat->col_idx[j]] += args->terms[k].coef * mat->values[j];
+        }
+    }
+    return args;
+}
+
+/**
+ * @brief Evaluate terms that are all sparse into a CSR result.
+ */
+static matrix_t *evaluate_sparse_terms(const expr_term_t *terms, int term_count)
+{
+    size_t total = 0;
+    for (int k = 0; k < term_count; k++)
+        total += terms[k].mat->nnz;
+
+    matrix_triplet_t *triplets = malloc((total > 0 ? total : 1) * sizeof(matrix_triplet_t));
+    if (!triplets)
+        return NULL;
+
+    size_t n = 0;
+    for (int k = 0; k < term_count; k++)
+    {
+        const matrix_t *mat = terms[k].mat;
+        for (int r = 0; r < mat->rows; r++)
+        {
+            for (size_t j = mat->row_ptr[r]; j < mat->row_ptr[r + 1]; j++)
+            {
+                triplets[n].row = r;
+                triplets[n].col = mat->col_idx[j];
+                triplets[n].value = terms[k].coef * mat->values[j];
+                n++;
+            }
+        }
+    }
+
+    matrix_t *result = sparse_from_triplets(terms[0].mat->rows, terms[0].mat->cols, triplets, n);
+    free(triplets);
+    return result;
+}
+
+/**
+ * @brief Evaluate compiled terms with the fused kernel, parallel over row ranges.
+ */
+static matrix_t *evaluate_terms(const expr_term_t *terms, int term_count)
+{
+    int all_sparse = 1;
+    for (int k = 0; k < term_count; k++)
+    {
+        if (!terms[k].mat->row_ptr)
+            all_sparse = 0;
+    }
+    if (all_sparse)
+        return evaluate_sparse_terms(terms, term_count);
+
+    int rows = terms[0].mat->rows, cols = terms[0].mat->cols;
+    matrix_t *result = create_matrix(rows, cols);
+    if (!result)
+        return NULL;
+
+    size_t chunks = (size_t)rows * cols / EXPR_MIN_WORK + 1;
+    int thread_count = mcalc_thread_count(chunks < (size_t)rows ? (int)chunks : rows);
+
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+    expr_thread_arg_t *args = malloc(thread_count * sizeof(expr_thread_arg_t));
+    if (!threads || !args)
+    {
+        free(threads);
+        free(args);
+        free_matrix(result);
+        return NULL;
+    }
+
+    int started = 0;
+    for (int t = 0; t < thread_count; t++)
+    {
+        args[t].terms = terms;
+        args[t].term_count = term_count;
+        args[t].result = result;
+        args[t].row_begin = (int)((long long)rows * t / thread_count);
+        args[t].row_end = (int)((long long)rows * (t + 1) / thread_count);
+
+        if (t == thread_count - 1 || pthread_create(&threads[t], NULL, expr_eval_thread, &args[t]) != 0)
+        {
+            // The last range (or any range left after a failed create) runs on this thread
+            args[t].row_end = rows;
+            expr_eval_thread(&args[t]);
+            break;
+        }
+        started++;
+    }
+
+    for (int t = 0; t < started; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    free(threads);
+    free(args);
+    return result;
+}
+
+/**
+ * @brief Decide whether a single mcalc argument is an expression.
+ * @param str Argument text
+ * @return 1 if it contains an operator outside of matrix literals, 0 otherwise
+ */
+int is_matrix_expression(const char *str)
+{
+    int depth = 0;
+    for (const char *p = str; *p; p++)
+    {
+        if (*p == '(' && is_literal_start(p))
+        {
+            depth++;
+        }
+        else if (*p == ')' && depth > 0)
+        {
+            depth--;
+        }
+        else if (depth == 0 && (*p == '+' || *p == '-' || *p == '*'))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse, compile and evaluate an element-wise matrix expression.
+ *
+ * Supports '+', '-', unary minus, scalar '*' and parentheses over literals,
+ * "@file" and named ("NAME" or "$NAME") operands. The tree is compiled to a
+ * weighted sum of operands and evaluated in a single fused pass, without
+ * intermediate matrices.
+ *
+ * @param expr Expression text, e.g. "A + B - C*2 + D"
+ * @return Newly allocated result or NULL on error
+ */
+matrix_t *evaluate_matrix_expression(const char *expr)
+{
+    const char *cursor = expr;
+    expr_node_t *root = parse_sum(&cursor);
+    if (!root || *skip_expr_spaces(cursor) != '\0')
+    {
+        free_expr(root);
+        return NULL;
+    }
+
+    int leaves = count_matrix_leaves(root);
+    expr_term_t *terms = malloc((leaves > 0 ? leaves : 1) * sizeof(expr_term_t));
+    if (!terms)
+    {
+        free_expr(root);
+        return NULL;
+    }
+
+    int term_count = 0;
+    double scalar = 0.0;
+    matrix_t *result = NULL;
+
+    if (compile_expr(root, 1.0, terms, &term_count, &scalar) == 1)
+    {
+        result = evaluate_terms(terms, term_count);
+    }
+
+    free(terms);
+    free_expr(root);
+    return result;
+}
+
+/**
+ * @brief Write an expression over literals in normalized form, as a cache key.
+ *
+ * Spaces are dropped and every literal and number is replaced by its parsed
+ * value, so "(1,1:2) * 2" and "(1,1:2.0)*2.0" give the same key.
+ *
+ * @param expr Expression without file or named operands
+ * @param out Stream the key is written to
+ * @return 0 on success, -1 if a literal or number does not parse
+ */
+int write_expression_key(const char *expr, FILE *out)
+{
+    for (const char *p = skip_expr_spaces(expr); *p; p = skip_expr_spaces(p))
+    {
+        if (*p == '(' && is_literal_start(p))
+        {
+            const char *end = strchr(p, ')');
+            char *token = end ? strndup(p, end + 1 - p) : NULL;
+            matrix_t *mat = token ? parse_matrix(token) : NULL;
+            free(token);
+            if (!mat)
+                return -1;
+
+            fputc('M', out);
+            write_matrix_key(mat, out);
+            free_matrix(mat);
+            p = end + 1;
+        }
+        else if (isdigit((unsigned char)*p) || *p == '.')
+        {
+            char *stop;
+            double value = strtod(p, &stop);
+            if (stop == p)
+                return -1;
+
+            fputc('N', out);
+            fwrite(&value, sizeof(value), 1, out);
+            p = stop;
+        }
+        else
+        {
+            fputc(*p++, out); // Operator or parenthesis
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,393 @@
+#include "../include/shell.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+
+/**
+ * @brief Drop one reference to a file mapping, unmapping it with the last one.
+ * @param mapping Mapping shared by zero-copy matrices
+ */
+void release_matrix_mapping(matrix_mapping_t *mapping)
+{
+    if (--mapping->refs > 0)
+        return;
+
+    munmap(mapping->addr, mapping->length);
+    free(mapping);
+}
+
+/**
+ * @brief Skip whitespace and '#' comments in a text matrix file.
+ * @param p Current position
+ * @param end End of the mapped text
+ * @return First position that is neither blank nor inside a comment
+ */
+static const char *skip_blanks(const char *p, const char *end)
+{
+    while (p < end)
+    {
+        if (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        else if (*p == '#')
+        {
+            while (p < end && *p != '\n')
+                p++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return p;
+}
+
+/**
+ * @brief Consume an expected separator character.
+ * @param cursor Parse position, advanced past the character on success
+ * @param end End of the mapped text
+ * @param c Expected character
+ * @return 0 on success, -1 if the next non-blank character differs
+ */
+static int expect_char(const char **cursor, const char *end, char c)
+{
+    const char *p = skip_blanks(*cursor, end);
+    if (p == end || *p != c)
+        return -1;
+    *cursor = p + 1;
+    return 0;
+}
+
+/**
+ * @brief Parse one number without relying on NUL termination of the mapping.
+ * @param cursor Parse position, advanced past the number on success
+ * @param end End of the mapped text
+ * @param value Output value
+ * @return 0 on success, -1 on malformed input
+ */
+static int scan_number(const char **cursor, const char *end, double *value)
+{
+    char buf[64];
+    const char *p = skip_blanks(*cursor, end);
+    size_t len = 0;
+
+    while (p + len < end && len < sizeof(buf) - 1 &&
+           (isalnum((unsigned char)p[len]) || p[len] == '.' || p[len] == '+' || p[len] == '-'))
+    {
+        len++;
+    }
+
+    if (len == 0 || len == sizeof(buf) - 1)
+        return -1;
+
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+
+    char *stop;
+    *value = strtod(buf, &stop);
+    if (*stop != '\0')
+        return -1;
+
+    *cursor = p + len;
+    return 0;
+}
+
+/**
+ * @brief Parse the "r,c:v;..." body of a sparse text record up to its ')'.
+ * @param cursor Parse position, advanced past the record on success
+ * @param end End of the mapped text
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @return Newly allocated CSR matrix or NULL on malformed input
+ */
+static matrix_t *scan_sparse_body(const char **cursor, const char *end, int rows, int cols)
+{
+    matrix_triplet_t *triplets = NULL;
+    size_t count = 0, capacity = 0;
+
+    while (expect_char(cursor, end, ')') == -1)
+    {
+        double r, c, v;
+        if (scan_number(cursor, end, &r) == -1 || expect_char(cursor, end, ',') == -1 ||
+            scan_number(cursor, end, &c) == -1 || expect_char(cursor, end, ':') == -1 ||
+            scan_number(cursor, end, &v) == -1 ||
+            r < 0 || r >= rows || c < 0 || c >= cols || r != (int)r || c != (int)c)
+        {
+            free(triplets);
+            return NULL;
+        }
+
+        // Entries are separated by ';', the record ends with ')'
+        expect_char(cursor, end, ';');
+
+        if (count == capacity)
+        {
+            size_t new_capacity = capacity ? capacity * 2 : 64;
+            matrix_triplet_t *grown = realloc(triplets, new_capacity * sizeof(matrix_triplet_t));
+            if (!grown)
+            {
+                free(triplets);
+                return NULL;
+            }
+            triplets = grown;
+            capacity = new_capacity;
+        }
+
+        triplets[count].row = (int)r;
+        triplets[count].col = (int)c;
+        triplets[count].value = v;
+        count++;
+    }
+
+    matrix_t *mat = sparse_from_triplets(rows, cols, triplets, count);
+    free(triplets);
+    return mat;
+}
+
+/**
+ * @brief Parse one "(rows,cols:v1,...,vN)" or "(rows,cols;r,c:v;...)" record from text.
+ *
+ * Blanks are allowed anywhere. Dense records below MATRIX_SPARSE_DENSITY are
+ * stored as CSR.
+ *
+ * @param cursor Parse position, advanced past the record on success
+ * @param end End of the mapped text
+ * @return Newly allocated matrix or NULL on malformed input
+ */
+static matrix_t *scan_matrix_record(const char **cursor, const char *end)
+{
+    double rows, cols;
+
+    if (expect_char(cursor, end, '(') == -1 ||
+        scan_number(cursor, end, &rows) == -1 || expect_char(cursor, end, ',') == -1 ||
+        scan_number(cursor, end, &cols) == -1)
+    {
+        return NULL;
+    }
+
+    if (rows < 1 || cols < 1 || rows > INT_MAX || cols > INT_MAX ||
+        rows != (int)rows || cols != (int)cols)
+    {
+        return NULL;
+    }
+
+    if (expect_char(cursor, end, ';') == 0)
+    {
+        return scan_sparse_body(cursor, end, (int)rows, (int)cols);
+    }
+
+    if (expect_char(cursor, end, ':') == -1)
+    {
+        return NULL;
+    }
+
+    matrix_t *mat = create_matrix((int)rows, (int)cols);
+    if (!mat)
+        return NULL;
+
+    size_t size = (size_t)mat->rows * mat->cols;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (scan_number(cursor, end, &mat->data[i]) == -1 ||
+            expect_char(cursor, end, (i + 1 < size) ? ',' : ')') == -1)
+        {
+            free_matrix(mat);
+            return NULL;
+        }
+    }
+
+    return sparsify_if_sparse(mat);
+}
+
+/**
+ * @brief Append every text record of a mapped file, parsing it in one forward pass.
+ * @return 0 on success, -1 on malformed input or allocation failure
+ */
+static int load_text_records(const char *p, const char *end,
+                             matrix_t ***matrices, int *count, int *capacity)
+{
+    int loaded = 0;
+
+    while ((p = skip_blanks(p, end)) < end)
+    {
+        matrix_t *mat = scan_matrix_record(&p, end);
+        if (!mat)
+            return -1;
+
+        if (append_matrix(matrices, count, capacity, mat) == -1)
+        {
+            free_matrix(mat);
+            return -1;
+        }
+        loaded++;
+    }
+
+    return loaded > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Append every binary record of a mapping as a zero-copy matrix.
+ * @return 0 on success, -1 on a malformed record or allocation failure
+ */
+static int load_binary_records(matrix_mapping_t *mapping,
+                               matrix_t ***matrices, int *count, int *capacity)
+{
+    const char *p = mapping->addr;
+    const char *end = p + mapping->length;
+
+    while (p < end)
+    {
+        matrix_file_header_t header;
+        if ((size_t)(end - p) < sizeof(header))
+            return -1;
+
+        memcpy(&header, p, sizeof(header));
+        if (memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != MATRIX_FILE_VERSION ||
+            header.rows < 1 || header.cols < 1 ||
+            header.rows > INT_MAX || header.cols > INT_MAX)
+        {
+            return -1;
+        }
+
+        size_t available = (size_t)(end - p) - sizeof(header);
+        if ((size_t)header.rows > available / sizeof(double) / header.cols)
+            return -1;
+
+        size_t bytes = (size_t)header.rows * header.cols * sizeof(double);
+
+        matrix_t *mat = malloc(sizeof(matrix_t));
+        if (!mat)
+            return -1;
+
+        mat->rows = (int)header.rows;
+        mat->cols = (int)header.cols;
+        mat->data = (double *)(p + sizeof(header));
+        mat->mapping = mapping;
+        mat->refs = 1;
+        mat->nnz = 0;
+        mat->row_ptr = NULL;
+        mat->col_idx = NULL;
+        mat->values = NULL;
+        mapping->refs++;
+
+        if (append_matrix(matrices, count, capacity, mat) == -1)
+        {
+            free_matrix(mat);
+            return -1;
+        }
+
+        p += sizeof(header) + bytes;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Load all matrices stored in a file and append them to a matrix array.
+ *
+ * The file is memory-mapped. Binary files (starting with MATRIX_FILE_MAGIC)
+ * are used in place: each matrix's data points straight into the mapping.
+ * Text files hold one or more "(rows,cols:...)" records and are parsed in a
+ * single streaming pass without copying the text.
+ *
+ * @param path File to load
+ * @param matrices Growable array to append to
+ * @param count Number of used entries, updated
+ * @param capacity Allocated entries, updated
+ * @return 0 on success, -1 on error (matrices appended so far stay in the array)
+ */
+int load_matrix_file(const char *path, matrix_t ***matrices, int *count, int *capacity)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        perror(path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap");
+        return -1;
+    }
+
+    size_t length = st.st_size;
+    if (length >= sizeof(matrix_file_header_t) &&
+        memcmp(addr, MATRIX_FILE_MAGIC, strlen(MATRIX_FILE_MAGIC)) == 0)
+    {
+        matrix_mapping_t *mapping = malloc(sizeof(matrix_mapping_t));
+        if (!mapping)
+        {
+            munmap(addr, length);
+            return -1;
+        }
+        mapping->addr = addr;
+        mapping->length = length;
+        mapping->refs = 1; // held by the loader until all records are appended
+
+        madvise(addr, length, MADV_WILLNEED);
+        int status = load_binary_records(mapping, matrices, count, capacity);
+        release_matrix_mapping(mapping);
+        return status;
+    }
+
+    madvise(addr, length, MADV_SEQUENTIAL);
+    int status = load_text_records(addr, (const char *)addr + length, matrices, count, capacity);
+    munmap(addr, length);
+    return status;
+}
+
+/**
+ * @brief Write a matrix to a file in the binary matrix format.
+ * @param path Output file (created or truncated)
+ * @param mat Matrix to store
+ * @return 0 on success, -1 on error
+ */
+int save_matrix_file(const char *path, const matrix_t *mat)
+{
+    // The binary format is dense; expand CSR results on the way out
+    if (mat->row_ptr)
+    {
+        matrix_t *dense = matrix_to_dense(mat);
+        if (!dense)
+            return -1;
+
+        int status = save_matrix_file(path, dense);
+        free_matrix(dense);
+        return status;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, DEFAULT_FILE_PERMISSIONS);
+    if (fd == -1)
+    {
+        perror(path);
+        return -1;
+    }
+
+    matrix_file_header_t header;
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.version = MATRIX_FILE_VERSION;
+    header.rows = (uint32_t)mat->rows;
+    header.cols = (uint32_t)mat->cols;
+
+    size_t bytes = (size_t)mat->rows * mat->cols * sizeof(double);
+    if (write_all(fd, &header, sizeof(header)) == -1 || write_all(fd, mat->data, bytes) == -1)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    return close(fd);
+}
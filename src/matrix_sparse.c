@@ -0,0 +1,509 @@
+#include "../include/shell.h"
+#include <limits.h>
+
+/* Minimum number of row entries (stored values plus rows) per sparse worker thread */
+#define SPARSE_MIN_WORK 16384
+
+/**
+ * @brief Allocate a CSR matrix with room for nnz stored values.
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @param nnz Capacity for stored values
+ * @return Matrix with zeroed row_ptr, or NULL on failure
+ */
+matrix_t *create_sparse_matrix(int rows, int cols, size_t nnz)
+{
+    matrix_t *mat = malloc(sizeof(matrix_t));
+    if (!mat)
+        return NULL;
+
+    mat->rows = rows;
+    mat->cols = cols;
+    mat->data = NULL;
+    mat->mapping = NULL;
+    mat->refs = 1;
+    mat->nnz = nnz;
+    mat->row_ptr = calloc((size_t)rows + 1, sizeof(size_t));
+    mat->col_idx = malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    mat->values = malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+
+    if (!mat->row_ptr || !mat->col_idx || !mat->values)
+    {
+        free_matrix(mat);
+        return NULL;
+    }
+    return mat;
+}
+
+/**
+ * @brief qsort comparator ordering triplets by row, then column.
+ */
+static int compare_triplets(const void *a, const void *b)
+{
+    const matrix_triplet_t *x = a, *y = b;
+    if (x->row != y->row)
+        return (x->row < y->row) ? -1 : 1;
+    if (x->col != y->col)
+        return (x->col < y->col) ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Build a CSR matrix from unordered triplets (sorted in place).
+ *
+ * Duplicate coordinates are summed and entries that end up zero are dropped.
+ *
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @param triplets Entries, all within bounds
+ * @param count Number of entries
+ * @return Newly allocated CSR matrix or NULL on failure
+ */
+matrix_t *sparse_from_triplets(int rows, int cols, matrix_triplet_t *triplets, size_t count)
+{
+    if (count > 0)
+        qsort(triplets, count, sizeof(matrix_triplet_t), compare_triplets);
+
+    // Merge duplicates in place
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (unique > 0 && triplets[unique - 1].row == triplets[i].row &&
+            triplets[unique - 1].col == triplets[i].col)
+        {
+            triplets[unique - 1].value += triplets[i].value;
+        }
+        else
+        {
+            triplets[unique++] = triplets[i];
+        }
+    }
+
+    size_t nnz = 0;
+    for (size_t i = 0; i < unique; i++)
+    {
+        if (triplets[i].value != 0.0)
+            nnz++;
+    }
+
+    matrix_t *mat = create_sparse_matrix(rows, cols, nnz);
+    if (!mat)
+        return NULL;
+
+    size_t k = 0;
+    for (size_t i = 0; i < unique; i++)
+    {
+        if (triplets[i].value == 0.0)
+            continue;
+
+        mat->row_ptr[triplets[i].row + 1]++;
+        mat->col_idx[k] = triplets[i].col;
+        mat->values[k] = triplets[i].value;
+        k++;
+    }
+
+    for (int r = 0; r < rows; r++)
+    {
+        mat->row_ptr[r + 1] += mat->row_ptr[r];
+    }
+    return mat;
+}
+
+/**
+ * @brief Parse a sparse literal "(rows,cols;r,c:v;r,c:v;...)" with 0-based indices.
+ * @param str Input string to parse
+ * @return Newly allocated CSR matrix or NULL on format/parse error
+ */
+matrix_t *parse_sparse_matrix(const char *str)
+{
+    if (!str || str[0] != '(')
+        return NULL;
+
+    char *p;
+    long rows = strtol(str + 1, &p, 10);
+    if (*p != ',')
+        return NULL;
+    long cols = strtol(p + 1, &p, 10);
+    if (*p != ';' || rows <= 0 || cols <= 0 || rows > INT_MAX || cols > INT_MAX)
+        return NULL;
+    p++;
+
+    matrix_triplet_t *triplets = NULL;
+    size_t count = 0, capacity = 0;
+
+    while (*p != ')')
+    {
+        char *q;
+        long r = strtol(p, &q, 10);
+        if (q == p || *q != ',')
+            goto fail;
+        p = q + 1;
+
+        long c = strtol(p, &q, 10);
+        if (q == p || *q != ':')
+            goto fail;
+        p = q + 1;
+
+        double v = strtod(p, &q);
+        if (q == p || r < 0 || r >= rows || c < 0 || c >= cols)
+            goto fail;
+        p = q;
+
+        if (*p == ';')
+            p++;
+        else if (*p != ')')
+            goto fail;
+
+        if (count == capacity)
+        {
+            size_t new_capacity = capacity ? capacity * 2 : 16;
+            matrix_triplet_t *grown = realloc(triplets, new_capacity * sizeof(matrix_triplet_t));
+            if (!grown)
+                goto fail;
+            triplets = grown;
+            capacity = new_capacity;
+        }
+
+        triplets[count].row = (int)r;
+        triplets[count].col = (int)c;
+        triplets[count].value = v;
+        count++;
+    }
+
+    matrix_t *mat = sparse_from_triplets((int)rows, (int)cols, triplets, count);
+    free(triplets);
+    return mat;
+
+fail:
+    free(triplets);
+    return NULL;
+}
+
+/**
+ * @brief Expand a CSR matrix into a dense one.
+ * @param mat Sparse matrix
+ * @return Newly allocated dense matrix or NULL on failure
+ */
+matrix_t *matrix_to_dense(const matrix_t *mat)
+{
+    matrix_t *dense = create_matrix(mat->rows, mat->cols);
+    if (!dense)
+        return NULL;
+
+    for (int r = 0; r < mat->rows; r++)
+    {
+        double *row = &dense->data[(size_t)r * mat->cols];
+        for (size_t k = mat->row_ptr[r]; k < mat->row_ptr[r + 1]; k++)
+        {
+            row[mat->col_idx[k]] = mat->values[k];
+        }
+    }
+    return dense;
+}
+
+/**
+ * @brief Convert a freshly parsed dense matrix to CSR if its fill ratio is low.
+ *
+ * Mapped (zero-copy) matrices are left untouched.
+ *
+ * @param mat Dense matrix; released if a sparse replacement is returned
+ * @return mat itself, or the CSR equivalent
+ */
+matrix_t *sparsify_if_sparse(matrix_t *mat)
+{
+    if (!mat || mat->row_ptr || mat->mapping)
+        return mat;
+
+    size_t size = (size_t)mat->rows * mat->cols;
+    size_t nnz = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (mat->data[i] != 0.0)
+            nnz++;
+    }
+
+    if ((double)nnz >= MATRIX_SPARSE_DENSITY * size)
+        return mat;
+
+    matrix_t *sparse = create_sparse_matrix(mat->rows, mat->cols, nnz);
+    if (!sparse)
+        return mat; // Dense form is still valid
+
+    size_t k = 0;
+    for (int r = 0; r < mat->rows; r++)
+    {
+        const double *row = &mat->data[(size_t)r * mat->cols];
+        for (int c = 0; c < mat->cols; c++)
+        {
+            if (row[c] != 0.0)
+            {
+                sparse->col_idx[k] = c;
+                sparse->values[k] = row[c];
+                k++;
+            }
+        }
+        sparse->row_ptr[r + 1] = k;
+    }
+
+    free_matrix(mat);
+    return sparse;
+}
+
+/**
+ * @brief Work done before a given row, used to balance threads by nonzeros.
+ * @return Stored entries of both operands in rows [0, row) plus the row count
+ */
+static size_t work_before_row(const matrix_t *left, const matrix_t *right, int row)
+{
+    size_t l = left->row_ptr ? left->row_ptr[row] : (size_t)row * left->cols;
+    size_t r = right->row_ptr ? right->row_ptr[row] : (size_t)row * right->cols;
+    return l + r + row;
+}
+
+/**
+ * @brief Find the first row at which the accumulated work reaches a target.
+ */
+static int row_for_work(const matrix_t *left, const matrix_t *right, size_t target)
+{
+    int lo = 0, hi = left->rows;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (work_before_row(left, right, mid) < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief Run a row kernel over all rows, split across threads by equal work.
+ * @param kernel Thread function taking a sparse_thread_arg_t
+ * @param left Left operand
+ * @param right Right operand
+ * @param result Result matrix shared by all threads (rows are disjoint)
+ * @param operation 'A' or 'S'
+ * @return 0 on success, -1 if threads could not be created
+ */
+static int run_row_partitioned(void *(*kernel)(void *), const matrix_t *left, const matrix_t *right,
+                               matrix_t *result, char operation)
+{
+    size_t total = work_before_row(left, right, left->rows);
+    size_t chunks = total / SPARSE_MIN_WORK + 1;
+    int thread_count = mcalc_thread_count(chunks < (size_t)left->rows ? (int)chunks : left->rows);
+
+    if (thread_count <= 1)
+    {
+        sparse_thread_arg_t arg = {left, right, result, operation, 0, left->rows};
+        kernel(&arg);
+        return 0;
+    }
+
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+    sparse_thread_arg_t *args = malloc(thread_count * sizeof(sparse_thread_arg_t));
+    if (!threads || !args)
+    {
+        free(threads);
+        free(args);
+        return -1;
+    }
+
+    int started = 0;
+    for (int t = 0; t < thread_count; t++)
+    {
+        args[t].left = left;
+        args[t].right = right;
+        args[t].result = result;
+        args[t].operation = operation;
+        args[t].row_begin = row_for_work(left, right, total * t / thread_count);
+        args[t].row_end = (t == thread_count - 1) ? left->rows
+                                                  : row_for_work(left, right, total * (t + 1) / thread_count);
+
+        if (pthread_create(&threads[t], NULL, kernel, &args[t]) != 0)
+        {
+            // Finish the remaining rows on this thread
+            args[t].row_end = left->rows;
+            kernel(&args[t]);
+            break;
+        }
+        started++;
+    }
+
+    for (int t = 0; t < started; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    free(threads);
+    free(args);
+    return 0;
+}
+
+/**
+ * @brief Merge one row of two CSR matrices (sorted column lists).
+ * @param cols_out Output columns, or NULL to only count
+ * @param values_out Output values, or NULL to only count
+ * @return Number of nonzero entries in the merged row
+ */
+static size_t merge_sparse_row(const matrix_t *left, const matrix_t *right, int row, char operation,
+                               int *cols_out, double *values_out)
+{
+    size_t a = left->row_ptr[row], a_end = left->row_ptr[row + 1];
+    size_t b = right->row_ptr[row], b_end = right->row_ptr[row + 1];
+    double sign = (operation == 'S') ? -1.0 : 1.0;
+    size_t n = 0;
+
+    while (a < a_end || b < b_end)
+    {
+        int col;
+        double value;
+
+        if (b == b_end || (a < a_end && left->col_idx[a] < right->col_idx[b]))
+        {
+            col = left->col_idx[a];
+            value = left->values[a++];
+        }
+        else if (a == a_end || right->col_idx[b] < left->col_idx[a])
+        {
+            col = right->col_idx[b];
+            value = sign * right->values[b++];
+        }
+        else
+        {
+            col = left->col_idx[a];
+            value = left->values[a++] + sign * right->values[b++];
+        }
+
+        if (value != 0.0)
+        {
+            if (cols_out)
+            {
+                cols_out[n] = col;
+                values_out[n] = value;
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Phase 1 of sparse+sparse: store each merged row length in row_ptr[row + 1].
+ */
+static void *sparse_count_thread(void *arg)
+{
+    sparse_thread_arg_t *args = (sparse_thread_arg_t *)arg;
+    for (int r = args->row_begin; r < args->row_end; r++)
+    {
+        args->result->row_ptr[r + 1] = merge_sparse_row(args->left, args->right, r, args->operation, NULL, NULL);
+    }
+    return args;
+}
+
+/**
+ * @brief Phase 2 of sparse+sparse: write merged rows at their final offsets.
+ */
+static void *sparse_fill_thread(void *arg)
+{
+    sparse_thread_arg_t *args = (sparse_thread_arg_t *)arg;
+    matrix_t *result = args->result;
+    for (int r = args->row_begin; r < args->row_end; r++)
+    {
+        size_t offset = result->row_ptr[r];
+        merge_sparse_row(args->left, args->right, r, args->operation,
+                         &result->col_idx[offset], &result->values[offset]);
+    }
+    return args;
+}
+
+/**
+ * @brief Sparse with dense: copy the dense rows, then scatter the sparse entries.
+ */
+static void *sparse_dense_thread(void *arg)
+{
+    sparse_thread_arg_t *args = (sparse_thread_arg_t *)arg;
+    const matrix_t *sparse = args->left->row_ptr ? args->left : args->right;
+    const matrix_t *dense = args->left->row_ptr ? args->right : args->left;
+    int cols = dense->cols;
+
+    // left - right: negate whichever operand sits on the right
+    double dense_sign = (args->operation == 'S' && dense == args->right) ? -1.0 : 1.0;
+    double sparse_sign = (args->operation == 'S' && sparse == args->right) ? -1.0 : 1.0;
+
+    for (int r = args->row_begin; r < args->row_end; r++)
+    {
+        const double *src = &dense->data[(size_t)r * cols];
+        double *dst = &args->result->data[(size_t)r * cols];
+
+        for (int c = 0; c < cols; c++)
+        {
+            dst[c] = dense_sign * src[c];
+        }
+        for (size_t k = sparse->row_ptr[r]; k < sparse->row_ptr[r + 1]; k++)
+        {
+            dst[sparse->col_idx[k]] += sparse_sign * sparse->values[k];
+        }
+    }
+    return args;
+}
+
+/**
+ * @brief Add or subtract two same-shaped matrices when at least one is CSR.
+ *
+ * Sparse+sparse stays sparse and costs O(nnz): rows are merged in a count
+ * pass and a fill pass, both split across threads by nonzero count.
+ * Sparse+dense produces a dense result in a single parallel pass.
+ *
+ * @param left Left operand
+ * @param right Right operand
+ * @param operation 'A' for addition, 'S' for subtraction
+ * @return Newly allocated result or NULL on failure
+ */
+matrix_t *sparse_add_sub(const matrix_t *left, const matrix_t *right, char operation)
+{
+    if (!left->row_ptr || !right->row_ptr)
+    {
+        matrix_t *result = create_matrix(left->rows, left->cols);
+        if (!result)
+            return NULL;
+
+        if (run_row_partitioned(sparse_dense_thread, left, right, result, operation) == -1)
+        {
+            free_matrix(result);
+            return NULL;
+        }
+        return result;
+    }
+
+    matrix_t *result = create_sparse_matrix(left->rows, left->cols, 0);
+    if (!result)
+        return NULL;
+
+    if (run_row_partitioned(sparse_count_thread, left, right, result, operation) == -1)
+    {
+        free_matrix(result);
+        return NULL;
+    }
+
+    for (int r = 0; r < result->rows; r++)
+    {
+        result->row_ptr[r + 1] += result->row_ptr[r];
+    }
+    result->nnz = result->row_ptr[result->rows];
+
+    int *col_idx = realloc(result->col_idx, (result->nnz > 0 ? result->nnz : 1) * sizeof(int));
+    if (col_idx)
+        result->col_idx = col_idx;
+    double *values = realloc(result->values, (result->nnz > 0 ? result->nnz : 1) * sizeof(double));
+    if (values)
+        result->values = values;
+
+    if (!col_idx || !values ||
+        run_row_partitioned(sparse_fill_thread, left, right, result, operation) == -1)
+    {
+        free_matrix(result);
+        return NULL;
+    }
+    return result;
+}
@@ -0,0 +1,123 @@
+#include "../include/shell.h"
+
+// Session-lifetime list of named matrices, in definition order
+static named_matrix_t *store_head = NULL;
+
+/**
+ * @brief Find the link pointing at a named entry.
+ * @param name Variable name
+ * @return Address of the link to the entry, or of the list tail if not found
+ */
+static named_matrix_t **find_link(const char *name)
+{
+    named_matrix_t **link = &store_head;
+    while (*link && strcmp((*link)->name, name) != 0)
+    {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/**
+ * @brief Bind a name to a matrix, replacing any previous binding.
+ * @param name Variable name
+ * @param mat Matrix to store; the store takes over the caller's reference
+ * @return 0 on success, -1 on allocation failure
+ */
+int matrix_store_set(const char *name, matrix_t *mat)
+{
+    named_matrix_t **link = find_link(name);
+    if (*link)
+    {
+        free_matrix((*link)->mat);
+        (*link)->mat = mat;
+        return 0;
+    }
+
+    named_matrix_t *entry = malloc(sizeof(named_matrix_t));
+    if (!entry)
+        return -1;
+
+    entry->name = strdup(name);
+    if (!entry->name)
+    {
+        free(entry);
+        return -1;
+    }
+    entry->mat = mat;
+    entry->next = NULL;
+    *link = entry;
+    return 0;
+}
+
+/**
+ * @brief Look up a named matrix.
+ * @param name Variable name
+ * @return Stored matrix (borrowed; use retain_matrix to keep it) or NULL
+ */
+matrix_t *matrix_store_get(const char *name)
+{
+    named_matrix_t *entry = *find_link(name);
+    return entry ? entry->mat : NULL;
+}
+
+/**
+ * @brief Remove a binding and drop the store's reference to its matrix.
+ * @param name Variable name
+ * @return 0 on success, -1 if the name is not bound
+ */
+int matrix_store_remove(const char *name)
+{
+    named_matrix_t **link = find_link(name);
+    named_matrix_t *entry = *link;
+    if (!entry)
+        return -1;
+
+    *link = entry->next;
+    free_matrix(entry->mat);
+    free(entry->name);
+    free(entry);
+    return 0;
+}
+
+/**
+ * @brief Print every binding with its shape and memory footprint.
+ * @param out Output stream
+ */
+void matrix_store_list(FILE *out)
+{
+    size_t total = 0;
+
+    for (named_matrix_t *entry = store_head; entry; entry = entry->next)
+    {
+        const matrix_t *mat = entry->mat;
+        size_t bytes;
+
+        if (mat->row_ptr)
+        {
+            bytes = ((size_t)mat->rows + 1) * sizeof(size_t) + mat->nnz * (sizeof(int) + sizeof(double));
+            fprintf(out, "%s (%d,%d) %zu bytes sparse nnz=%zu\n", entry->name, mat->rows, mat->cols,
+                    bytes, mat->nnz);
+        }
+        else
+        {
+            bytes = (size_t)mat->rows * mat->cols * sizeof(double);
+            fprintf(out, "%s (%d,%d) %zu bytes%s\n", entry->name, mat->rows, mat->cols,
+                    bytes, mat->mapping ? " mapped" : "");
+        }
+        total += bytes;
+    }
+
+    fprintf(out, "total %zu bytes\n", total);
+}
+
+/**
+ * @brief Drop every binding (used at shell exit).
+ */
+void matrix_store_clear(void)
+{
+    while (store_head)
+    {
+        matrix_store_remove(store_head->name);
+    }
+}
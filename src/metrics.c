@@ -0,0 +1,395 @@
+#include "../include/shell.h"
+#include <poll.h>
+#include <sys/socket.h>
+
+/*
+ * Metrics export. A background thread serves the shell's counters, latency
+ * histogram, blacklist hit counts and job counts as Prometheus text or JSON,
+ * on an AF_UNIX socket (--metrics-socket) and/or in a file rewritten every
+ * METRICS_FILE_INTERVAL ms and replaced by rename() (--metrics-file).
+ *
+ * The shell thread never waits for a scraper: after each line it copies its
+ * statistics into a snapshot guarded by a sequence counter, and the metrics
+ * thread retries its read if the counter moved underneath it. Blacklist hits
+ * live in shared memory (dangerous_hits) and are read with atomic loads.
+ */
+
+static pthread_t metrics_thread;
+static int metrics_running = 0;
+static pid_t metrics_owner = 0; // Forked copies of the shell must not stop the owner's thread
+static int metrics_wake[2] = {-1, -1}; // metrics_stop() writes here to end the thread
+static int metrics_listen_fd = -1;
+static char *metrics_socket_path = NULL;
+static char *metrics_file_path = NULL;
+
+static command_stats_t snapshot;
+static unsigned int snapshot_seq = 0; // Odd while the shell thread is writing the snapshot
+
+/**
+ * @brief Publish the shell's statistics to the metrics thread
+ *
+ * Called by the shell thread after each line; it only copies the structure
+ * and never blocks.
+ *
+ * @param stats Current statistics
+ */
+void metrics_publish(const command_stats_t *stats)
+{
+    if (!metrics_running)
+        return;
+
+    __atomic_store_n(&snapshot_seq, snapshot_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&snapshot, stats, sizeof(snapshot));
+    __atomic_store_n(&snapshot_seq, snapshot_seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Take a consistent copy of the published statistics
+ * @param out Output: statistics as of the last completed metrics_publish()
+ */
+static void read_snapshot(command_stats_t *out)
+{
+    for (;;)
+    {
+        unsigned int before = __atomic_load_n(&snapshot_seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            sched_yield();
+            continue;
+        }
+
+        memcpy(out, &snapshot, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&snapshot_seq, __ATOMIC_RELAXED) == before)
+            return;
+    }
+}
+
+/**
+ * @brief Write a string as a quoted Prometheus label value or JSON string
+ * @param out Destination stream
+ * @param str String to quote
+ * @param json Also escape other control characters, as JSON requires
+ */
+static void write_quoted(FILE *out, const char *str, int json)
+{
+    fputc('"', out);
+    for (; *str; str++)
+    {
+        unsigned char c = (unsigned char)*str;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c == '\n')
+            fputs("\\n", out);
+        else if (json && c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief Format the current metrics in Prometheus text exposition format
+ * @param out Destination stream
+ * @param s Statistics snapshot
+ */
+static void format_prometheus(FILE *out, const command_stats_t *s)
+{
+    fprintf(out, "# HELP shell_commands_total Commands executed.\n# TYPE shell_commands_total counter\n"
+                 "shell_commands_total %d\n", s->cmds_count);
+    fprintf(out, "# HELP shell_commands_blocked_total Commands blocked as dangerous.\n"
+                 "# TYPE shell_commands_blocked_total counter\nshell_commands_blocked_total %d\n",
+            s->blocked_cmd_count);
+    fprintf(out, "# HELP shell_commands_warned_total Commands similar to a dangerous command.\n"
+                 "# TYPE shell_commands_warned_total counter\nshell_commands_warned_total %d\n",
+            s->unblocked_dangerous_cmds_count);
+    fprintf(out, "# HELP shell_limit_exceeded_total Commands stopped by limit.\n"
+                 "# TYPE shell_limit_exceeded_total counter\nshell_limit_exceeded_total %d\n",
+            s->limit_violations);
+    fprintf(out, "# HELP shell_background_jobs_total Pipelines started with '&'.\n"
+                 "# TYPE shell_background_jobs_total counter\nshell_background_jobs_total %d\n",
+            s->background_jobs);
+    fprintf(out, "# HELP shell_builtin_cache_hits_total Builtin calls answered from the result cache.\n"
+                 "# TYPE shell_builtin_cache_hits_total counter\nshell_builtin_cache_hits_total %d\n",
+            s->cache_hits);
+    fprintf(out, "# HELP shell_builtin_cache_misses_total Cacheable builtin calls that had to run.\n"
+                 "# TYPE shell_builtin_cache_misses_total counter\nshell_builtin_cache_misses_total %d\n",
+            s->cache_misses);
+    fprintf(out, "# HELP shell_builtin_cache_evictions_total Cached results dropped for the memory budget.\n"
+                 "# TYPE shell_builtin_cache_evictions_total counter\nshell_builtin_cache_evictions_total %d\n",
+            s->cache_evictions);
+    fprintf(out, "# HELP shell_parallel_jobs Worker limit set with -j.\n"
+                 "# TYPE shell_parallel_jobs gauge\nshell_parallel_jobs %d\n", batch_jobs);
+    fprintf(out, "# HELP shell_sessions_active Connected --serve sessions.\n"
+                 "# TYPE shell_sessions_active gauge\nshell_sessions_active %d\n",
+            __atomic_load_n(&server_sessions_active, __ATOMIC_RELAXED));
+
+    fprintf(out, "# HELP shell_command_duration_seconds Execution time of executed commands.\n"
+                 "# TYPE shell_command_duration_seconds histogram\n");
+    unsigned long cumulative = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        cumulative += s->latency_buckets[i];
+        if (i < LATENCY_BUCKETS - 1)
+            fprintf(out, "shell_command_duration_seconds_bucket{le=\"%g\"} %lu\n", latency_bucket_bounds[i],
+                    cumulative);
+        else
+            fprintf(out, "shell_command_duration_seconds_bucket{le=\"+Inf\"} %lu\n", cumulative);
+    }
+    fprintf(out, "shell_command_duration_seconds_sum %.6f\nshell_command_duration_seconds_count %lu\n",
+            s->total_time, cumulative);
+
+    if (!dangerous_hits)
+        return;
+
+    fprintf(out, "# HELP shell_blacklist_hits_total Matches per blacklist entry.\n"
+                 "# TYPE shell_blacklist_hits_total counter\n");
+    for (size_t i = 0; i < dangerous_cmds_count; i++)
+    {
+        for (int base = 0; base < 2; base++)
+        {
+            fputs("shell_blacklist_hits_total{command=", out);
+            write_quoted(out, dangerous_cmds[i], 0);
+            fprintf(out, ",match=\"%s\"} %lu\n", base ? "base" : "exact",
+                    __atomic_load_n(&dangerous_hits[i * 2 + base], __ATOMIC_RELAXED));
+        }
+    }
+}
+
+/**
+ * @brief Format the current metrics as one JSON object
+ * @param out Destination stream
+ * @param s Statistics snapshot
+ */
+static void format_json(FILE *out, const command_stats_t *s)
+{
+    int ran = s->cmds_count > 0;
+
+    fprintf(out, "{\"commands\": %d, \"blocked\": %d, \"warned\": %d, \"limit_exceeded\": %d, "
+                 "\"background_jobs\": %d, \"cache_hits\": %d, \"cache_misses\": %d, \"cache_evictions\": %d, "
+                 "\"parallel_jobs\": %d, \"sessions_active\": %d, "
+                 "\"total_time\": %.6f, \"avg_time\": %.6f, \"min_time\": %.6f, \"max_time\": %.6f",
+            s->cmds_count, s->blocked_cmd_count, s->unblocked_dangerous_cmds_count, s->limit_violations,
+            s->background_jobs, s->cache_hits, s->cache_misses, s->cache_evictions, batch_jobs, __atomic_load_n(&server_sessions_active, __ATOMIC_RELAXED),
+            s->total_time, ran ? s->avg_time : 0.0, ran ? s->min_time : 0.0, ran ? s->max_time : 0.0);
+
+    fputs(",\n \"latency_buckets\": [", out);
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        if (i < LATENCY_BUCKETS - 1)
+            fprintf(out, "%s{\"le\": %g, \"count\": %lu}", i ? ", " : "", latency_bucket_bounds[i],
+                    s->latency_buckets[i]);
+        else
+            fprintf(out, ", {\"le\": null, \"count\": %lu}", s->latency_buckets[i]);
+    }
+
+    fputs("],\n \"blacklist\": [", out);
+    for (size_t i = 0; dangerous_hits && i < dangerous_cmds_count; i++)
+    {
+        fputs(i ? ",\n  {\"command\": " : "\n  {\"command\": ", out);
+        write_quoted(out, dangerous_cmds[i], 1);
+        fprintf(out, ", \"exact\": %lu, \"base\": %lu}", __atomic_load_n(&dangerous_hits[i * 2], __ATOMIC_RELAXED),
+                __atomic_load_n(&dangerous_hits[i * 2 + 1], __ATOMIC_RELAXED));
+    }
+    fputs("]}\n", out);
+}
+
+/**
+ * @brief Render the current metrics into a heap buffer
+ * @param json JSON instead of Prometheus text
+ * @param len Output: length of the rendered text
+ * @return Malloc'd text, NULL on allocation failure
+ */
+static char *render_metrics(int json, size_t *len)
+{
+    command_stats_t s;
+    char *text = NULL;
+
+    read_snapshot(&s);
+    FILE *out = open_memstream(&text, len);
+    if (!out)
+        return NULL;
+
+    if (json)
+        format_json(out, &s);
+    else
+        format_prometheus(out, &s);
+    fclose(out);
+    return text;
+}
+
+/**
+ * @brief Answer one scraper on the metrics socket
+ *
+ * A client may send "json" first to get JSON; anything else, or nothing
+ * within 100 ms, gets Prometheus text.
+ *
+ * @param fd Accepted connection
+ */
+static void serve_scraper(int fd)
+{
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    char request[64] = "";
+    struct timeval timeout = {.tv_sec = 1};
+
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)); // a stuck client only stalls this thread
+    if (poll(&pfd, 1, 100) == 1)
+    {
+        ssize_t n = read(fd, request, sizeof(request) - 1);
+        request[n > 0 ? n : 0] = '\0';
+    }
+
+    size_t len;
+    char *text = render_metrics(strncmp(request, "json", 4) == 0, &len);
+    if (text)
+    {
+        write_all(fd, text, len);
+        free(text);
+    }
+    close(fd);
+}
+
+/**
+ * @brief Replace the metrics file atomically with the current metrics
+ */
+static void rewrite_metrics_file(void)
+{
+    size_t path_len = strlen(metrics_file_path), len;
+    int json = path_len >= 5 && strcmp(metrics_file_path + path_len - 5, ".json") == 0;
+    char *text = render_metrics(json, &len);
+    char *tmp_path = malloc(path_len + 5);
+    if (!text || !tmp_path)
+    {
+        free(text);
+        free(tmp_path);
+        return;
+    }
+
+    // Readers see either the old file or the new one, never a partial write
+    snprintf(tmp_path, path_len + 5, "%s.tmp", metrics_file_path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd != -1)
+    {
+        int written = write_all(fd, text, len) != -1;
+        close(fd);
+        if (!written || rename(tmp_path, metrics_file_path) == -1)
+            unlink(tmp_path);
+    }
+    free(tmp_path);
+    free(text);
+}
+
+/**
+ * @brief Metrics thread: serve the socket and rewrite the file until stopped
+ */
+static void *metrics_main(void *arg)
+{
+    (void)arg;
+    struct pollfd pfds[2] = {{.fd = metrics_wake[0], .events = POLLIN},
+                             {.fd = metrics_listen_fd, .events = POLLIN}};
+    int nfds = metrics_listen_fd >= 0 ? 2 : 1;
+    int timeout = metrics_file_path ? METRICS_FILE_INTERVAL : -1;
+
+    for (;;)
+    {
+        int ready = poll(pfds, nfds, timeout);
+        if (ready == -1 && errno != EINTR)
+            break;
+        if (ready > 0 && pfds[0].revents)
+            break;
+
+        if (ready > 0 && nfds == 2 && pfds[1].revents)
+        {
+            int fd;
+            while ((fd = accept4(metrics_listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0)
+                serve_scraper(fd);
+        }
+        if (ready == 0 && metrics_file_path)
+            rewrite_metrics_file();
+    }
+
+    // Leave the final numbers behind
+    if (metrics_file_path)
+        rewrite_metrics_file();
+    return NULL;
+}
+
+/**
+ * @brief Start serving metrics
+ * @param socket_path AF_UNIX socket to serve on, or NULL
+ * @param file_path File to rewrite periodically, or NULL
+ * @return 0 on success (or nothing requested), -1 on error
+ */
+int metrics_start(const char *socket_path, const char *file_path)
+{
+    if (!socket_path && !file_path)
+        return 0;
+
+    if (socket_path && (metrics_listen_fd = open_unix_listener(socket_path, SOMAXCONN)) == -1)
+        return -1;
+
+    if (pipe2(metrics_wake, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        metrics_stop();
+        return -1;
+    }
+    metrics_socket_path = socket_path ? strdup(socket_path) : NULL;
+    metrics_file_path = file_path ? strdup(file_path) : NULL;
+
+    // Signals stay with the shell thread
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    metrics_running = 1;
+    metrics_owner = getpid();
+    metrics_publish(&stats);
+    int error = pthread_create(&metrics_thread, NULL, metrics_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    if (error)
+    {
+        fprintf(stderr, "metrics: %s\n", strerror(error));
+        metrics_running = 0;
+        metrics_stop();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Stop the metrics thread, write the file one last time and remove the socket
+ */
+void metrics_stop(void)
+{
+    if (metrics_owner && metrics_owner != getpid())
+        return;
+
+    if (metrics_running)
+    {
+        metrics_publish(&stats);
+        if (write(metrics_wake[1], "", 1) == 1)
+            pthread_join(metrics_thread, NULL);
+        metrics_running = 0;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (metrics_wake[i] >= 0)
+            close(metrics_wake[i]);
+        metrics_wake[i] = -1;
+    }
+    if (metrics_listen_fd >= 0)
+    {
+        close(metrics_listen_fd);
+        metrics_listen_fd = -1;
+        if (metrics_socket_path)
+            unlink(metrics_socket_path);
+    }
+    free(metrics_socket_path);
+    free(metrics_file_path);
+    metrics_socket_path = metrics_file_path = NULL;
+    metrics_owner = 0;
+}
@@ -46,56 +46,101 @@ static int split_on_pipe(char *line, char **left_cmd, char **right_cmd)
     return 1;
 }
 
+static const struct
+{
+    const char *op;
+    redirect_type_t type;
+} redirect_ops[] = {
+    {"<", REDIRECT_IN},   {">", REDIRECT_OUT},           {">>", REDIRECT_APPEND},
+    {"2>", REDIRECT_ERR}, {"2>>", REDIRECT_ERR_APPEND}, {"2>&1", REDIRECT_ERR_TO_OUT},
+};
+
+/**
+ * @brief Check whether a token is a redirection operator
+ * @param token Token to check
+ * @param type Output: operator type
+ * @return 1 if it is one, 0 otherwise
+ */
+static int is_redirect_operator(const char *token, redirect_type_t *type)
+{
+    if (token[0] != '<' && token[0] != '>' && token[0] != '2')
+        return 0;
+
+    for (size_t i = 0; i < sizeof(redirect_ops) / sizeof(redirect_ops[0]); i++)
+    {
+        if (strcmp(token, redirect_ops[i].op) == 0)
+        {
+            *type = redirect_ops[i].type;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /**
  * @brief Parse a single command string into command structure
  * @param cmd_str Command string to parse
  * @param cmd Command structure to populate
+ * @param arena Line arena the arguments are written into
  * @return 0 on success, -1 on error
  */
-static int parse_single_command(const char *cmd_str, command_t *cmd)
+static int parse_single_command(const char *cmd_str, command_t *cmd, arena_chunk_t **arena)
 {
-    char *tokens[MAX_ARGS + 1]; // +1 for NULL terminator
-    char *cmd_copy = strdup(cmd_str);
-    if (!cmd_copy)
-    {
-        return -1;
-    }
-
-    int token_count = tokenize(cmd_copy, tokens, MAX_ARGS);
+    char **tokens;
+    unsigned char *globs;
+    int token_count = tokenize(cmd_str, arena, &tokens, &globs);
     if (token_count == -1)
     {
-        printf("ERR_ARGS\n");
-        fflush(stdout);
-        free(cmd_copy);
-        return -1;
-    }
-
-    cmd->stderr_file = NULL;
-    cmd->args = malloc((token_count + 1) * sizeof(char *));
-    if (!cmd->args)
-    {
-        free(cmd_copy);
+        perror("malloc");
         return -1;
     }
 
+    // The token vector becomes args; redirections are squeezed out in place
+    cmd->args = tokens;
+    cmd->globs = globs;
+    cmd->redirect_count = 0;
     int arg_index = 0;
 
     for (int i = 0; i < token_count; ++i)
     {
-        if (strcmp(tokens[i], "2>") == 0 && i + 1 < token_count)
+        redirect_type_t type;
+        if (!is_redirect_operator(tokens[i], &type))
         {
-            cmd->stderr_file = strdup(tokens[++i]);
+            if (globs)
+                globs[arg_index] = globs[i];
+            cmd->args[arg_index++] = tokens[i];
+            continue;
         }
-        else
+
+        const char *error = NULL;
+        if (cmd->redirect_count == MAX_REDIRECTIONS)
+            error = "too many redirections";
+        else if (type != REDIRECT_ERR_TO_OUT && i + 1 == token_count)
+            error = "missing file name";
+        if (error)
         {
-            cmd->args[arg_index++] = strdup(tokens[i]);
+            fprintf(stderr, "%s: %s\n", tokens[i], error);
+            free(tokens);
+            free(globs);
+            return -1;
         }
+
+        // Targets are taken as written; wildcards in them are not expanded
+        redirection_t *redirect = &cmd->redirects[cmd->redirect_count++];
+        redirect->type = type;
+        redirect->path = (type == REDIRECT_ERR_TO_OUT) ? NULL : tokens[++i];
+    }
+
+    if (arg_index == 0 && cmd->redirect_count > 0)
+    {
+        fprintf(stderr, "redirection: missing command\n");
+        free(tokens);
+        free(globs);
+        return -1;
     }
 
     cmd->args[arg_index] = NULL;
     cmd->argc = arg_index;
-
-    free(cmd_copy);
     return 0;
 }
 
@@ -136,8 +181,11 @@ pipeline_t *parse_line(const char *line)
     pipeline->cmd_count = has_pipe ? 2 : 1;
 
     // Step 4: Parse commands - check for errors
-    if (parse_single_command(left_cmd, &pipeline->commands[0]) == -1)
+    // Unexpanded, a command's tokens fit in its own length plus one byte
+    pipeline->arena = arena_new(strlen(line_copy) + (has_pipe ? strlen(right_cmd) : 0) + 2 + ARENA_SLACK);
+    if (!pipeline->arena || parse_single_command(left_cmd, &pipeline->commands[0], &pipeline->arena) == -1)
     {
+        arena_free(pipeline->arena);
         free(pipeline);
         free(line_copy);
         return NULL; // Error encountered
@@ -145,19 +193,12 @@ pipeline_t *parse_line(const char *line)
 
     if (has_pipe)
     {
-        if (parse_single_command(right_cmd, &pipeline->commands[1]) == -1)
+        if (parse_single_command(right_cmd, &pipeline->commands[1], &pipeline->arena) == -1)
         {
             // Clean up first command
-            command_t *cmd = &pipeline->commands[0];
-            for (int j = 0; j < cmd->argc; j++)
-            {
-                free(cmd->args[j]);
-            }
-            free(cmd->args);
-            if (cmd->stderr_file)
-            {
-                free(cmd->stderr_file);
-            }
+            free(pipeline->commands[0].args);
+            free(pipeline->commands[0].globs);
+            arena_free(pipeline->arena);
 
             free(pipeline);
             free(line_copy);
@@ -180,22 +221,11 @@ void free_pipeline(pipeline_t *pipeline)
 
     for (int i = 0; i < pipeline->cmd_count; i++)
     {
-        command_t *cmd = &pipeline->commands[i];
-
-        if (cmd->args)
-        {
-            for (int j = 0; j < cmd->argc; j++)
-            {
-                free(cmd->args[j]);
-            }
-            free(cmd->args);
-        }
-
-        if (cmd->stderr_file)
-        {
-            free(cmd->stderr_file);
-        }
+        // The arguments themselves live in the arena
+        free(pipeline->commands[i].args);
+        free(pipeline->commands[i].globs);
     }
 
+    arena_free(pipeline->arena);
     free(pipeline);
 }
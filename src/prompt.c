@@ -1,7 +1,263 @@
 #include "../include/shell.h"
 
-/* Prompt format string */
-#define PROMPT_FORMAT "#cmd:%d|#dangerous_cmd_blocked:%d|last_cmd_time:%.5f|avg_time:%.5f|min_time:%.5f|max_time:%.5f>> "
+/*
+ * Prompt rendering. The template (--prompt, or PROMPT_DEFAULT) is compiled
+ * once into literal and field segments, so fields the template does not use
+ * are never looked at. The rendered prompt is cached and rebuilt only when one
+ * of its fields changed; empty lines and unchanged statistics reuse it as is.
+ */
+
+static const struct
+{
+    const char *name;
+    prompt_field_t field;
+} prompt_fields[] = {
+    {"cmd", PROMPT_CMD},     {"blocked", PROMPT_BLOCKED}, {"warned", PROMPT_WARNED}, {"limit", PROMPT_LIMIT},
+    {"jobs", PROMPT_JOBS},   {"last", PROMPT_LAST},       {"avg", PROMPT_AVG},       {"min", PROMPT_MIN},
+    {"max", PROMPT_MAX},
+};
+
+static prompt_segment_t segments[PROMPT_MAX_SEGMENTS];
+static int segment_count = 0;
+static char *template_text = NULL; // Owned copy the literal segments point into
+static char *rendered = NULL;      // Cached prompt
+static size_t rendered_len = 0;
+static int rendered_valid = 0;
+
+/**
+ * @brief Append a segment to the compiled template
+ * @return 0 on success, -1 if the template has too many segments
+ */
+static int add_segment(prompt_field_t field, const char *text, size_t len)
+{
+    if (field == PROMPT_TEXT && len == 0)
+        return 0;
+    if (segment_count == PROMPT_MAX_SEGMENTS)
+    {
+        fprintf(stderr, "prompt: more than %d segments\n", PROMPT_MAX_SEGMENTS);
+        return -1;
+    }
+
+    segments[segment_count].field = field;
+    segments[segment_count].text = text;
+    segments[segment_count].len = len;
+    segments[segment_count].shown = 0.0;
+    segment_count++;
+    return 0;
+}
+
+/**
+ * @brief Compile a prompt template
+ *
+ * Fields are written as {cmd}, {blocked}, {warned}, {limit}, {jobs}, {last},
+ * {avg}, {min} and {max}; "{{" stands for a literal brace.
+ *
+ * @param template Template text
+ * @return 0 on success, -1 on an invalid template (the previous one is kept)
+ */
+int prompt_compile(const char *template)
+{
+    char *text = strdup(template);
+    if (!text)
+    {
+        perror("strdup");
+        return -1;
+    }
+
+    prompt_segment_t saved[PROMPT_MAX_SEGMENTS];
+    int saved_count = segment_count;
+    memcpy(saved, segments, sizeof(saved));
+    segment_count = 0;
+
+    const char *literal = text, *p = text;
+    size_t fixed_len = 0, field_count = 0;
+    int status = 0;
+    while (*p && status == 0)
+    {
+        if (*p != '{')
+        {
+            p++;
+            continue;
+        }
+
+        // "{{": the literal so far, including one brace
+        if (p[1] == '{')
+        {
+            status = add_segment(PROMPT_TEXT, literal, (size_t)(p + 1 - literal));
+            fixed_len += (size_t)(p + 1 - literal);
+            literal = p += 2;
+            continue;
+        }
+
+        const char *end = strchr(p, '}');
+        size_t name_len = end ? (size_t)(end - p - 1) : 0;
+        size_t i = 0;
+        while (end && i < sizeof(prompt_fields) / sizeof(prompt_fields[0]) &&
+               !(strlen(prompt_fields[i].name) == name_len && strncmp(prompt_fields[i].name, p + 1, name_len) == 0))
+            i++;
+        if (!end || i == sizeof(prompt_fields) / sizeof(prompt_fields[0]))
+        {
+            fprintf(stderr, "prompt: unknown field %.*s\n", end ? (int)(end - p + 1) : (int)strlen(p), p);
+            status = -1;
+            break;
+        }
+
+        status = add_segment(PROMPT_TEXT, literal, (size_t)(p - literal));
+        if (status == 0)
+            status = add_segment(prompt_fields[i].field, NULL, 0);
+        fixed_len += (size_t)(p - literal);
+        field_count++;
+        literal = p = end + 1;
+    }
+    if (status == 0)
+    {
+        status = add_segment(PROMPT_TEXT, literal, (size_t)(p - literal));
+        fixed_len += (size_t)(p - literal);
+    }
+
+    char *buffer = status == 0 ? malloc(fixed_len + field_count * PROMPT_FIELD_WIDTH + 1) : NULL;
+    if (status == 0 && !buffer)
+    {
+        perror("malloc");
+        status = -1;
+    }
+    if (status == -1)
+    {
+        memcpy(segments, saved, sizeof(saved));
+        segment_count = saved_count;
+        free(text);
+        return -1;
+    }
+
+    free(template_text);
+    free(rendered);
+    template_text = text;
+    rendered = buffer;
+    rendered_valid = 0;
+    return 0;
+}
+
+/**
+ * @brief Release the compiled template and the cached prompt
+ */
+void prompt_free(void)
+{
+    free(template_text);
+    free(rendered);
+    template_text = NULL;
+    rendered = NULL;
+    segment_count = 0;
+    rendered_valid = 0;
+}
+
+/**
+ * @brief Current value of a prompt field
+ * @param field Field to read
+ * @param stats Statistics to read it from
+ * @return Field value; times are 0 until a command has run
+ */
+static double field_value(prompt_field_t field, const command_stats_t *stats)
+{
+    int timed = stats->cmds_count > 0;
+
+    switch (field)
+    {
+    case PROMPT_CMD: return stats->cmds_count;
+    case PROMPT_BLOCKED: return stats->blocked_cmd_count;
+    case PROMPT_WARNED: return stats->unblocked_dangerous_cmds_count;
+    case PROMPT_LIMIT: return stats->limit_violations;
+    case PROMPT_JOBS: return stats->background_jobs;
+    case PROMPT_LAST: return timed ? stats->last_time : 0.0;
+    case PROMPT_AVG: return timed ? stats->avg_time : 0.0;
+    case PROMPT_MIN: return timed ? stats->min_time : 0.0;
+    case PROMPT_MAX: return timed ? stats->max_time : 0.0;
+    default: return 0.0;
+    }
+}
+
+/**
+ * @brief Write an unsigned integer in decimal
+ * @return Number of characters written
+ */
+static size_t format_uint(char *out, uint64_t value)
+{
+    char digits[20];
+    size_t n = 0;
+
+    do
+    {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    for (size_t i = 0; i < n; i++)
+        out[i] = digits[n - 1 - i];
+    return n;
+}
+
+/**
+ * @brief Write a value as printf("%.5f") would, without going through printf
+ *
+ * Values are scaled to integer units of 1e-5 and printed as two integers.
+ * Negative, huge and non-finite values, and values so close to a rounding
+ * tie that the scaled double cannot decide it, are left to snprintf().
+ *
+ * @return Number of characters written (at most PROMPT_FIELD_WIDTH)
+ */
+static size_t format_fixed5(char *out, double value)
+{
+    double scaled = value * 1e5;
+    if (!(value >= 0.0) || value >= 1e9 || fabs(scaled - floor(scaled) - 0.5) < 1e-6)
+    {
+        int n = snprintf(out, PROMPT_FIELD_WIDTH, "%.5f", value);
+        return n < PROMPT_FIELD_WIDTH ? (size_t)n : PROMPT_FIELD_WIDTH - 1;
+    }
+
+    uint64_t units = (uint64_t)(scaled + 0.5);
+    size_t n = format_uint(out, units / 100000);
+    out[n++] = '.';
+
+    uint64_t frac = units % 100000;
+    for (int i = 4; i >= 0; i--)
+    {
+        out[n + i] = (char)('0' + frac % 10);
+        frac /= 10;
+    }
+    return n + 5;
+}
+
+/**
+ * @brief Rebuild the cached prompt from the values recorded in the segments
+ */
+static void render_prompt(void)
+{
+    size_t pos = 0;
+
+    for (int i = 0; i < segment_count; i++)
+    {
+        const prompt_segment_t *seg = &segments[i];
+        switch (seg->field)
+        {
+        case PROMPT_TEXT:
+            memcpy(rendered + pos, seg->text, seg->len);
+            pos += seg->len;
+            break;
+        case PROMPT_LAST:
+        case PROMPT_AVG:
+        case PROMPT_MIN:
+        case PROMPT_MAX:
+            pos += format_fixed5(rendered + pos, seg->shown);
+            break;
+        default:
+            if (seg->shown < 0)
+                rendered[pos++] = '-';
+            pos += format_uint(rendered + pos, (uint64_t)fabs(seg->shown));
+            break;
+        }
+    }
+    rendered_len = pos;
+    rendered_valid = 1;
+}
 
 /**
  * @brief Display the shell prompt with command statistics
@@ -9,23 +265,25 @@
  */
 void display_prompt(command_stats_t *stats)
 {
-    double last = 0.0, avg = 0.0, min = 0.0, max = 0.0;
+    if (!rendered && prompt_compile(PROMPT_DEFAULT) == -1)
+        return;
 
-    // Only show stats if at least one command has been executed
-    if (stats->cmds_count > 0)
+    for (int i = 0; i < segment_count; i++)
     {
-        last = stats->last_time;
-        avg = stats->avg_time;
-        min = stats->min_time;
-        max = stats->max_time;
+        if (segments[i].field == PROMPT_TEXT)
+            continue;
+
+        double value = field_value(segments[i].field, stats);
+        if (value != segments[i].shown)
+        {
+            segments[i].shown = value;
+            rendered_valid = 0;
+        }
     }
+    if (!rendered_valid)
+        render_prompt();
 
-    printf(PROMPT_FORMAT,
-           stats->cmds_count,
-           stats->blocked_cmd_count,
-           last,
-           avg,
-           min,
-           max);
+    // Output still buffered by the last command goes first; fflush() is free when there is none
     fflush(stdout);
+    write_all(STDOUT_FILENO, rendered, rendered_len);
 }
@@ -1,61 +1,50 @@
 #include "../include/shell.h"
 
 /**
- * @brief Trim leading and trailing whitespace from a string
- * @param str String to trim (modified in place)
+ * @brief Trim leading and trailing whitespace without moving the text
+ * @param str String to trim (trailing whitespace is cut in place)
+ * @param len Length of str
+ * @return Pointer to the first non-whitespace character within str
  */
-static void trim_spaces(char *str)
+char *trim_spaces(char *str, size_t len)
 {
-    if (!str || !*str)
-        return;
-
-    // Trim leading
-    char *start = str;
-    while (isspace((unsigned char)*start))
+    size_t start = 0;
+    while (start < len && isspace((unsigned char)str[start]))
         start++;
 
-    // Move to start
-    if (start != str)
-        memmove(str, start, strlen(start) + 1);
+    while (len > start && isspace((unsigned char)str[len - 1]))
+        len--;
 
-    // Trim trailing
-    char *end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end))
-        end--;
-    *(end + 1) = '\0';
+    str[len] = '\0';
+    return str + start;
 }
 
 /**
- * @brief Read a line from input stream with proper handling
- * @param buffer Buffer to store the line
- * @param size Size of the buffer
+ * @brief Read a line of any length from input stream
+ *
+ * The line is read with getline() into *buffer, which grows as needed and is
+ * meant to be passed back in on the next call so its allocation is reused.
+ * The caller frees *buffer when done.
+ *
+ * @param buffer In/out: line buffer (may start as NULL)
+ * @param capacity In/out: allocated size of *buffer
  * @param stream Input stream to read from
- * @return Pointer to buffer on success, NULL on EOF or error
+ * @return Trimmed line (points into *buffer), or NULL on EOF or error
  */
-char *read_line(char *buffer, size_t size, FILE *stream)
+char *read_line(char **buffer, size_t *capacity, FILE *stream)
 {
-    if (!fgets(buffer, size, stream))
+    ssize_t len = getline(buffer, capacity, stream);
+    if (len < 0)
     {
         return NULL; // EOF or error
     }
 
     // Remove newline if present
-    char *newline = strchr(buffer, '\n');
-    if (newline)
-    {
-        *newline = '\0';
-    }
-    else
+    if (len > 0 && (*buffer)[len - 1] == '\n')
     {
-        // If we filled the buffer and there's no newline, flush the rest
-        int c;
-        while ((c = fgetc(stream)) != '\n' && c != EOF)
-        {
-            // Consume remaining characters
-        }
+        (*buffer)[--len] = '\0';
     }
 
     // Trim leading/trailing spaces
-    trim_spaces(buffer);
-    return buffer;
+    return trim_spaces(*buffer, (size_t)len);
 }
@@ -0,0 +1,163 @@
+#include "../include/shell.h"
+#include <sys/stat.h>
+
+/*
+ * Redirections (<, >, >>, 2>, 2>>, 2>&1). The files of a command are opened
+ * by the shell before the command starts, so the launcher, a forked child
+ * and an in-shell builtin all get the same descriptors and an unopenable
+ * file stops the command before anything runs. Operators apply left to
+ * right: "> f 2>&1" sends both streams to f, "2>&1 > f" only stdout.
+ *
+ * With --preallocate SIZE, a file truncated by > for a foreground command is
+ * given SIZE bytes with fallocate() before the command writes to it, so a
+ * large output is laid out in a few extents instead of growing block by
+ * block. Whatever the command did not use is released when it is done.
+ */
+
+long long redirect_preallocate = 0; // --preallocate: bytes reserved for each > file, 0 for none
+
+/**
+ * @brief Reserve redirect_preallocate bytes for an output file
+ * @param fd File just opened with O_TRUNC
+ * @return 1 if space was reserved, 0 otherwise (not a regular file, or unsupported)
+ */
+static int preallocate(int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return 0;
+    // KEEP_SIZE: the file still reads as empty until the command writes to it
+    return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)redirect_preallocate) == 0;
+}
+
+/**
+ * @brief Free the preallocated space a command did not write into
+ * @param fd Preallocated output file
+ */
+static void release_unused(int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || st.st_blksize <= 0)
+        return;
+
+    off_t used = (st.st_size + st.st_blksize - 1) / st.st_blksize * st.st_blksize;
+    // Truncating at the current end drops the blocks reserved past it
+    if ((off_t)st.st_blocks * 512 > used && ftruncate(fd, st.st_size) == -1)
+        perror("ftruncate");
+}
+
+/**
+ * @brief Open the files a command redirects to
+ * @param cmd Parsed command
+ * @param set Output: descriptors for the command's standard streams
+ * @param foreground Whether the shell waits for the command (only then are files preallocated)
+ * @return 0 on success, -1 if a file could not be opened (nothing is left open)
+ */
+int redirect_open(const command_t *cmd, redirect_set_t *set, int foreground)
+{
+    set->fds[0] = set->fds[1] = set->fds[2] = REDIRECT_KEEP;
+    set->opened_count = 0;
+
+    for (int i = 0; i < cmd->redirect_count; i++)
+    {
+        const redirection_t *r = &cmd->redirects[i];
+        int stream, flags;
+
+        switch (r->type)
+        {
+        case REDIRECT_IN:
+            stream = STDIN_FILENO;
+            flags = O_RDONLY;
+            break;
+        case REDIRECT_OUT:
+            stream = STDOUT_FILENO;
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+        case REDIRECT_APPEND:
+            stream = STDOUT_FILENO;
+            flags = O_WRONLY | O_CREAT | O_APPEND;
+            break;
+        case REDIRECT_ERR:
+            stream = STDERR_FILENO;
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+        case REDIRECT_ERR_APPEND:
+            stream = STDERR_FILENO;
+            flags = O_WRONLY | O_CREAT | O_APPEND;
+            break;
+        default:
+            // 2>&1: wherever stdout points so far
+            set->fds[STDERR_FILENO] = set->fds[STDOUT_FILENO] == REDIRECT_KEEP ? REDIRECT_STDOUT : set->fds[STDOUT_FILENO];
+            continue;
+        }
+
+        int fd = open(r->path, flags | O_CLOEXEC, DEFAULT_FILE_PERMISSIONS);
+        if (fd == -1)
+        {
+            perror(r->path);
+            redirect_close(set);
+            return -1;
+        }
+
+        // Appended files may have other writers, so only > targets are preallocated
+        set->trim[set->opened_count] = r->type == REDIRECT_OUT && foreground && redirect_preallocate > 0 && preallocate(fd);
+        set->opened[set->opened_count++] = fd;
+        set->fds[stream] = fd;
+    }
+    return 0;
+}
+
+/**
+ * @brief Work out the descriptors a command runs with
+ * @param set Redirections from redirect_open()
+ * @param fds On entry, the streams the command would get without redirections
+ *            (pipe ends or the shell's own); on return, the ones it gets
+ */
+void redirect_resolve(const redirect_set_t *set, int fds[3])
+{
+    int out_fd = fds[STDOUT_FILENO];
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (set->fds[i] == REDIRECT_STDOUT)
+            fds[i] = out_fd;
+        else if (set->fds[i] != REDIRECT_KEEP)
+            fds[i] = set->fds[i];
+    }
+}
+
+/**
+ * @brief Child side: point the standard descriptors at the redirection targets
+ *
+ * stderr goes first, since 2>&1 may refer to the stdout that a later > replaces.
+ *
+ * @param set Redirections from redirect_open()
+ */
+void redirect_apply(const redirect_set_t *set)
+{
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    redirect_resolve(set, fds);
+
+    for (int i = STDERR_FILENO; i >= STDIN_FILENO; i--)
+    {
+        if (fds[i] != i)
+            dup2(fds[i], i);
+    }
+}
+
+/**
+ * @brief Close the files of redirect_open(), releasing unused preallocated space
+ * @param set Redirections from redirect_open()
+ */
+void redirect_close(redirect_set_t *set)
+{
+    for (int i = 0; i < set->opened_count; i++)
+    {
+        if (set->trim[i])
+            release_unused(set->opened[i]);
+        close(set->opened[i]);
+    }
+    set->opened_count = 0;
+}
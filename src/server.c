@@ -0,0 +1,723 @@
+#include "../include/shell.h"
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * --serve daemon. One process accepts client sessions on an AF_UNIX socket
+ * and multiplexes them with epoll. Each session executes its lines in
+ * order, one at a time: ordinary lines run in a forked worker, and the
+ * worker reports its statistics through a pipe watched by the same epoll
+ * loop. Lines that change shell state (cd, mcalc let/free) run in the
+ * daemon itself. The blacklist, the named matrices and the log are shared
+ * by all sessions.
+ *
+ * The daemon never blocks on a client. Client sockets are non-blocking;
+ * workers write to a per-session output pipe, and the daemon forwards what
+ * the client is ready to take. Output of lines run in the daemon is caught
+ * in a memfd and queued behind it. A client that stops reading fills the
+ * pipe and stalls only its own worker.
+ */
+
+/* epoll data: generation << 32 | session slot << 2 | descriptor kind, or one of the fixed tags */
+#define TAG_CLIENT 0
+#define TAG_RESULT 1
+#define TAG_OUTPUT 2
+#define TAG_LISTEN UINT64_MAX
+#define TAG_SIGNAL (UINT64_MAX - 1)
+#define TAG_SLOT(tag) ((int)(((tag) >> 2) & 0x3fffffff))
+
+static server_session_t **sessions = NULL;
+int server_sessions_active = 0; // Connected sessions, reported by the metrics endpoint
+static int session_cap = 0;
+static uint32_t next_generation = 0;
+static int epoll_fd = -1;
+static int listen_fd = -1;
+static int signal_fd = -1;
+static int capture_fd = -1; // memfd catching the output of lines run in the daemon
+static sigset_t saved_mask;
+
+/**
+ * @brief Register a descriptor with the epoll loop.
+ * @return 0 on success, -1 on error
+ */
+static int watch_fd(int fd, uint64_t tag)
+{
+    struct epoll_event event = {.events = EPOLLIN, .data.u64 = tag};
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/**
+ * @brief epoll tag of one of a session's descriptors.
+ */
+static uint64_t session_tag(int slot, int kind)
+{
+    return (uint64_t)sessions[slot]->generation << 32 | (uint64_t)slot << 2 | kind;
+}
+
+/**
+ * @brief Tear a session down, stopping its worker if one is still running.
+ * @param slot Session slot
+ */
+static void close_session(int slot)
+{
+    server_session_t *s = sessions[slot];
+
+    if (s->worker > 0)
+    {
+        kill(s->worker, SIGTERM);
+        waitpid(s->worker, NULL, 0);
+    }
+    if (s->result_fd >= 0)
+        close(s->result_fd);
+    if (s->output_fd >= 0)
+        close(s->output_fd);
+    if (s->output_write >= 0)
+        close(s->output_write);
+    shutdown(s->fd, SHUT_RDWR); // ends the connection even if a copy of the socket is still open
+    close(s->fd);
+
+    free(s->line);
+    free(s->cwd);
+    free(s->input);
+    free(s->output);
+    free(s);
+    sessions[slot] = NULL;
+    server_sessions_active--;
+}
+
+/**
+ * @brief Point the session's epoll registrations at what it can make progress on.
+ *
+ * The client is watched for input until it shuts its side down and for
+ * room while output is queued; the output pipe is read only when the
+ * queue is empty, so a slow client holds its worker back, not the daemon.
+ *
+ * @param slot Session slot
+ */
+static void update_watches(int slot)
+{
+    server_session_t *s = sessions[slot];
+    struct epoll_event event = {.events = 0, .data.u64 = session_tag(slot, TAG_CLIENT)};
+
+    if (!s->eof)
+        event.events |= EPOLLIN;
+    if (s->output_len > 0)
+        event.events |= EPOLLOUT;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s->fd, &event);
+
+    if (s->output_fd >= 0)
+    {
+        struct epoll_event output = {.events = s->output_len > 0 ? 0 : EPOLLIN,
+                                     .data.u64 = session_tag(slot, TAG_OUTPUT)};
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s->output_fd, &output);
+    }
+}
+
+/**
+ * @brief Make room for n more bytes of queued output.
+ * @return 0 on success, -1 on allocation failure
+ */
+static int reserve_output(server_session_t *s, size_t n)
+{
+    if (s->output_cap - s->output_len >= n)
+        return 0;
+
+    size_t cap = s->output_cap ? s->output_cap : SERVER_READ_SIZE;
+    while (cap - s->output_len < n)
+        cap *= 2;
+    char *grown = realloc(s->output, cap);
+    if (!grown)
+        return -1;
+    s->output = grown;
+    s->output_cap = cap;
+    return 0;
+}
+
+/**
+ * @brief Send queued output for as long as the client takes it.
+ * @param slot Session slot
+ * @return 0 if the session is still open, -1 if it was closed
+ */
+static int flush_output(int slot)
+{
+    server_session_t *s = sessions[slot];
+    size_t sent = 0;
+
+    while (sent < s->output_len)
+    {
+        ssize_t n = send(s->fd, s->output + sent, s->output_len - sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            close_session(slot); // the client went away
+            return -1;
+        }
+        sent += n;
+    }
+    if (sent > 0)
+    {
+        memmove(s->output, s->output + sent, s->output_len - sent);
+        s->output_len -= sent;
+    }
+
+    // Closing, and everything the workers wrote has been delivered
+    if (s->output_fd == -1 && s->output_len == 0)
+    {
+        close_session(slot);
+        return -1;
+    }
+    update_watches(slot);
+    return 0;
+}
+
+/**
+ * @brief Move what the workers wrote from the output pipe to the queue.
+ * @param slot Session slot
+ * @param all Read until the pipe is empty rather than one chunk
+ * @return 0 on success, -1 on allocation failure
+ */
+static int collect_output(int slot, int all)
+{
+    server_session_t *s = sessions[slot];
+
+    while (s->output_fd >= 0)
+    {
+        if (reserve_output(s, SERVER_READ_SIZE) == -1)
+            return -1;
+
+        ssize_t n = read(s->output_fd, s->output + s->output_len, SERVER_READ_SIZE);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break; // EAGAIN: nothing more for now
+        }
+        if (n == 0)
+        {
+            // Every writer is gone: the session was closing
+            close(s->output_fd);
+            s->output_fd = -1;
+            break;
+        }
+        s->output_len += n;
+        if (!all)
+            break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Stop taking lines and close once the output already written is delivered.
+ * @param slot Session slot
+ */
+static void finish_session(int slot)
+{
+    server_session_t *s = sessions[slot];
+
+    s->eof = 1;
+    s->input_len = 0;
+    if (s->output_write >= 0)
+    {
+        close(s->output_write); // background jobs may still hold it
+        s->output_write = -1;
+    }
+    flush_output(slot);
+}
+
+/**
+ * @brief Accept a client and give it a fresh session.
+ * @param root Working directory new sessions start in
+ */
+static void accept_session(const char *root)
+{
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1)
+    {
+        if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED)
+            perror("accept");
+        return;
+    }
+
+    int slot = 0;
+    while (slot < session_cap && sessions[slot])
+        slot++;
+
+    if (slot == session_cap)
+    {
+        int cap = session_cap ? session_cap * 2 : 64;
+        server_session_t **grown = realloc(sessions, cap * sizeof(*grown));
+        if (!grown)
+        {
+            close(fd);
+            return;
+        }
+        memset(grown + session_cap, 0, (cap - session_cap) * sizeof(*grown));
+        sessions = grown;
+        session_cap = cap;
+    }
+
+    server_session_t *s = calloc(1, sizeof(*s));
+    int output_pipe[2];
+    if (!s || !(s->cwd = strdup(root)))
+    {
+        free(s);
+        close(fd);
+        return;
+    }
+    if (pipe2(output_pipe, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        free(s->cwd);
+        free(s);
+        close(fd);
+        return;
+    }
+    fcntl(output_pipe[0], F_SETFL, O_NONBLOCK);
+
+    s->fd = fd;
+    s->generation = ++next_generation;
+    s->result_fd = -1;
+    s->output_fd = output_pipe[0];
+    s->output_write = output_pipe[1];
+    s->stats.min_time = DBL_MAX;
+    sessions[slot] = s;
+    server_sessions_active++;
+
+    if (watch_fd(fd, session_tag(slot, TAG_CLIENT)) == -1 ||
+        watch_fd(s->output_fd, session_tag(slot, TAG_OUTPUT)) == -1)
+    {
+        perror("epoll_ctl");
+        close_session(slot);
+    }
+}
+
+/**
+ * @brief Apply a finished line to the session and the daemon-wide statistics.
+ */
+static void account_line(server_session_t *s, const batch_result_t *result)
+{
+    apply_line_result(&s->stats, s->line, result); // also writes the shared log
+
+    stats.blocked_cmd_count += result->blocked;
+    stats.unblocked_dangerous_cmds_count += result->warned;
+    stats.limit_violations += (result->limit_reason[0] != '\0');
+    stats.background_jobs += result->background;
+    stats.cache_hits += result->cache_hits;
+    stats.cache_misses += result->cache_misses;
+    stats.cache_evictions += result->cache_evictions;
+    if (result->executed)
+    {
+        ++stats.cmds_count;
+        update_command_stats(&stats, result->elapsed);
+    }
+    metrics_publish(&stats);
+    stats_shm_sync(&stats);
+
+    free(s->line);
+    s->line = NULL;
+}
+
+/**
+ * @brief Run a state-changing line inside the daemon, queueing its output for the client.
+ * @param slot Session slot
+ * @return 0 on success, -1 on allocation failure
+ */
+static int run_in_daemon(int slot)
+{
+    server_session_t *s = sessions[slot];
+    batch_result_t result = {0};
+
+    // The previous line's worker has exited: its output goes out first
+    if (collect_output(slot, 1) == -1)
+        return -1;
+
+    fflush(stdout);
+    int saved_out = dup(STDOUT_FILENO), saved_err = dup(STDERR_FILENO);
+    dup2(capture_fd, STDOUT_FILENO);
+    dup2(capture_fd, STDERR_FILENO);
+
+    if (chdir(s->cwd) == -1)
+        fprintf(stderr, "cd: %s: %s\n", s->cwd, strerror(errno));
+    else
+        execute_line_unlogged(s->line, &result);
+
+    fflush(stdout);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    off_t len = lseek(capture_fd, 0, SEEK_CUR);
+    if (len > 0 && reserve_output(s, (size_t)len) == 0 &&
+        pread(capture_fd, s->output + s->output_len, (size_t)len, 0) == len)
+        s->output_len += (size_t)len;
+    if (ftruncate(capture_fd, 0) == -1 || lseek(capture_fd, 0, SEEK_SET) == -1)
+        perror("memfd");
+
+    // Pick up the new directory after cd
+    char *cwd = getcwd(NULL, 0);
+    if (cwd)
+    {
+        free(s->cwd);
+        s->cwd = cwd;
+    }
+
+    account_line(s, &result);
+    return 0;
+}
+
+/**
+ * @brief Start a worker for the session's current line.
+ * @return 0 on success, -1 on error
+ */
+static int start_worker(int slot)
+{
+    server_session_t *s = sessions[slot];
+    int result_pipe[2];
+
+    if (pipe2(result_pipe, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        batch_result_t result = {0};
+
+        close(result_pipe[0]);
+        sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+
+        // Keep only this session's output pipe: a copy of another session's
+        // socket or pipe would hold its client open until this line is done
+        for (int i = 0; i < session_cap; i++)
+        {
+            if (!sessions[i])
+                continue;
+            close(sessions[i]->fd);
+            if (sessions[i]->output_fd >= 0)
+                close(sessions[i]->output_fd);
+            if (sessions[i]->result_fd >= 0)
+                close(sessions[i]->result_fd);
+            if (i != slot && sessions[i]->output_write >= 0)
+                close(sessions[i]->output_write);
+        }
+        close(epoll_fd);
+        close(listen_fd);
+        close(signal_fd);
+        close(capture_fd);
+        signal(SIGPIPE, SIG_DFL);
+
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0)
+            dup2(null_fd, STDIN_FILENO);
+        dup2(s->output_write, STDOUT_FILENO);
+        dup2(s->output_write, STDERR_FILENO);
+
+        if (chdir(s->cwd) == -1)
+        {
+            fprintf(stderr, "cd: %s: %s\n", s->cwd, strerror(errno));
+            _exit(1);
+        }
+
+        execute_line_unlogged(s->line, &result);
+        write_all(result_pipe[1], &result, sizeof(result));
+        _exit(0);
+    }
+
+    close(result_pipe[1]);
+    if (pid < 0)
+    {
+        perror("fork");
+        close(result_pipe[0]);
+        return -1;
+    }
+
+    s->worker = pid;
+    s->result_fd = result_pipe[0];
+    if (watch_fd(s->result_fd, session_tag(slot, TAG_RESULT)) == -1)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Execute the session's buffered lines until one needs a worker.
+ * @param slot Session slot
+ */
+static void advance_session(int slot)
+{
+    server_session_t *s = sessions[slot];
+
+    while (s->worker == 0)
+    {
+        char *newline = s->input_len ? memchr(s->input, '\n', s->input_len) : NULL;
+        if (!newline && !(s->eof && s->input_len > 0))
+        {
+            if (s->eof)
+                finish_session(slot); // all input executed
+            else
+                flush_output(slot);
+            return;
+        }
+
+        size_t len = newline ? (size_t)(newline - s->input) : s->input_len;
+        size_t consumed = newline ? len + 1 : len;
+
+        char *text = malloc(len + 1);
+        if (!text)
+        {
+            close_session(slot);
+            return;
+        }
+        memcpy(text, s->input, len);
+        memmove(s->input, s->input + consumed, s->input_len - consumed);
+        s->input_len -= consumed;
+
+        char *line = trim_spaces(text, len);
+        size_t word = strcspn(line, " \t");
+        if (*line == '\0')
+        {
+            free(text);
+            continue;
+        }
+        if (word == 4 && strncmp(line, "exit", 4) == 0)
+        {
+            free(text);
+            finish_session(slot); // ends the session, not the daemon
+            return;
+        }
+
+        s->line = strdup(line);
+        free(text);
+        if (!s->line)
+        {
+            close_session(slot);
+            return;
+        }
+
+        if (is_barrier_line(s->line))
+        {
+            if (run_in_daemon(slot) == -1)
+            {
+                close_session(slot);
+                return;
+            }
+        }
+        else if (start_worker(slot) == -1)
+        {
+            close_session(slot);
+            return;
+        }
+    }
+    flush_output(slot); // what lines run in the daemon printed before the worker started
+}
+
+/**
+ * @brief Take in bytes from a client and run what is complete.
+ * @param slot Session slot
+ */
+static void read_session(int slot)
+{
+    server_session_t *s = sessions[slot];
+
+    if (s->input_cap - s->input_len < SERVER_READ_SIZE)
+    {
+        size_t cap = s->input_cap ? s->input_cap * 2 : SERVER_READ_SIZE * 2;
+        char *grown = realloc(s->input, cap);
+        if (!grown)
+        {
+            close_session(slot);
+            return;
+        }
+        s->input = grown;
+        s->input_cap = cap;
+    }
+
+    ssize_t n = read(s->fd, s->input + s->input_len, s->input_cap - s->input_len);
+    if (n < 0)
+    {
+        if (errno != EINTR && errno != EAGAIN)
+            close_session(slot);
+        return;
+    }
+
+    if (n == 0)
+    {
+        // Half-closed: finish the queued lines, then close
+        s->eof = 1;
+        update_watches(slot);
+    }
+    s->input_len += n;
+
+    advance_session(slot);
+}
+
+/**
+ * @brief Collect a finished worker's result and move the session on.
+ * @param slot Session slot
+ */
+static void finish_worker(int slot)
+{
+    server_session_t *s = sessions[slot];
+    batch_result_t result = {0};
+
+    // A worker that died without reporting counts as not executed
+    if (read(s->result_fd, &result, sizeof(result)) != (ssize_t)sizeof(result))
+        memset(&result, 0, sizeof(result));
+
+    close(s->result_fd);
+    s->result_fd = -1;
+    waitpid(s->worker, NULL, 0); // it exits right after reporting
+    s->worker = 0;
+    account_line(s, &result);
+
+    advance_session(slot);
+}
+
+/**
+ * @brief Serve shell sessions on a Unix domain socket until SIGINT or SIGTERM.
+ * @param socket_path Filesystem path of the socket
+ * @return 0 on clean shutdown, -1 on setup failure
+ */
+int run_server(const char *socket_path)
+{
+    char *root = getcwd(NULL, 0);
+    if (!root)
+    {
+        perror("getcwd");
+        return -1;
+    }
+
+    listen_fd = open_unix_listener(socket_path, SERVER_BACKLOG);
+    if (listen_fd == -1)
+    {
+        free(root);
+        return -1;
+    }
+
+    // Shutdown signals arrive through the event loop; workers are reaped
+    // by the session that started them, not by the SIGCHLD handler
+    sigset_t shutdown_set, block_set;
+    sigemptyset(&shutdown_set);
+    sigaddset(&shutdown_set, SIGINT);
+    sigaddset(&shutdown_set, SIGTERM);
+    block_set = shutdown_set;
+    sigaddset(&block_set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block_set, &saved_mask);
+    signal_fd = signalfd(-1, &shutdown_set, SFD_CLOEXEC);
+
+    signal(SIGPIPE, SIG_IGN); // a vanished client must not kill the daemon
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    capture_fd = memfd_create("serve-output", MFD_CLOEXEC);
+    if (epoll_fd == -1 || signal_fd == -1 || capture_fd == -1 || watch_fd(listen_fd, TAG_LISTEN) == -1 ||
+        watch_fd(signal_fd, TAG_SIGNAL) == -1)
+    {
+        perror("serve");
+        close(listen_fd);
+        unlink(socket_path);
+        sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+        free(root);
+        return -1;
+    }
+
+    fprintf(stderr, "serving on %s\n", socket_path);
+
+    int running = 1;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (running)
+    {
+        int n = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            uint64_t tag = events[i].data.u64;
+            if (tag == TAG_LISTEN)
+            {
+                accept_session(root);
+                continue;
+            }
+            if (tag == TAG_SIGNAL)
+            {
+                // Consume it so it is not delivered once unblocked
+                struct signalfd_siginfo info;
+                if (read(signal_fd, &info, sizeof(info)) == -1)
+                    perror("signalfd");
+                running = 0;
+                continue;
+            }
+
+            // Skip sessions closed earlier in this batch of events, even if
+            // a new session has taken over the slot since
+            int slot = TAG_SLOT(tag);
+            if (slot >= session_cap || !sessions[slot] || sessions[slot]->generation != (uint32_t)(tag >> 32))
+                continue;
+
+            uint32_t ready = events[i].events;
+            switch (tag & 3)
+            {
+            case TAG_RESULT:
+                finish_worker(slot);
+                break;
+            case TAG_OUTPUT:
+                if (collect_output(slot, 0) == -1)
+                    close_session(slot);
+                else
+                    flush_output(slot);
+                break;
+            default:
+                if (ready & EPOLLIN)
+                    read_session(slot);
+                else if (ready & (EPOLLHUP | EPOLLERR))
+                    close_session(slot); // nobody left to read the output
+                else
+                    flush_output(slot);
+                break;
+            }
+        }
+    }
+
+    for (int slot = 0; slot < session_cap; slot++)
+    {
+        if (sessions[slot])
+            close_session(slot);
+    }
+    free(sessions);
+    sessions = NULL;
+    session_cap = 0;
+
+    close(epoll_fd);
+    close(capture_fd);
+    capture_fd = -1;
+    close(signal_fd);
+    close(listen_fd);
+    signal_fd = listen_fd = -1;
+    unlink(socket_path);
+    sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+    if (chdir(root) == -1)
+        perror("chdir");
+    free(root);
+
+    print_stats_summary(stderr, &stats);
+    return 0;
+}
@@ -1,5 +1,10 @@
 #include "../include/shell.h"
 
+/* Upper bounds (seconds) of the latency histogram buckets; the last bucket has none */
+const double latency_bucket_bounds[LATENCY_BUCKETS - 1] = {
+    25e-6, 50e-6, 100e-6, 250e-6, 500e-6, 1e-3, 2.5e-3, 5e-3, 10e-3,
+    25e-3, 50e-3, 100e-3, 250e-3, 500e-3, 1.0, 2.5, 5.0, 10.0};
+
 /**
  * Updates command execution statistics
  *
@@ -21,4 +26,40 @@ void update_command_stats(command_stats_t *stats, double elapsed_time)
     {
         stats->max_time = elapsed_time;
     }
+
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && elapsed_time > latency_bucket_bounds[bucket])
+    {
+        bucket++;
+    }
+    stats->latency_buckets[bucket]++;
+}
+
+/**
+ * Prints the end-of-run statistics summary used by batch mode
+ *
+ * @param out Destination stream
+ * @param stats Pointer to statistics structure
+ */
+void print_stats_summary(FILE *out, const command_stats_t *stats)
+{
+    int ran = stats->cmds_count > 0;
+
+    fprintf(out, "commands: %d | blocked: %d | warned: %d | limit_exceeded: %d | total_time: %.5f | avg_time: %.5f | min_time: %.5f | max_time: %.5f",
+            stats->cmds_count,
+            stats->blocked_cmd_count,
+            stats->unblocked_dangerous_cmds_count,
+            stats->limit_violations,
+            stats->total_time,
+            ran ? stats->avg_time : 0.0,
+            ran ? stats->min_time : 0.0,
+            ran ? stats->max_time : 0.0);
+
+    // Only shells running with --builtin-cache have anything to report here
+    if (stats->cache_hits || stats->cache_misses)
+    {
+        fprintf(out, " | cache_hits: %d | cache_misses: %d | cache_evictions: %d",
+                stats->cache_hits, stats->cache_misses, stats->cache_evictions);
+    }
+    fputc('\n', out);
 }
@@ -0,0 +1,220 @@
+#include "../include/shell.h"
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Host-wide statistics segment (--stats-shm). Every shell instance claims a
+ * cache-line aligned slot in a shared memory object and adds its counters to
+ * it as lines finish; shellstat maps the same object and sums the slots
+ * without taking any lock. An instance that exits folds its slot into the
+ * segment's "retired" totals and frees the slot; slots left behind by
+ * instances that died are taken over by the next instance that needs one.
+ */
+
+static stats_shm_t *segment = NULL;
+static stats_slot_t *own_slot = NULL;
+static pid_t slot_owner = 0;         // Forked copies of the shell must not release the slot
+static command_stats_t synced;       // Statistics already added to the slot
+static uint64_t synced_time_ns = 0;  // synced.total_time as added, in nanoseconds
+
+/**
+ * @brief Map the statistics segment, creating and initializing it if needed
+ * @param name shm_open() name of the segment
+ * @param writable Map read-write (shell instances) or read-only (shellstat)
+ * @return Mapped segment, NULL on error (errno set)
+ */
+stats_shm_t *stats_shm_map(const char *name, int writable)
+{
+    int fd = shm_open(name, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return NULL;
+
+    // Every instance sizes the object the same way, so racing creators agree
+    struct stat st;
+    if ((writable && ftruncate(fd, sizeof(stats_shm_t)) == -1) || fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(stats_shm_t))
+    {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    stats_shm_t *shm = mmap(NULL, sizeof(stats_shm_t), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                            fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+        return NULL;
+
+    if (writable)
+    {
+        shm->version = STATS_SHM_VERSION;
+        shm->slot_count = STATS_SHM_SLOTS;
+        shm->slot_size = sizeof(stats_slot_t);
+        __atomic_store_n(&shm->magic, STATS_SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+    else if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != STATS_SHM_MAGIC ||
+             shm->version != STATS_SHM_VERSION || shm->slot_size != sizeof(stats_slot_t))
+    {
+        munmap(shm, sizeof(stats_shm_t));
+        errno = EPROTO;
+        return NULL;
+    }
+    return shm;
+}
+
+/**
+ * @brief Check whether the process owning a slot is still running
+ * @param pid Slot owner
+ * @return 1 if it is alive (or cannot be checked), 0 if it is gone
+ */
+int stats_slot_alive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+/**
+ * @brief Add one slot's counters to another
+ * @param dst Slot to add to (atomically)
+ * @param src Slot to read from
+ */
+void stats_slot_add(stats_slot_t *dst, const stats_slot_t *src)
+{
+    const uint64_t *from = &src->commands;
+    uint64_t *to = &dst->commands;
+
+    // commands .. latency_buckets are consecutive uint64_t counters
+    size_t count = (sizeof(stats_slot_t) - offsetof(stats_slot_t, commands)) / sizeof(uint64_t);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t value = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+        if (value)
+            __atomic_fetch_add(&to[i], value, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Fold a slot into the retired totals and clear its counters
+ * @param slot Slot held by the caller (pid negative)
+ */
+static void retire_slot(stats_slot_t *slot)
+{
+    stats_slot_add(&segment->retired, slot);
+    memset(&slot->started, 0, sizeof(stats_slot_t) - offsetof(stats_slot_t, started));
+}
+
+/**
+ * @brief Join the host-wide statistics segment
+ * @param name shm_open() name of the segment
+ * @return 0 on success, -1 on error
+ */
+int stats_shm_attach(const char *name)
+{
+    segment = stats_shm_map(name, 1);
+    if (!segment)
+    {
+        perror("stats-shm");
+        return -1;
+    }
+
+    int32_t self = (int32_t)getpid();
+    for (int i = 0; i < STATS_SHM_SLOTS && !own_slot; i++)
+    {
+        stats_slot_t *slot = &segment->slots[i];
+        int32_t pid = __atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE);
+
+        // A free slot, or one whose owner died without releasing it (even mid-claim)
+        if (pid != 0 && stats_slot_alive(pid < 0 ? -pid : pid))
+            continue;
+        if (!__atomic_compare_exchange_n(&slot->pid, &pid, -self, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            continue;
+
+        retire_slot(slot);
+        slot->started = (uint64_t)time(NULL);
+        __atomic_store_n(&slot->pid, self, __ATOMIC_RELEASE);
+        own_slot = slot;
+    }
+
+    if (!own_slot)
+    {
+        fprintf(stderr, "stats-shm: all %d slots of %s are in use\n", STATS_SHM_SLOTS, name);
+        munmap(segment, sizeof(stats_shm_t));
+        segment = NULL;
+        return -1;
+    }
+
+    slot_owner = self;
+    memset(&synced, 0, sizeof(synced));
+    synced_time_ns = 0;
+    return 0;
+}
+
+/**
+ * @brief Add the growth of one counter to the slot
+ * @param field Slot counter
+ * @param now Current value in the shell's statistics
+ * @param before Value already added
+ */
+static void sync_counter(uint64_t *field, int now, int before)
+{
+    if (now != before)
+        __atomic_fetch_add(field, (uint64_t)(now - before), __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Add the statistics gathered since the last call to the instance's slot
+ *
+ * A typical line costs three atomic adds: the command count, its latency
+ * bucket and the summed time.
+ *
+ * @param stats Current statistics
+ */
+void stats_shm_sync(const command_stats_t *stats)
+{
+    if (!own_slot)
+        return;
+
+    sync_counter(&own_slot->commands, stats->cmds_count, synced.cmds_count);
+    sync_counter(&own_slot->blocked, stats->blocked_cmd_count, synced.blocked_cmd_count);
+    sync_counter(&own_slot->warned, stats->unblocked_dangerous_cmds_count, synced.unblocked_dangerous_cmds_count);
+    sync_counter(&own_slot->limit_exceeded, stats->limit_violations, synced.limit_violations);
+    sync_counter(&own_slot->background_jobs, stats->background_jobs, synced.background_jobs);
+
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        if (stats->latency_buckets[i] != synced.latency_buckets[i])
+            __atomic_fetch_add(&own_slot->latency_buckets[i], stats->latency_buckets[i] - synced.latency_buckets[i],
+                               __ATOMIC_RELAXED);
+    }
+
+    uint64_t time_ns = (uint64_t)(stats->total_time * 1e9);
+    if (time_ns > synced_time_ns)
+    {
+        __atomic_fetch_add(&own_slot->total_time_ns, time_ns - synced_time_ns, __ATOMIC_RELAXED);
+        synced_time_ns = time_ns;
+    }
+    synced = *stats;
+}
+
+/**
+ * @brief Leave the segment: fold the slot into the retired totals and free it
+ */
+void stats_shm_detach(void)
+{
+    if (!own_slot || slot_owner != getpid())
+        return;
+
+    int32_t self = (int32_t)slot_owner;
+    __atomic_store_n(&own_slot->pid, -self, __ATOMIC_RELEASE);
+    retire_slot(own_slot);
+    __atomic_store_n(&own_slot->pid, 0, __ATOMIC_RELEASE);
+
+    munmap(segment, sizeof(stats_shm_t));
+    segment = NULL;
+    own_slot = NULL;
+    slot_owner = 0;
+}
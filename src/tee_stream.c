@@ -0,0 +1,500 @@
+#include "../include/shell.h"
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+/* Maximum bytes moved per tee()/splice() round */
+#define TEE_SPLICE_CHUNK (1 << 20)
+
+/**
+ * @brief Check whether a file descriptor refers to a pipe or FIFO.
+ */
+static int is_pipe_fd(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+/**
+ * @brief Check whether a file descriptor refers to a regular file.
+ */
+static int is_regular_fd(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/**
+ * @brief Check whether any output was opened with O_APPEND (splice() rejects those).
+ */
+static int has_append_output(const int *fds, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int flags = fcntl(fds[i], F_GETFL);
+        if (flags != -1 && (flags & O_APPEND))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Move exactly len bytes from a pipe to an output with splice().
+ * @return 0 on success, -1 on error or premature end of input
+ */
+static int splice_all(int in_fd, int out_fd, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read exactly len bytes (the caller knows they are buffered in the pipe).
+ * @return 0 on success, -1 on error or premature end of input
+ */
+static int read_exact(int fd, char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Pipe-to-pipe tee without copying data through user space.
+ *
+ * Each round tee()s up to TEE_SPLICE_CHUNK bytes from the input pipe into
+ * the output pipe, duplicates the same bytes into an internal pipe that is
+ * splice()d to each file but the last, and finally splices the input into
+ * the last file, which consumes the chunk. If the internal pipe cannot hold
+ * a whole chunk, that chunk is finished with read()/write().
+ *
+ * @return 0 on success, -1 on error
+ */
+static int tee_zero_copy(int in_fd, int out_fd, const int *fds, int count)
+{
+    int internal[2] = {-1, -1};
+    char *slow_buf = NULL;
+    int status = 0;
+
+    if (count > 1)
+    {
+        if (pipe(internal) == -1)
+            return -1;
+
+        // Match the input pipe so a full chunk always fits
+        int size = fcntl(in_fd, F_GETPIPE_SZ);
+        if (size > 0)
+            fcntl(internal[1], F_SETPIPE_SZ, size);
+    }
+
+    while (status == 0)
+    {
+        ssize_t n = (count == 0) ? splice(in_fd, NULL, out_fd, NULL, TEE_SPLICE_CHUNK, SPLICE_F_MOVE)
+                                 : tee(in_fd, out_fd, TEE_SPLICE_CHUNK, 0);
+        if (n == 0)
+            break; // EOF
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            status = -1;
+            break;
+        }
+        if (count == 0)
+            continue;
+
+        int i;
+        ssize_t done = n;
+        for (i = 0; i < count - 1; i++)
+        {
+            done = tee(in_fd, internal[1], n, 0);
+            if (done < 0)
+                done = 0;
+            if (done > 0 && splice_all(internal[0], fds[i], done) == -1)
+            {
+                status = -1;
+                break;
+            }
+            if (done < n)
+                break;
+        }
+        if (status == -1)
+            break;
+
+        if (i == count - 1)
+        {
+            // Every duplicate is out; the last file consumes the chunk from the input
+            if (splice_all(in_fd, fds[count - 1], n) == -1)
+                status = -1;
+            continue;
+        }
+
+        // Slow path: consume the chunk and write the remainder of file i onwards
+        if (!slow_buf && !(slow_buf = malloc(TEE_SPLICE_CHUNK)))
+        {
+            status = -1;
+            break;
+        }
+        if (read_exact(in_fd, slow_buf, n) == -1 ||
+            write_all(fds[i], slow_buf + done, n - done) == -1)
+        {
+            status = -1;
+            break;
+        }
+        for (int j = i + 1; j < count && status == 0; j++)
+        {
+            if (write_all(fds[j], slow_buf, n) == -1)
+                status = -1;
+        }
+    }
+
+    if (internal[0] != -1)
+    {
+        close(internal[0]);
+        close(internal[1]);
+    }
+    free(slow_buf);
+    return status;
+}
+
+/**
+ * @brief Copy [offset, EOF) of a regular file to one output inside the kernel.
+ *
+ * Tries copy_file_range() (which may reflink), then sendfile(), then falls
+ * back to pread()/write().
+ *
+ * @param in_fd Regular input file
+ * @param offset Start offset; updated to the end of the copied range
+ * @param out_fd Output descriptor
+ * @return 0 on success, -1 on error
+ */
+static int copy_file_to_output(int in_fd, off_t *offset, int out_fd)
+{
+    int use_copy_range = 1, use_sendfile = 1;
+    char *buf = NULL;
+
+    for (;;)
+    {
+        ssize_t n = -1;
+
+        if (use_copy_range)
+        {
+            n = copy_file_range(in_fd, offset, out_fd, NULL, TEE_SPLICE_CHUNK, 0);
+            if (n < 0 && errno != EINTR)
+            {
+                use_copy_range = 0;
+                continue;
+            }
+        }
+        else if (use_sendfile)
+        {
+            n = sendfile(out_fd, in_fd, offset, TEE_SPLICE_CHUNK);
+            if (n < 0 && errno != EINTR)
+            {
+                use_sendfile = 0;
+                continue;
+            }
+        }
+        else
+        {
+            if (!buf && !(buf = malloc(TEE_BUFFER_SIZE)))
+                return -1;
+            n = pread(in_fd, buf, TEE_BUFFER_SIZE, *offset);
+            if (n > 0)
+            {
+                if (write_all(out_fd, buf, n) == -1)
+                {
+                    free(buf);
+                    return -1;
+                }
+                *offset += n;
+            }
+            else if (n < 0 && errno != EINTR)
+            {
+                free(buf);
+                return -1;
+            }
+        }
+
+        if (n == 0)
+            break; // EOF
+    }
+
+    free(buf);
+    return 0;
+}
+
+/**
+ * @brief Tee a regular input file to every output with in-kernel copies.
+ * @return 0 on success, -1 on error
+ */
+static int tee_from_file(int in_fd, int out_fd, const int *fds, int count)
+{
+    off_t start = lseek(in_fd, 0, SEEK_CUR);
+    off_t end = start;
+
+    for (int i = -1; i < count; i++)
+    {
+        off_t offset = start;
+        if (copy_file_to_output(in_fd, &offset, (i < 0) ? out_fd : fds[i]) == -1)
+            return -1;
+        if (offset > end)
+            end = offset;
+    }
+
+    lseek(in_fd, end, SEEK_SET);
+    return 0;
+}
+
+/**
+ * @brief Generic tee through one large user-space buffer.
+ * @return 0 on success, -1 on error
+ */
+static int tee_buffered(int in_fd, int out_fd, const int *fds, int count)
+{
+    char *buf = malloc(TEE_BUFFER_SIZE);
+    if (!buf)
+        return -1;
+
+    int status = 0;
+    ssize_t n;
+    while (status == 0 && ((n = read(in_fd, buf, TEE_BUFFER_SIZE)) > 0 || (n < 0 && errno == EINTR)))
+    {
+        if (n < 0)
+            continue;
+
+        if (write_all(out_fd, buf, n) == -1)
+            status = -1;
+        for (int i = 0; i < count && status == 0; i++)
+        {
+            if (write_all(fds[i], buf, n) == -1)
+                status = -1;
+        }
+    }
+    if (status == 0 && n < 0)
+        status = -1;
+
+    free(buf);
+    return status;
+}
+
+/**
+ * @brief Copy everything from in_fd to out_fd and to every file in fds.
+ *
+ * Picks the cheapest mechanism for the descriptors at hand: tee()/splice()
+ * when input and output are pipes, copy_file_range()/sendfile() when the
+ * input is a regular file, and a large-buffer read/write loop otherwise.
+ *
+ * @param in_fd Input descriptor
+ * @param out_fd Primary output (usually stdout)
+ * @param fds Additional output files
+ * @param count Number of additional output files
+ * @return 0 on success, -1 on error (errno set)
+ */
+int tee_stream(int in_fd, int out_fd, const int *fds, int count)
+{
+    if (is_pipe_fd(in_fd) && is_pipe_fd(out_fd) && !has_append_output(fds, count))
+    {
+        return tee_zero_copy(in_fd, out_fd, fds, count);
+    }
+
+    if (is_regular_fd(in_fd))
+    {
+        return tee_from_file(in_fd, out_fd, fds, count);
+    }
+
+    return tee_buffered(in_fd, out_fd, fds, count);
+}
+
+/**
+ * @brief Drop one writer's reference to a chunk, freeing the slot with the last one.
+ * @param ring Shared ring (lock held)
+ * @param chunk Chunk to release
+ */
+static void release_chunk_locked(tee_ring_t *ring, tee_chunk_t *chunk)
+{
+    if (--chunk->refs == 0)
+    {
+        pthread_cond_signal(&ring->slot_free);
+    }
+}
+
+/**
+ * @brief Writer thread: write every published chunk to one output, in order.
+ *
+ * Short writes are retried by write_all(). After a failure the writer keeps
+ * releasing chunks without writing, so one broken output never stalls the
+ * reader or the other writers.
+ */
+static void *tee_writer_thread(void *arg)
+{
+    tee_writer_t *writer = (tee_writer_t *)arg;
+    tee_ring_t *ring = writer->ring;
+
+    pthread_mutex_lock(&ring->lock);
+    for (;;)
+    {
+        while (writer->next == ring->produced && !ring->eof)
+        {
+            pthread_cond_wait(&ring->chunk_ready, &ring->lock);
+        }
+        if (writer->next == ring->produced)
+        {
+            break; // eof and fully drained
+        }
+
+        tee_chunk_t *chunk = &ring->slots[writer->next % ring->slot_count];
+        pthread_mutex_unlock(&ring->lock);
+
+        if (!writer->failed && write_all(writer->fd, chunk->data, chunk->len) == -1)
+        {
+            writer->failed = 1;
+            writer->error = errno;
+        }
+
+        pthread_mutex_lock(&ring->lock);
+        release_chunk_locked(ring, chunk);
+        writer->next++;
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return writer;
+}
+
+/**
+ * @brief Tee with one writer thread per output and a bounded ring of shared chunks.
+ *
+ * The calling thread reads input into TEE_CHUNK_SIZE chunks, each referenced
+ * by every writer. Outputs drain at their own pace; the reader only blocks
+ * once the slowest output lags high_water bytes behind, which bounds memory
+ * and pushes back on the upstream pipe.
+ *
+ * @param in_fd Input descriptor
+ * @param out_fd Primary output (usually stdout)
+ * @param fds Additional output files
+ * @param count Number of additional output files
+ * @param high_water Maximum bytes buffered for the slowest output
+ * @return 0 on success, -1 on error (errno set)
+ */
+int tee_fanout(int in_fd, int out_fd, const int *fds, int count, size_t high_water)
+{
+    tee_ring_t ring;
+    int writer_count = count + 1;
+
+    memset(&ring, 0, sizeof(ring));
+    ring.slot_count = high_water / TEE_CHUNK_SIZE;
+    if (ring.slot_count < 2)
+        ring.slot_count = 2;
+    ring.writers = writer_count;
+
+    ring.slots = calloc(ring.slot_count, sizeof(tee_chunk_t));
+    tee_writer_t *writers = calloc(writer_count, sizeof(tee_writer_t));
+    pthread_t *threads = malloc(writer_count * sizeof(pthread_t));
+    if (!ring.slots || !writers || !threads)
+    {
+        free(ring.slots);
+        free(writers);
+        free(threads);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.chunk_ready, NULL);
+    pthread_cond_init(&ring.slot_free, NULL);
+
+    int started = 0, read_error = 0;
+    for (int i = 0; i < writer_count; i++)
+    {
+        writers[i].ring = &ring;
+        writers[i].fd = (i == 0) ? out_fd : fds[i - 1];
+        if (pthread_create(&threads[i], NULL, tee_writer_thread, &writers[i]) != 0)
+        {
+            read_error = EAGAIN;
+            break;
+        }
+        started++;
+    }
+    ring.writers = started;
+
+    while (!read_error)
+    {
+        tee_chunk_t *chunk = &ring.slots[ring.produced % ring.slot_count];
+
+        // Backpressure: wait until every writer is done with the slot being reused
+        pthread_mutex_lock(&ring.lock);
+        while (chunk->refs > 0)
+        {
+            pthread_cond_wait(&ring.slot_free, &ring.lock);
+        }
+        pthread_mutex_unlock(&ring.lock);
+
+        if (!chunk->data && !(chunk->data = malloc(TEE_CHUNK_SIZE)))
+        {
+            read_error = ENOMEM;
+            break;
+        }
+
+        ssize_t n = read(in_fd, chunk->data, TEE_CHUNK_SIZE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            if (n < 0)
+                read_error = errno;
+            break;
+        }
+
+        pthread_mutex_lock(&ring.lock);
+        chunk->len = n;
+        chunk->refs = ring.writers;
+        ring.produced++;
+        pthread_cond_broadcast(&ring.chunk_ready);
+        pthread_mutex_unlock(&ring.lock);
+    }
+
+    pthread_mutex_lock(&ring.lock);
+    ring.eof = 1;
+    pthread_cond_broadcast(&ring.chunk_ready);
+    pthread_mutex_unlock(&ring.lock);
+
+    int error = read_error;
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+        if (writers[i].failed && !error)
+            error = writers[i].error;
+    }
+
+    for (size_t i = 0; i < ring.slot_count; i++)
+    {
+        free(ring.slots[i].data);
+    }
+    free(ring.slots);
+    free(writers);
+    free(threads);
+    pthread_mutex_destroy(&ring.lock);
+    pthread_cond_destroy(&ring.chunk_ready);
+    pthread_cond_destroy(&ring.slot_free);
+
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,675 @@
+#include "../include/shell.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/* Bytes per my_tee chunk with the io_uring engine (two are in flight) */
+#define URING_TEE_CHUNK (256 * 1024)
+
+/* user_data tag of the read SQE in tee_uring() */
+#define URING_TEE_READ_TAG UINT64_MAX
+
+int use_io_uring = 0; // Set by "-u": prefer io_uring for builtin I/O
+io_engine_stats_t io_engine_stats = {0};
+
+/**
+ * @brief Set up an io_uring instance and map its rings.
+ *
+ * Fails cleanly (returning -1) on kernels without io_uring or where it is
+ * disabled by sysctl or seccomp, so callers can fall back to read/write.
+ *
+ * @param ring Ring to initialize
+ * @param entries Requested submission queue size
+ * @return 0 on success, -1 on failure
+ */
+int uring_init(uring_t *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return -1;
+
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size)
+        ring->sq_ring_size = ring->cq_ring_size;
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+
+    ring->cq_ring = single_mmap ? ring->sq_ring
+                                : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        if (ring->cq_ring == MAP_FAILED)
+            ring->cq_ring = NULL;
+        if (ring->sqes == MAP_FAILED)
+            ring->sqes = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->sqe_tail = *ring->sq_tail;
+    ring->submitted = ring->sqe_tail;
+    return 0;
+}
+
+/**
+ * @brief Unmap the rings and close the ring descriptor.
+ * @param ring Ring to tear down (safe on a partially initialized ring)
+ */
+void uring_destroy(uring_t *ring)
+{
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0)
+        close(ring->fd);
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/**
+ * @brief Register fixed buffers so the kernel pins them once instead of per I/O.
+ * @return 0 on success, -1 if registration is refused (e.g. RLIMIT_MEMLOCK)
+ */
+static int uring_register_buffers(uring_t *ring, struct iovec *iovecs, unsigned count)
+{
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iovecs, count) < 0)
+        return -1;
+    ring->buffers_registered = 1;
+    return 0;
+}
+
+/**
+ * @brief Reserve the next submission queue entry.
+ * @return Zeroed SQE, or NULL if the queue is full
+ */
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head >= ring->entries)
+        return NULL;
+
+    unsigned index = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+    return sqe;
+}
+
+/**
+ * @brief Fill an SQE for a read or write at the current file position.
+ */
+static void uring_prep_rw(uring_t *ring, struct io_uring_sqe *sqe, int write, int fd,
+                          const void *buf, unsigned len, int buf_index, uint64_t user_data)
+{
+    if (ring->buffers_registered && buf_index >= 0)
+    {
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = (uint16_t)buf_index;
+    }
+    else
+    {
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = fd;
+    sqe->off = (uint64_t)-1; // current position; honours O_APPEND and works on pipes
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->user_data = user_data;
+}
+
+/**
+ * @brief Publish queued SQEs and optionally wait for completions, in one syscall.
+ * @param ring Ring
+ * @param wait_nr Completions to wait for (0 to only submit)
+ * @return 0 on success, -1 on error
+ */
+static int uring_submit(uring_t *ring, unsigned wait_nr)
+{
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    unsigned to_submit = ring->sqe_tail - ring->submitted;
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+
+    while (to_submit > 0 || wait_nr > 0)
+    {
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr, flags, NULL, 0);
+        io_engine_stats.enter_calls++;
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        io_engine_stats.sqes_submitted += ret;
+        ring->submitted += ret;
+        to_submit -= ret;
+        if (to_submit == 0)
+            break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Pop the next completion if one is available.
+ * @param ring Ring
+ * @param cqe Output copy of the completion
+ * @return 1 if a completion was returned, 0 if the queue is empty
+ */
+static int uring_pop_cqe(uring_t *ring, struct io_uring_cqe *cqe)
+{
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return 0;
+
+    *cqe = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * @brief Wait for and pop one completion.
+ * @return 0 on success, -1 on error
+ */
+static int uring_wait_cqe(uring_t *ring, struct io_uring_cqe *cqe)
+{
+    while (!uring_pop_cqe(ring, cqe))
+    {
+        if (uring_submit(ring, 1) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reserve an SQE, submitting the queued ones first if the queue is full.
+ * @return SQE, or NULL with errno set
+ */
+static struct io_uring_sqe *uring_next_sqe(uring_t *ring)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (sqe)
+        return sqe;
+    if (uring_submit(ring, 0) == -1)
+        return NULL;
+
+    sqe = uring_get_sqe(ring);
+    if (!sqe)
+        errno = EBUSY;
+    return sqe;
+}
+
+/**
+ * @brief State of one tee_uring() call
+ */
+typedef struct
+{
+    uring_t ring;
+    char *bufs[2];    // Registered chunk buffers
+    int *targets;     // out_fd followed by the file descriptors
+    size_t *done;     // Bytes of the current chunk written to each target
+    int outputs;      // Number of targets
+    int in_fd;
+    unsigned queued;  // SQEs whose completion has not been reaped
+    ssize_t read_len; // Result of the last read
+    int error;        // First errno value seen, 0 if none
+} uring_tee_t;
+
+/**
+ * @brief Queue a read of the next chunk into a buffer
+ * @param link Chain the next SQE to this one
+ */
+static void tee_queue_read(uring_tee_t *t, int buf, int link)
+{
+    struct io_uring_sqe *sqe = uring_next_sqe(&t->ring);
+    if (!sqe)
+    {
+        t->error = errno;
+        return;
+    }
+    uring_prep_rw(&t->ring, sqe, 0, t->in_fd, t->bufs[buf], URING_TEE_CHUNK, buf, URING_TEE_READ_TAG);
+    if (link)
+        sqe->flags |= IOSQE_IO_LINK;
+    t->queued++;
+}
+
+/**
+ * @brief Queue the part of a chunk an output has not received yet
+ * @param link Chain the next SQE to this one
+ */
+static void tee_queue_write(uring_tee_t *t, int target, int buf, size_t len, int link)
+{
+    struct io_uring_sqe *sqe = uring_next_sqe(&t->ring);
+    if (!sqe)
+    {
+        t->error = errno;
+        return;
+    }
+    uring_prep_rw(&t->ring, sqe, 1, t->targets[target], t->bufs[buf] + t->done[target],
+                  (unsigned)(len - t->done[target]), buf, (uint64_t)target);
+    if (link)
+        sqe->flags |= IOSQE_IO_LINK;
+    t->queued++;
+}
+
+/**
+ * @brief Submit what is queued and reap every completion
+ *
+ * Cancelled writes (their linked read came back short) leave done[] as it
+ * was, so tee_finish_chunk() writes them again with the real length.
+ *
+ * @return 0 once nothing is in flight, -1 if completions can no longer be reaped
+ */
+static int tee_wait(uring_tee_t *t)
+{
+    struct io_uring_cqe cqe;
+
+    if (uring_submit(&t->ring, t->queued) == -1)
+    {
+        // The SQEs that did reach the kernel still complete; reap them one by one
+        if (!t->error)
+            t->error = errno;
+    }
+
+    while (t->queued > 0)
+    {
+        if (uring_wait_cqe(&t->ring, &cqe) == -1)
+        {
+            if (!t->error)
+                t->error = errno;
+            return -1;
+        }
+        t->queued--;
+
+        if (cqe.user_data == URING_TEE_READ_TAG)
+        {
+            if (cqe.res < 0 && !t->error)
+                t->error = -cqe.res;
+            t->read_len = cqe.res;
+        }
+        else if (cqe.res >= 0)
+        {
+            t->done[cqe.user_data] += (size_t)cqe.res;
+        }
+        else if (cqe.res != -ECANCELED && !t->error)
+        {
+            t->error = -cqe.res;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Write whatever part of a chunk is still missing on each output
+ *
+ * Short and cancelled writes are requeued until every output has the
+ * whole chunk, so the next chunk cannot overtake it.
+ *
+ * @return 0 once nothing is in flight, -1 if completions can no longer be reaped
+ */
+static int tee_finish_chunk(uring_tee_t *t, int buf, size_t len)
+{
+    while (!t->error)
+    {
+        for (int i = 0; i < t->outputs && !t->error; i++)
+        {
+            if (t->done[i] < len)
+                tee_queue_write(t, i, buf, len, 0);
+        }
+        if (t->queued == 0)
+            break;
+        if (tee_wait(t) == -1)
+            return -1;
+    }
+    return t->queued == 0 ? 0 : tee_wait(t);
+}
+
+/**
+ * @brief Tee through io_uring, one io_uring_enter() per chunk.
+ *
+ * A regular-file input is read in linked chains: the read of a chunk is
+ * linked to its writes to every output, so the kernel runs the whole chunk
+ * from a single submission. A short read severs the chain and cancels the
+ * writes, which are then queued again with the length actually read; this
+ * only happens at end of file for regular files.
+ *
+ * Pipes and sockets return short reads all the time, so there two
+ * registered buffers alternate instead: while the writes of chunk k to every
+ * output are in flight, the read of chunk k+1 is queued in the same
+ * submission. Either way every output gets the whole chunk before the next
+ * chunk's writes are queued, preserving order, and no buffer is released
+ * while the kernel may still use it. Falls back to tee_stream() if io_uring
+ * is unavailable.
+ *
+ * @return 0 on success, -1 on error (errno set)
+ */
+int tee_uring(int in_fd, int out_fd, const int *fds, int count)
+{
+    uring_tee_t t = {.outputs = count + 1, .in_fd = in_fd};
+
+    if (uring_init(&t.ring, (unsigned)t.outputs + 1) == -1)
+    {
+        io_engine_stats.fallbacks++;
+        return tee_stream(in_fd, out_fd, fds, count);
+    }
+
+    t.bufs[0] = malloc(URING_TEE_CHUNK);
+    t.bufs[1] = malloc(URING_TEE_CHUNK);
+    t.targets = malloc(t.outputs * sizeof(int));
+    t.done = calloc(t.outputs, sizeof(size_t));
+    if (!t.bufs[0] || !t.bufs[1] || !t.targets || !t.done)
+    {
+        free(t.bufs[0]);
+        free(t.bufs[1]);
+        free(t.targets);
+        free(t.done);
+        uring_destroy(&t.ring);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    t.targets[0] = out_fd;
+    memcpy(t.targets + 1, fds, count * sizeof(int));
+
+    struct iovec iovecs[2] = {{t.bufs[0], URING_TEE_CHUNK}, {t.bufs[1], URING_TEE_CHUNK}};
+    uring_register_buffers(&t.ring, iovecs, 2); // plain READ/WRITE if refused
+
+    struct stat st;
+    int reaped = 0;
+    if (fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        while (!t.error)
+        {
+            memset(t.done, 0, t.outputs * sizeof(size_t));
+            tee_queue_read(&t, 0, 1);
+            for (int i = 0; i < t.outputs && !t.error; i++)
+                tee_queue_write(&t, i, 0, URING_TEE_CHUNK, i + 1 < t.outputs);
+            if ((reaped = tee_wait(&t)) == -1 || t.error || t.read_len <= 0)
+                break;
+            if ((reaped = tee_finish_chunk(&t, 0, (size_t)t.read_len)) == -1)
+                break;
+        }
+    }
+    else
+    {
+        int cur = 0;
+        tee_queue_read(&t, cur, 0);
+        reaped = tee_wait(&t);
+        ssize_t len = t.read_len;
+
+        while (reaped == 0 && !t.error && len > 0)
+        {
+            int next = cur ^ 1;
+
+            // Queue the writes of this chunk and the read of the next one together
+            memset(t.done, 0, t.outputs * sizeof(size_t));
+            for (int i = 0; i < t.outputs && !t.error; i++)
+                tee_queue_write(&t, i, cur, (size_t)len, 0);
+            if (!t.error)
+                tee_queue_read(&t, next, 0);
+            if ((reaped = tee_wait(&t)) == -1 || (reaped = tee_finish_chunk(&t, cur, (size_t)len)) == -1)
+                break;
+
+            cur = next;
+            len = t.read_len;
+        }
+    }
+
+    int error = t.error;
+    if (reaped == 0)
+    {
+        uring_destroy(&t.ring);
+        free(t.bufs[0]);
+        free(t.bufs[1]);
+    }
+    else
+    {
+        // Requests may still be in flight: the buffers stay allocated for the kernel
+        uring_destroy(&t.ring);
+    }
+    free(t.targets);
+    free(t.done);
+
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/* Session-wide ring for asynchronous log writes */
+static uring_t log_ring = {.fd = -1};
+static int log_fd = -1;
+static char *log_slots = NULL;
+static int log_slot_busy[URING_LOG_SLOTS];
+static unsigned log_slot_len[URING_LOG_SLOTS];
+
+/**
+ * @brief Start routing log writes for fd through io_uring.
+ * @param fd Log file descriptor (opened with O_APPEND)
+ * @return 0 if the engine is active, -1 if the caller should keep using stdio
+ */
+int uring_log_open(int fd)
+{
+    if (uring_init(&log_ring, URING_LOG_SLOTS) == -1)
+    {
+        io_engine_stats.fallbacks++;
+        return -1;
+    }
+
+    log_slots = malloc((size_t)URING_LOG_SLOTS * URING_LOG_SLOT_SIZE);
+    if (!log_slots)
+    {
+        uring_destroy(&log_ring);
+        return -1;
+    }
+
+    struct iovec iov = {log_slots, (size_t)URING_LOG_SLOTS * URING_LOG_SLOT_SIZE};
+    uring_register_buffers(&log_ring, &iov, 1);
+
+    memset(log_slot_busy, 0, sizeof(log_slot_busy));
+    log_fd = fd;
+    return 0;
+}
+
+/**
+ * @brief Account for one finished log write
+ *
+ * A short write has its remainder written synchronously, after any records
+ * the kernel appended in the meantime; nothing is dropped.
+ */
+static void complete_log_write(const struct io_uring_cqe *cqe)
+{
+    int slot = (int)cqe->user_data;
+
+    if (cqe->res < 0)
+    {
+        fprintf(stderr, "log: %s\n", strerror(-cqe->res));
+    }
+    else if ((unsigned)cqe->res < log_slot_len[slot])
+    {
+        const char *rest = log_slots + (size_t)slot * URING_LOG_SLOT_SIZE + cqe->res;
+        if (write_all(log_fd, rest, log_slot_len[slot] - (unsigned)cqe->res) == -1)
+            perror("log");
+    }
+    log_slot_busy[slot] = 0;
+}
+
+/**
+ * @brief Mark slots of finished log writes free again.
+ * @param wait Block for at least one completion
+ * @return 0 on success, -1 if completions can no longer be waited for
+ */
+static int reap_log_completions(int wait)
+{
+    struct io_uring_cqe cqe;
+
+    if (wait)
+    {
+        if (uring_wait_cqe(&log_ring, &cqe) == -1)
+            return -1;
+        complete_log_write(&cqe);
+    }
+
+    while (uring_pop_cqe(&log_ring, &cqe))
+        complete_log_write(&cqe);
+    return 0;
+}
+
+/**
+ * @brief Give up on the engine after its completions became unreachable
+ *
+ * Writes may still be in flight from the slots, so they are left allocated;
+ * later records go through stdio.
+ */
+static void abandon_log_ring(void)
+{
+    fprintf(stderr, "log: io_uring failed (%s), falling back to stdio\n", strerror(errno));
+    uring_destroy(&log_ring);
+    log_slots = NULL;
+    log_fd = -1;
+}
+
+/**
+ * @brief Wait until every queued log write has landed
+ * @return 0 on success, -1 if the engine had to be abandoned
+ */
+static int drain_log_writes(void)
+{
+    for (int i = 0; i < URING_LOG_SLOTS; i++)
+    {
+        while (log_slot_busy[i])
+        {
+            if (reap_log_completions(1) == -1)
+            {
+                abandon_log_ring();
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Queue one log record; the shell does not wait for it to reach the file.
+ *
+ * Records larger than a slot, and records that find no free SQE, are written
+ * synchronously once the queued ones have landed, so the file keeps command
+ * order.
+ *
+ * @param fd Descriptor the record is meant for
+ * @param data Record bytes
+ * @param len Record length
+ * @return 0 if written or queued, -1 if the engine is not active for fd
+ */
+int uring_log_write(int fd, const char *data, size_t len)
+{
+    if (log_fd < 0 || fd != log_fd)
+        return -1;
+
+    if (reap_log_completions(0) == -1)
+        return -1;
+
+    if (len > URING_LOG_SLOT_SIZE)
+    {
+        if (drain_log_writes() == -1)
+            return -1;
+        if (write_all(fd, data, len) == -1)
+            perror("log");
+        return 0;
+    }
+
+    int slot = -1;
+    while (slot < 0)
+    {
+        for (int i = 0; i < URING_LOG_SLOTS; i++)
+        {
+            if (!log_slot_busy[i])
+            {
+                slot = i;
+                break;
+            }
+        }
+        if (slot < 0 && reap_log_completions(1) == -1)
+        {
+            abandon_log_ring();
+            return -1;
+        }
+    }
+
+    struct io_uring_sqe *sqe = uring_get_sqe(&log_ring);
+    if (!sqe)
+    {
+        if (drain_log_writes() == -1)
+            return -1;
+        if (write_all(fd, data, len) == -1)
+            perror("log");
+        return 0;
+    }
+
+    char *buf = log_slots + (size_t)slot * URING_LOG_SLOT_SIZE;
+    memcpy(buf, data, len);
+    uring_prep_rw(&log_ring, sqe, 1, log_fd, buf, (unsigned)len, 0, (uint64_t)slot);
+    log_slot_busy[slot] = 1;
+    log_slot_len[slot] = (unsigned)len;
+    if (uring_submit(&log_ring, 0) == -1)
+    {
+        abandon_log_ring();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Wait for outstanding log writes and tear the log ring down.
+ */
+void uring_log_close(void)
+{
+    if (log_fd < 0)
+        return;
+    if (drain_log_writes() == -1)
+        return;
+
+    uring_destroy(&log_ring);
+    free(log_slots);
+    log_slots = NULL;
+    log_fd = -1;
+}
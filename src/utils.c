@@ -1,4 +1,7 @@
 #include "../include/shell.h"
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
 
 /**
  * Checks if a string contains consecutive spaces or a tab
@@ -19,80 +22,207 @@ int has_consecutive_spaces(const char *str)
     return 0;
 }
 
-int tokenize(char *str_src, char **tokens_dest, int max_args)
+/**
+ * Reconstructs command string from command_t structure
+ *
+ * @param cmd Command structure
+ * @return Newly allocated command string (caller frees), or NULL on allocation failure
+ */
+char *reconstruct_command_string(const command_t *cmd)
 {
-    int count = 0;
-    char *ptr = str_src;
-
-    while (*ptr && count < max_args)
+    size_t total = 1;
+    for (int i = 0; i < cmd->argc; i++)
     {
-        // Skip leading whitespace
-        while (*ptr && (*ptr == ' ' || *ptr == '\t' || *ptr == '\n'))
-            ptr++;
-
-        if (!*ptr)
-            break;
+        total += strlen(cmd->args[i]) + 1;
+    }
 
-        char *token_start = ptr;
+    char *cmd_str = malloc(total);
+    if (!cmd_str)
+        return NULL;
 
-        if (*ptr == '"')
+    char *pos = cmd_str;
+    for (int i = 0; i < cmd->argc; i++)
+    {
+        if (i > 0)
         {
-            // Handle quoted string
-            ptr++;             // Skip opening quote
-            token_start = ptr; // Start after the quote
-
-            // Find closing quote
-            while (*ptr && *ptr != '"')
-                ptr++;
-
-            if (*ptr == '"')
-            {
-                *ptr = '\0'; // Null-terminate the token (removing closing quote)
-                ptr++;       // Move past the closing quote
-            }
-            // If no closing quote found, treat rest as the token
+            *pos++ = ' ';
         }
-        else
+        size_t len = strlen(cmd->args[i]);
+        memcpy(pos, cmd->args[i], len);
+        pos += len;
+    }
+    *pos = '\0';
+
+    return cmd_str;
+}
+
+/**
+ * Writes an entire buffer, retrying on short writes and EINTR
+ *
+ * @param fd Destination file descriptor
+ * @param buf Data to write
+ * @param len Number of bytes to write
+ * @return len on success, -1 on error
+ */
+ssize_t write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    size_t left = len;
+
+    while (left > 0)
+    {
+        ssize_t n = write(fd, p, left);
+        if (n < 0)
         {
-            // Handle unquoted token
-            while (*ptr && *ptr != ' ' && *ptr != '\t' && *ptr != '\n')
-                ptr++;
-
-            if (*ptr)
-            {
-                *ptr = '\0'; // Null-terminate the token
-                ptr++;       // Move to next character
-            }
+            if (errno == EINTR)
+                continue;
+            return -1;
         }
-
-        tokens_dest[count++] = token_start;
+        p += n;
+        left -= n;
     }
 
-    if (count >= max_args && *ptr)
+    return len;
+}
+
+/**
+ * Parses a byte count with an optional K, M or G suffix (powers of 1024)
+ *
+ * @param str String such as "512", "64K" or "16M"
+ * @return Number of bytes, or -1 if the string is malformed
+ */
+long long parse_size(const char *str)
+{
+    char *end;
+    long long value = strtoll(str, &end, 10);
+    if (end == str || value < 0)
+        return -1;
+
+    switch (toupper((unsigned char)*end))
     {
-        return -1; // Too many tokens
+    case 'G':
+        value <<= 10;
+        /* fall through */
+    case 'M':
+        value <<= 10;
+        /* fall through */
+    case 'K':
+        value <<= 10;
+        end++;
+        break;
+    case '\0':
+        break;
+    default:
+        return -1;
     }
 
-    tokens_dest[count] = NULL;
-    return count;
+    return (*end == '\0') ? value : -1;
 }
 
 /**
- * Reconstructs command string from command_t structure
+ * Parses a duration such as "5", "1.5s", "500ms", "2m" or "1h"
  *
- * @param cmd Command structure
- * @param cmd_str Output buffer for reconstructed command
+ * @param str Duration string; a bare number is in seconds
+ * @return Duration in seconds, or -1 if the string is malformed
  */
-void reconstruct_command_string(const command_t *cmd, char *cmd_str)
+double parse_duration(const char *str)
 {
-    cmd_str[0] = '\0';
+    char *end;
+    double value = strtod(str, &end);
+    if (end == str || value < 0)
+        return -1;
 
-    for (int i = 0; i < cmd->argc; i++)
+    if (strcmp(end, "") == 0 || strcmp(end, "s") == 0)
+        return value;
+    if (strcmp(end, "ms") == 0)
+        return value / 1000.0;
+    if (strcmp(end, "m") == 0)
+        return value * 60.0;
+    if (strcmp(end, "h") == 0)
+        return value * 3600.0;
+    return -1;
+}
+
+/**
+ * Binds a listening Unix domain socket, replacing a stale socket file
+ *
+ * @param path Filesystem path of the socket
+ * @param backlog Pending connections allowed by listen()
+ * @return Non-blocking listening descriptor, or -1 on error
+ */
+int open_unix_listener(const char *path, int backlog)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
     {
-        if (i > 0)
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (bound == -1 && errno == EADDRINUSE)
+    {
+        // Only take the path over if nobody is listening on it
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int alive = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0)
+            close(probe);
+        if (alive)
         {
-            strcat(cmd_str, " ");
+            fprintf(stderr, "%s is already in use\n", path);
+            close(fd);
+            return -1;
         }
-        strcat(cmd_str, cmd->args[i]);
+        unlink(path);
+        bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
     }
+
+    if (bound == -1 || listen(fd, backlog) == -1)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Find the command of a "limit [-t D] [-c D] [-m S] command..." call.
+ *
+ * Every option takes a value; options are not validated here.
+ *
+ * @param args Arguments of the call, args[0] being "limit"
+ * @param argc Number of arguments
+ * @return Index of the limited command's name, argc if there is none
+ */
+int limit_command_start(char *const *args, int argc)
+{
+    int start = 1;
+    while (start + 1 < argc && args[start][0] == '-')
+        start += 2;
+    return start;
+}
+
+/**
+ * @brief Open a pidfd for a child, if the kernel supports it.
+ * @param pid Child process (it may already have exited, as long as it is not reaped)
+ * @return pidfd (close-on-exec), or -1; callers then poll with waitpid(WNOHANG)
+ */
+int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
 }
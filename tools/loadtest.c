@@ -0,0 +1,188 @@
+#include "../include/shell.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * Load test for "shell --serve": starts a daemon, opens many concurrent
+ * sessions that each send a short script and wait for all of its output,
+ * and reports throughput and session latency percentiles.
+ *
+ * Usage: loadtest ./shell [clients] [lines_per_client]   (default 200 x 20)
+ */
+
+typedef struct
+{
+    int fd;          // Session socket
+    size_t lines;    // Output lines received so far
+    double start;    // Connect time
+    double latency;  // Connect to end-of-output, -1 while running
+} client_t;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int connect_session(const struct sockaddr_un *addr)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s shell [clients] [lines_per_client]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int clients = (argc > 2) ? atoi(argv[2]) : 200;
+    int lines = (argc > 3) ? atoi(argv[3]) : 20;
+    if (clients < 1 || lines < 1)
+    {
+        fprintf(stderr, "%s: clients and lines must be positive\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/shell-loadtest-%d.sock", (int)getpid());
+
+    signal(SIGPIPE, SIG_IGN);
+
+    pid_t server = fork();
+    if (server == 0)
+    {
+        execl(argv[1], argv[1], "--serve", addr.sun_path, (char *)NULL);
+        perror(argv[1]);
+        _exit(127);
+    }
+
+    // Wait for the daemon to listen
+    int probe = -1;
+    for (int i = 0; i < 500 && probe == -1; i++)
+    {
+        probe = connect_session(&addr);
+        if (probe == -1)
+            usleep(10000);
+    }
+    if (probe == -1)
+    {
+        fprintf(stderr, "%s: daemon did not start\n", argv[0]);
+        kill(server, SIGTERM);
+        return EXIT_FAILURE;
+    }
+    close(probe);
+
+    // Every line prints exactly one line: external commands and builtins mixed
+    size_t script_cap = (size_t)lines * 64 + 1, script_len = 0;
+    char *script = malloc(script_cap);
+    for (int i = 0; i < lines; i++)
+    {
+        if (i % 2 == 0)
+            script_len += snprintf(script + script_len, script_cap - script_len, "echo line-%d\n", i);
+        else
+            script_len += snprintf(script + script_len, script_cap - script_len,
+                                   "mcalc (2,2:1,2,3,%d) (2,2:1,1,1,1) ADD\n", i);
+    }
+
+    client_t *sessions = calloc(clients, sizeof(client_t));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    double t0 = now_seconds();
+
+    for (int i = 0; i < clients; i++)
+    {
+        client_t *c = &sessions[i];
+        c->latency = -1;
+        c->start = now_seconds();
+        c->fd = connect_session(&addr);
+        if (c->fd == -1 || write_all(c->fd, script, script_len) == -1)
+        {
+            perror("session");
+            kill(server, SIGTERM);
+            return EXIT_FAILURE;
+        }
+        shutdown(c->fd, SHUT_WR);
+
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = c};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c->fd, &event);
+    }
+
+    int remaining = clients, failed = 0;
+    char buf[65536];
+    struct epoll_event events[64];
+    while (remaining > 0)
+    {
+        int n = epoll_wait(epoll_fd, events, 64, 30000);
+        if (n <= 0)
+        {
+            if (n == -1 && errno == EINTR)
+                continue;
+            fprintf(stderr, "%s: timed out with %d sessions open\n", argv[0], remaining);
+            failed = 1;
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            client_t *c = events[i].data.ptr;
+            ssize_t got = read(c->fd, buf, sizeof(buf));
+            if (got > 0)
+            {
+                for (ssize_t k = 0; k < got; k++)
+                    c->lines += (buf[k] == '\n');
+                continue;
+            }
+
+            c->latency = now_seconds() - c->start;
+            if (c->lines != (size_t)lines)
+                failed = 1;
+            close(c->fd);
+            remaining--;
+        }
+    }
+
+    double elapsed = now_seconds() - t0;
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+
+    double *latencies = malloc(clients * sizeof(double));
+    int done = 0;
+    for (int i = 0; i < clients; i++)
+    {
+        if (sessions[i].latency >= 0)
+            latencies[done++] = sessions[i].latency;
+    }
+    qsort(latencies, done, sizeof(double), compare_doubles);
+
+    printf("sessions: %d  lines/session: %d  commands: %ld  time: %.3f s  commands/s: %.0f\n",
+           clients, lines, (long)done * lines, elapsed, done * lines / elapsed);
+    if (done > 0)
+        printf("session latency  p50: %.1f ms  p95: %.1f ms  p99: %.1f ms  max: %.1f ms\n",
+               latencies[done / 2] * 1e3, latencies[done * 95 / 100] * 1e3, latencies[done * 99 / 100] * 1e3,
+               latencies[done - 1] * 1e3);
+    if (failed)
+        printf("FAILED: some sessions returned the wrong number of lines\n");
+
+    free(latencies);
+    free(sessions);
+    free(script);
+    close(epoll_fd);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
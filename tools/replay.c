@@ -0,0 +1,485 @@
+#include "../include/shell.h"
+#include <limits.h>
+#include <poll.h>
+#include <termios.h>
+
+/*
+ * Command-replay load generator. Feeds a recorded command file, or a seeded
+ * mix of safe, warned, blocked, piped, background and mcalc lines, into an
+ * interactive shell on a pseudo-terminal. A command's round trip ends when
+ * the next prompt arrives: the shell prints it last before reading, so the
+ * output then ends with the prompt suffix. Reports throughput, latency
+ * percentiles and a log2 histogram, optionally next to a baseline binary run
+ * on the same lines. With -m pipe the lines are streamed through a pipe in
+ * batch mode instead, which measures throughput only.
+ *
+ * Usage: replay [-f file | -n count -s seed] [-o record] [-m pty|pipe]
+ *               [-p suffix] [-B baseline_shell] shell [shell flags...]
+ */
+
+#define REPLAY_TIMEOUT_MS 10000
+#define REPLAY_BUCKETS 32
+
+typedef enum
+{
+    LINE_SAFE,
+    LINE_WARN,
+    LINE_BLOCKED,
+    LINE_PIPED,
+    LINE_BACKGROUND,
+    LINE_MCALC,
+    LINE_KINDS
+} line_kind_t;
+
+typedef struct
+{
+    char **lines;
+    size_t count;
+    const char *prompt_suffix;
+    const char *dangerous_path;
+    char *const *shell_flags; // Extra flags passed before the dangerous/log files
+    int flag_count;
+} replay_config_t;
+
+typedef struct
+{
+    double elapsed;     // Wall time of the whole run
+    double *latencies;  // Per-command round trips (pty mode only)
+    size_t completed;   // Commands that got their prompt back
+    int failed;         // Shell died or stopped answering
+} replay_result_t;
+
+/* Blacklist used for generated mixes: the blocked line matches exactly, warned lines share "rm" */
+static const char *const replay_blacklist = "rm -rf /tmp/replay-guard\n";
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static char *generate_line(line_kind_t kind, size_t i)
+{
+    char line[128];
+
+    switch (kind)
+    {
+    case LINE_SAFE:
+        snprintf(line, sizeof(line), (i % 2) ? "echo replay-%zu" : "ls /tmp/replay-absent-%zu", i);
+        break;
+    case LINE_WARN:
+        snprintf(line, sizeof(line), "rm -f /tmp/replay-absent-%zu", i);
+        break;
+    case LINE_BLOCKED:
+        snprintf(line, sizeof(line), "rm -rf /tmp/replay-guard");
+        break;
+    case LINE_PIPED:
+        snprintf(line, sizeof(line), "echo replay-%zu | tr a-z A-Z", i);
+        break;
+    case LINE_BACKGROUND:
+        snprintf(line, sizeof(line), "sleep 0 &");
+        break;
+    default:
+        snprintf(line, sizeof(line), "mcalc (2,2:1,2,3,%zu) (2,2:4,3,2,1) ADD", i % 1000);
+        break;
+    }
+    return strdup(line);
+}
+
+/* Seeded mix: 40% safe, 10% warned, 10% blocked, 15% piped, 5% background, 20% mcalc */
+static char **generate_mix(size_t count, unsigned int seed)
+{
+    static const int weights[LINE_KINDS] = {40, 10, 10, 15, 5, 20};
+    char **lines = malloc(count * sizeof(char *));
+
+    for (size_t i = 0; lines && i < count; i++)
+    {
+        int pick = rand_r(&seed) % 100, kind = 0;
+        while (pick >= weights[kind])
+            pick -= weights[kind++];
+        lines[i] = generate_line((line_kind_t)kind, i);
+    }
+    return lines;
+}
+
+static char **load_lines(const char *path, size_t *count)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    char **lines = NULL, *buffer = NULL, *line;
+    size_t capacity = 0, line_cap = 0;
+    *count = 0;
+    while ((line = read_line(&buffer, &line_cap, file)))
+    {
+        if (!*line)
+            continue;
+        if (*count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            lines = realloc(lines, capacity * sizeof(char *));
+        }
+        lines[(*count)++] = strdup(line);
+    }
+    free(buffer);
+    fclose(file);
+    return lines;
+}
+
+/* Exec the shell under test with its flags, the blacklist and a scratch log */
+static void exec_shell(const char *shell, const replay_config_t *config, const char *log_path)
+{
+    char **argv = calloc(config->flag_count + 4, sizeof(char *));
+    int argc = 0;
+
+    argv[argc++] = (char *)shell;
+    for (int i = 0; i < config->flag_count; i++)
+        argv[argc++] = config->shell_flags[i];
+    argv[argc++] = (char *)config->dangerous_path;
+    argv[argc++] = (char *)log_path;
+
+    // Replayed lines stay out of the user's command history
+    setenv("SECURESHELL_HISTORY", "", 1);
+    execv(shell, argv);
+    perror(shell);
+    _exit(127);
+}
+
+/* Read from fd until the output ends with the prompt suffix; 0 on success, -1 on EOF or timeout */
+static int wait_for_prompt(int fd, const char *suffix, char *tail, size_t tail_size)
+{
+    size_t suffix_len = strlen(suffix), have = 0;
+    char buf[8192];
+
+    for (;;)
+    {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        int ready = poll(&pfd, 1, REPLAY_TIMEOUT_MS);
+        if (ready == -1 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+            return -1;
+
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+
+        // Keep only the last tail_size bytes; the prompt suffix is all we look for
+        if ((size_t)n >= tail_size)
+        {
+            memcpy(tail, buf + n - tail_size, tail_size);
+            have = tail_size;
+        }
+        else
+        {
+            size_t keep = have + n > tail_size ? tail_size - n : have;
+            memmove(tail, tail + have - keep, keep);
+            memcpy(tail + keep, buf, n);
+            have = keep + n;
+        }
+
+        if (have >= suffix_len && memcmp(tail + have - suffix_len, suffix, suffix_len) == 0)
+            return 0;
+    }
+}
+
+static int run_pty(const char *shell, const replay_config_t *config, const char *log_path,
+                   replay_result_t *result)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1)
+    {
+        perror("posix_openpt");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setsid();
+        int slave = open(ptsname(master), O_RDWR);
+        if (slave == -1)
+            _exit(127);
+
+        // No echo, so the shell's output is all that comes back
+        struct termios tio;
+        tcgetattr(slave, &tio);
+        tio.c_lflag &= ~(ECHO | ECHONL);
+        tcsetattr(slave, TCSANOW, &tio);
+
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        if (slave > STDERR_FILENO)
+            close(slave);
+        exec_shell(shell, config, log_path);
+    }
+
+    char tail[256];
+    double start = now_seconds();
+    if (wait_for_prompt(master, config->prompt_suffix, tail, sizeof(tail)) == -1)
+    {
+        fprintf(stderr, "replay: %s never printed a prompt ending in \"%s\"\n", shell, config->prompt_suffix);
+        result->failed = 1;
+    }
+
+    for (size_t i = 0; !result->failed && i < config->count; i++)
+    {
+        double t0 = now_seconds();
+        if (write_all(master, config->lines[i], strlen(config->lines[i])) == -1 ||
+            write_all(master, "\n", 1) == -1 ||
+            wait_for_prompt(master, config->prompt_suffix, tail, sizeof(tail)) == -1)
+        {
+            fprintf(stderr, "replay: no prompt after line %zu: %s\n", i + 1, config->lines[i]);
+            result->failed = 1;
+            break;
+        }
+        result->latencies[result->completed++] = now_seconds() - t0;
+    }
+    result->elapsed = now_seconds() - start;
+
+    write_all(master, "exit\n", 5);
+    close(master);
+    waitpid(pid, NULL, 0);
+    return 0;
+}
+
+static int run_pipe(const char *shell, const replay_config_t *config, const char *log_path,
+                    replay_result_t *result)
+{
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) == -1 || pipe2(out, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(out[1], STDERR_FILENO);
+        exec_shell(shell, config, log_path);
+    }
+    close(in[0]);
+    close(out[1]);
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+
+    // Stream the lines in while draining the output, so neither side stalls
+    size_t line = 0, offset = 0;
+    char buf[65536];
+    struct pollfd pfds[2] = {{.fd = out[0], .events = POLLIN}, {.fd = in[1], .events = POLLOUT}};
+    for (;;)
+    {
+        int nfds = pfds[1].fd == -1 ? 1 : 2;
+        if (poll(pfds, nfds, REPLAY_TIMEOUT_MS) <= 0)
+        {
+            if (errno == EINTR)
+                continue;
+            result->failed = 1;
+            break;
+        }
+
+        if (pfds[0].revents)
+        {
+            if (read(out[0], buf, sizeof(buf)) <= 0)
+                break;
+        }
+
+        if (nfds == 2 && pfds[1].revents)
+        {
+            const char *text = config->lines[line];
+            size_t len = strlen(text);
+            ssize_t n = offset < len ? write(in[1], text + offset, len - offset) : write(in[1], "\n", 1);
+            if (n > 0 && (offset += n) > len)
+            {
+                offset = 0;
+                if (++line == config->count)
+                {
+                    close(in[1]);
+                    pfds[1].fd = -1;
+                }
+            }
+            else if (n == -1 && errno != EAGAIN)
+            {
+                result->failed = 1;
+                break;
+            }
+        }
+    }
+    result->elapsed = now_seconds() - start;
+    result->completed = result->failed ? line : config->count;
+
+    if (pfds[1].fd != -1)
+        close(in[1]);
+    close(out[0]);
+    waitpid(pid, NULL, 0);
+    return 0;
+}
+
+static void print_report(const char *label, replay_result_t *result)
+{
+    printf("%s: %zu commands in %.3f s, %.0f commands/s%s\n", label, result->completed, result->elapsed,
+           result->completed / result->elapsed, result->failed ? "  (FAILED)" : "");
+
+    size_t n = result->completed;
+    if (!result->latencies || n == 0)
+        return;
+
+    double *lat = result->latencies;
+    qsort(lat, n, sizeof(double), compare_doubles);
+    printf("  latency  p50: %.1f us  p90: %.1f us  p99: %.1f us  p99.9: %.1f us  max: %.1f us\n",
+           lat[n / 2] * 1e6, lat[n * 90 / 100] * 1e6, lat[n * 99 / 100] * 1e6, lat[n * 999 / 1000] * 1e6,
+           lat[n - 1] * 1e6);
+
+    // log2 buckets of microseconds
+    size_t buckets[REPLAY_BUCKETS] = {0}, peak = 0;
+    int lo = REPLAY_BUCKETS, hi = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        double us = lat[i] * 1e6;
+        int b = 0;
+        while (b < REPLAY_BUCKETS - 1 && us >= (double)(2UL << b))
+            b++;
+        if (++buckets[b] > peak)
+            peak = buckets[b];
+        lo = b < lo ? b : lo;
+        hi = b > hi ? b : hi;
+    }
+    for (int b = lo; b <= hi; b++)
+    {
+        int width = (int)(buckets[b] * 40 / peak);
+        printf("  %9lu - %9lu us |%-40.*s| %zu\n", b ? 1UL << b : 0UL, 2UL << b, width,
+               "########################################", buckets[b]);
+    }
+}
+
+static int replay(const char *label, const char *shell, const replay_config_t *config, int use_pty,
+                  replay_result_t *result)
+{
+    char log_path[] = "/tmp/replay_log_XXXXXX";
+    int log_fd = mkstemp(log_path);
+    if (log_fd == -1)
+    {
+        perror("mkstemp");
+        return -1;
+    }
+    close(log_fd);
+
+    memset(result, 0, sizeof(*result));
+    result->latencies = use_pty ? malloc(config->count * sizeof(double)) : NULL;
+    int status = use_pty ? run_pty(shell, config, log_path, result) : run_pipe(shell, config, log_path, result);
+    unlink(log_path);
+
+    if (status == 0)
+        print_report(label, result);
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *file = NULL, *record = NULL, *baseline = NULL, *mode = "pty";
+    size_t count = 2000;
+    unsigned int seed = 1;
+    replay_config_t config = {.prompt_suffix = ">> "};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+f:n:s:o:m:p:B:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f': file = optarg; break;
+        case 'n': count = strtoul(optarg, NULL, 10); break;
+        case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'o': record = optarg; break;
+        case 'm': mode = optarg; break;
+        case 'p': config.prompt_suffix = optarg; break;
+        case 'B': baseline = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-f file | -n count -s seed] [-o record] [-m pty|pipe] "
+                            "[-p suffix] [-B baseline_shell] shell [shell flags...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc || count == 0 || (strcmp(mode, "pty") != 0 && strcmp(mode, "pipe") != 0))
+    {
+        fprintf(stderr, "%s: need a shell binary, a positive count and -m pty or -m pipe\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *shell = argv[optind];
+    config.shell_flags = argv + optind + 1;
+    config.flag_count = argc - optind - 1;
+
+    config.lines = file ? load_lines(file, &config.count) : generate_mix(count, seed);
+    if (!file)
+        config.count = count;
+    if (!config.lines || config.count == 0)
+    {
+        fprintf(stderr, "%s: no commands to replay\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (record)
+    {
+        FILE *out = fopen(record, "w");
+        if (!out)
+        {
+            perror(record);
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < config.count; i++)
+            fprintf(out, "%s\n", config.lines[i]);
+        fclose(out);
+    }
+
+    char dangerous_path[] = "/tmp/replay_blacklist_XXXXXX";
+    int fd = mkstemp(dangerous_path);
+    if (fd == -1 || write_all(fd, replay_blacklist, strlen(replay_blacklist)) == -1)
+    {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    config.dangerous_path = dangerous_path;
+
+    signal(SIGPIPE, SIG_IGN);
+    int use_pty = strcmp(mode, "pty") == 0;
+    replay_result_t current, base;
+    int failed = replay(shell, shell, &config, use_pty, &current) == -1 || current.failed;
+
+    char label[PATH_MAX + 16];
+    snprintf(label, sizeof(label), "baseline %s", baseline ? baseline : "");
+    if (baseline && replay(label, baseline, &config, use_pty, &base) == 0 && !base.failed)
+    {
+        printf("%s vs %s: throughput %+.1f%%", shell, baseline,
+               ((current.completed / current.elapsed) / (base.completed / base.elapsed) - 1) * 100);
+        if (use_pty && current.completed && base.completed)
+            printf("  p50 %+.1f%%  p99 %+.1f%%",
+                   (current.latencies[current.completed / 2] / base.latencies[base.completed / 2] - 1) * 100,
+                   (current.latencies[current.completed * 99 / 100] / base.latencies[base.completed * 99 / 100] - 1) * 100);
+        printf("\n");
+        free(base.latencies);
+    }
+
+    unlink(dangerous_path);
+    free(current.latencies);
+    for (size_t i = 0; i < config.count; i++)
+        free(config.lines[i]);
+    free(config.lines);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
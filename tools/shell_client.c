@@ -0,0 +1,78 @@
+#include "../include/shell.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * Client for "shell --serve": connects stdin and stdout to a session.
+ *
+ * Usage: shell_client /path/to/socket
+ */
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s socket\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(argv[1]) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%s: socket path too long\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, argv[1]);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    struct pollfd fds[2] = {{.fd = STDIN_FILENO, .events = POLLIN}, {.fd = sock, .events = POLLIN}};
+    char buf[65536];
+
+    while (1)
+    {
+        if (poll(fds, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return EXIT_FAILURE;
+        }
+
+        if (fds[0].revents)
+        {
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n <= 0)
+            {
+                // End of input: the session finishes what it has, then closes
+                shutdown(sock, SHUT_WR);
+                fds[0].fd = -1;
+            }
+            else if (write_all(sock, buf, n) == -1)
+            {
+                perror("write");
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (fds[1].revents)
+        {
+            ssize_t n = read(sock, buf, sizeof(buf));
+            if (n <= 0)
+                break; // session closed
+            if (write_all(STDOUT_FILENO, buf, n) == -1)
+                break;
+        }
+    }
+
+    close(sock);
+    return EXIT_SUCCESS;
+}
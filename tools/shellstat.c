@@ -0,0 +1,162 @@
+#include "../include/shell.h"
+#include <sys/mman.h>
+#include <time.h>
+
+/*
+ * Host-wide view of the shells running with --stats-shm. Maps the shared
+ * statistics segment read-only and sums the slots without locking: live
+ * instances, slots left by instances that died, and the retired totals of
+ * instances that exited cleanly.
+ *
+ * Usage: shellstat [-n name] [-i seconds] [-v]
+ *   -n name     segment name (default /secureshell-stats)
+ *   -i seconds  repeat every interval and show the command rate
+ *   -v          list every live instance
+ */
+
+typedef struct
+{
+    int instances;      // Slots summed into totals
+    stats_slot_t totals; // Summed counters
+} stats_sum_t;
+
+static void sum_segment(const stats_shm_t *shm, stats_sum_t *live, stats_sum_t *gone, int verbose)
+{
+    memset(live, 0, sizeof(*live));
+    memset(gone, 0, sizeof(*gone));
+
+    stats_slot_add(&gone->totals, &shm->retired);
+    if (verbose)
+        printf("%8s %10s %10s %8s %8s %12s\n", "pid", "uptime_s", "commands", "blocked", "warned", "avg_time_ms");
+
+    time_t now = time(NULL);
+    for (uint32_t i = 0; i < shm->slot_count && i < STATS_SHM_SLOTS; i++)
+    {
+        const stats_slot_t *slot = &shm->slots[i];
+        int32_t pid = __atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE);
+        if (pid <= 0)
+            continue;
+
+        stats_sum_t *sum = stats_slot_alive(pid) ? live : gone;
+        stats_slot_add(&sum->totals, slot);
+        sum->instances++;
+
+        if (verbose && sum == live)
+        {
+            uint64_t commands = __atomic_load_n(&slot->commands, __ATOMIC_RELAXED);
+            uint64_t time_ns = __atomic_load_n(&slot->total_time_ns, __ATOMIC_RELAXED);
+            printf("%8d %10ld %10lu %8lu %8lu %12.3f\n", pid, (long)(now - (time_t)slot->started),
+                   (unsigned long)commands, (unsigned long)__atomic_load_n(&slot->blocked, __ATOMIC_RELAXED),
+                   (unsigned long)__atomic_load_n(&slot->warned, __ATOMIC_RELAXED),
+                   commands ? time_ns / 1e6 / commands : 0.0);
+        }
+    }
+}
+
+/* Upper bound of the bucket holding the q-quantile, in milliseconds ("-" without samples) */
+static void format_quantile(char *buf, size_t size, const stats_slot_t *totals, double q)
+{
+    uint64_t samples = 0, seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+        samples += totals->latency_buckets[i];
+
+    snprintf(buf, size, "-");
+    uint64_t target = (uint64_t)(q * samples);
+    for (int i = 0; samples && i < LATENCY_BUCKETS; i++)
+    {
+        seen += totals->latency_buckets[i];
+        if (seen > target)
+        {
+            if (i < LATENCY_BUCKETS - 1)
+                snprintf(buf, size, "%g", latency_bucket_bounds[i] * 1e3);
+            else
+                snprintf(buf, size, "+Inf");
+            return;
+        }
+    }
+}
+
+static void print_column(const char *label, uint64_t live, uint64_t all)
+{
+    printf("%-18s %14lu %14lu\n", label, (unsigned long)live, (unsigned long)all);
+}
+
+static void print_report(const stats_sum_t *live, const stats_sum_t *gone)
+{
+    stats_slot_t all = {0};
+    stats_slot_add(&all, &live->totals);
+    stats_slot_add(&all, &gone->totals);
+    const stats_slot_t *l = &live->totals;
+
+    printf("instances: %d live, %d stale slots\n", live->instances, gone->instances);
+    printf("%-18s %14s %14s\n", "", "live", "all-time");
+    print_column("commands", l->commands, all.commands);
+    print_column("blocked", l->blocked, all.blocked);
+    print_column("warned", l->warned, all.warned);
+    print_column("limit_exceeded", l->limit_exceeded, all.limit_exceeded);
+    print_column("background_jobs", l->background_jobs, all.background_jobs);
+    printf("%-18s %14.3f %14.3f\n", "avg_time_ms", l->commands ? l->total_time_ns / 1e6 / l->commands : 0.0,
+           all.commands ? all.total_time_ns / 1e6 / all.commands : 0.0);
+
+    static const struct
+    {
+        const char *label;
+        double q;
+    } quantiles[] = {{"p50_ms <=", 0.5}, {"p99_ms <=", 0.99}};
+
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++)
+    {
+        char live_q[32], all_q[32];
+        format_quantile(live_q, sizeof(live_q), l, quantiles[i].q);
+        format_quantile(all_q, sizeof(all_q), &all, quantiles[i].q);
+        printf("%-18s %14s %14s\n", quantiles[i].label, live_q, all_q);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = STATS_SHM_NAME;
+    int interval = 0, verbose = 0, opt;
+
+    while ((opt = getopt(argc, argv, "n:i:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': name = optarg; break;
+        case 'i': interval = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-n name] [-i seconds] [-v]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    stats_shm_t *shm = stats_shm_map(name, 0);
+    if (!shm)
+    {
+        fprintf(stderr, "%s: cannot map %s: %s\n", argv[0], name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    stats_sum_t live, gone;
+    uint64_t last_commands = 0;
+    for (int round = 0;; round++)
+    {
+        sum_segment(shm, &live, &gone, verbose);
+        print_report(&live, &gone);
+
+        uint64_t commands = live.totals.commands + gone.totals.commands;
+        if (round > 0)
+            printf("%-18s %14.1f\n", "commands/s", (double)(commands - last_commands) / interval);
+        last_commands = commands;
+
+        if (interval <= 0)
+            break;
+        printf("\n");
+        fflush(stdout);
+        sleep(interval);
+    }
+
+    munmap(shm, sizeof(stats_shm_t));
+    return EXIT_SUCCESS;
+}